@@ -1,6 +1,12 @@
-#include "app.h"
+#include "app_internal.h"
 #include "../auth/auth.h"
 #include "../core/selection_tree.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include "../core/trace.h"
+#include "../storage/atomic_file.h"
+#include "../storage/checksum.h"
+#include "../storage/vote_segment.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,7 +43,7 @@ static int hex_decode(const char *hexstr, uint8_t *dst, size_t dst_len) {
     return 0;
 }
 
-static uint64_t email_hash64(const char *s) {
+uint64_t app_email_hash(const char *s) {
     uint64_t h = 1469598103934665603ULL;
     while (*s) {
         unsigned char c = (unsigned char)*s++;
@@ -47,182 +53,511 @@ static uint64_t email_hash64(const char *s) {
     return h;
 }
 
-static uint64_t vote_key(uint64_t election_id, uint64_t voter_id) {
+uint64_t app_vote_key(uint64_t election_id, uint64_t voter_id) {
     return (election_id << 32) ^ (voter_id & 0xffffffffULL);
 }
 
-static election_rec_t *find_election_by_id(app_state_t *app, uint64_t id) {
-    uint64_t ptr = 0;
-    if (hash_table_get(&app->election_by_id, id, &ptr) == 0) {
-        return (election_rec_t *)(uintptr_t)ptr;
+int app_user_eligible(const user_auth_t *u, const election_rec_t *el) {
+    if (!(u->flags & USER_FLAG_ACTIVE)) return 0;
+    return el->eligible_groups == 0 || (u->groups & el->eligible_groups) != 0;
+}
+
+election_rec_t *app_find_election(app_state_t *app, uint64_t id) {
+    uint32_t idx;
+    if (hash_table_get(&app->election_by_id, id, &idx) == 0) {
+        return (election_rec_t *)arena_at(&app->elections, idx);
     }
     return NULL;
 }
 
 int app_init(app_state_t *app) {
     memset(app, 0, sizeof(*app));
-    list_init(&app->users);
-    list_init(&app->elections);
-    list_init(&app->votes);
+    if (user_store_init(&app->users, 64) != 0) return -1;
+    if (arena_init(&app->elections, sizeof(election_rec_t), 16, MEM_TAG_ELECTIONS) != 0) return -1;
+    if (arena_init(&app->votes, sizeof(vote_rec_t), 64, MEM_TAG_VOTES) != 0) return -1;
     if (hash_table_init(&app->user_by_id, 64) != 0) return -1;
     if (hash_table_init(&app->user_by_email, 64) != 0) return -1;
     if (hash_table_init(&app->election_by_id, 64) != 0) return -1;
-    if (hash_table_init(&app->has_voted, 64) != 0) return -1;
+    if (concurrent_map_init(&app->has_voted, 64) != 0) return -1;
+    if (str_pool_init(&app->strings, 4096) != 0) return -1;
     app->next_user_id = 1;
     app->next_election_id = 1;
     app->next_vote_id = 1;
-    app->current_user = NULL;
+    app->current_user = APP_NO_USER;
     strncpy(app->admin_pin, "1234", sizeof(app->admin_pin) - 1);
     app->admin_exists = 0;
     return 0;
 }
 
-static void free_node(void *ptr) {
-    free(ptr);
+int app_attach_user(app_state_t *app, const user_auth_t *auth, const user_profile_t *profile) {
+    uint32_t idx;
+    uint64_t h = app_email_hash(profile->email);
+    if (app_reserve_email_filter(app, (size_t)app->users.count + 1) != 0) return -1;
+    if (user_store_add(&app->users, auth, profile, &idx) != 0) return -1;
+    if (hash_table_put(&app->user_by_id, auth->id, idx) != 0) {
+        user_store_pop(&app->users);
+        return -1;
+    }
+    if (hash_table_put(&app->user_by_email, h, idx) != 0) {
+        hash_table_delete(&app->user_by_id, auth->id);
+        user_store_pop(&app->users);
+        return -1;
+    }
+    bloom_add(&app->email_filter, h);
+    if (auth->flags & USER_FLAG_ADMIN) app->admin_exists = 1;
+    if (auth->id >= app->next_user_id) app->next_user_id = auth->id + 1;
+    return 0;
+}
+
+int app_attach_election(app_state_t *app, const election_rec_t *el) {
+    uint32_t idx;
+    if (arena_push(&app->elections, el, &idx) != 0) return -1;
+    if (hash_table_put(&app->election_by_id, el->id, idx) != 0) {
+        arena_pop(&app->elections);
+        return -1;
+    }
+    if (el->id >= app->next_election_id) app->next_election_id = el->id + 1;
+    return 0;
+}
+
+/* The log holds a change memory could not take: as in app_commit, refuse
+ * further changes until a restart replays it. */
+static int fail_logged(app_state_t *app) {
+    if (!app->wal) return -1;
+    fprintf(stderr, "Logged change could not be applied; refusing further changes and snapshots\n");
+    app->failed = 1;
+    return -1;
+}
+
+static int store_vote(app_state_t *app, const vote_rec_t *v) {
+    if (arena_push(&app->votes, v, NULL) != 0) return -1;
+    if (v->id >= app->next_vote_id) app->next_vote_id = v->id + 1;
+    return 0;
+}
+
+int app_attach_vote(app_state_t *app, const vote_rec_t *v) {
+    uint64_t key = app_vote_key(v->election_id, v->voter_id);
+    int rc = concurrent_map_insert_if_absent(&app->has_voted, key, 1, NULL);
+    if (rc <= 0) return rc < 0 ? -1 : 1;
+    if (store_vote(app, v) != 0) {
+        concurrent_map_remove(&app->has_voted, key);
+        return -1;
+    }
+    return 0;
+}
+
+/* Shared tail of the app_index_* builders. */
+static int build_index(hash_table_t *ht, hash_pair_t *pairs, size_t n) {
+    int rc = hash_table_build_from_pairs(ht, pairs, n);
+    mem_free(pairs);
+    return rc;
+}
+
+static hash_pair_t *alloc_pairs(uint32_t first, uint32_t count) {
+    return (hash_pair_t *)mem_alloc(MEM_TAG_INDEX, (count > first ? count - first : 1) * sizeof(hash_pair_t));
+}
+
+int app_index_users(app_state_t *app, uint32_t first) {
+    uint32_t count = app->users.count;
+    if (app_reserve_email_filter(app, count) != 0) return -1;
+    if (first >= count) return 0;
+    hash_pair_t *by_id = alloc_pairs(first, count);
+    hash_pair_t *by_email = alloc_pairs(first, count);
+    if (!by_id || !by_email) {
+        mem_free(by_id);
+        mem_free(by_email);
+        return -1;
+    }
+    for (uint32_t i = first; i < count; i++) {
+        const user_auth_t *u = user_store_auth(&app->users, i);
+        by_id[i - first].key = u->id;
+        by_id[i - first].value = i;
+        by_email[i - first].key = app_email_hash(user_store_profile(&app->users, i)->email);
+        by_email[i - first].value = i;
+        bloom_add(&app->email_filter, by_email[i - first].key);
+        if (u->flags & USER_FLAG_ADMIN) app->admin_exists = 1;
+        if (u->id >= app->next_user_id) app->next_user_id = u->id + 1;
+    }
+    int rc = build_index(&app->user_by_id, by_id, count - first);
+    if (build_index(&app->user_by_email, by_email, count - first) != 0) rc = -1;
+    return rc;
+}
+
+/* Elections are few, so they go in with put_many in arena order rather
+ * than through the region sort of build_from_pairs. */
+int app_index_elections(app_state_t *app, uint32_t first) {
+    uint32_t count = app->elections.count;
+    if (first >= count) return 0;
+    uint64_t *keys = (uint64_t *)mem_alloc(MEM_TAG_INDEX, (size_t)(count - first) * sizeof(uint64_t));
+    uint32_t *values = (uint32_t *)mem_alloc(MEM_TAG_INDEX, (size_t)(count - first) * sizeof(uint32_t));
+    int rc = keys && values ? 0 : -1;
+    for (uint32_t i = first; rc == 0 && i < count; i++) {
+        const election_rec_t *el = (const election_rec_t *)arena_at(&app->elections, i);
+        keys[i - first] = el->id;
+        values[i - first] = i;
+        if (el->id >= app->next_election_id) app->next_election_id = el->id + 1;
+    }
+    if (rc == 0) rc = hash_table_put_many(&app->election_by_id, keys, values, count - first);
+    mem_free(keys);
+    mem_free(values);
+    return rc;
+}
+
+/* Votes between prefetching a has_voted key and inserting it. */
+#define VOTE_PREFETCH 16u
+
+int app_index_votes(app_state_t *app, uint32_t first) {
+    uint32_t count = app->votes.count;
+    if (first >= count) return 0;
+    if (concurrent_map_reserve(&app->has_voted, concurrent_map_size(&app->has_voted) + (count - first)) != 0) return -1;
+    const vote_rec_t *votes = (const vote_rec_t *)app->votes.data;
+    for (uint32_t i = first; i < count; i++) {
+        if (i + VOTE_PREFETCH < count) {
+            const vote_rec_t *ahead = &votes[i + VOTE_PREFETCH];
+            concurrent_map_prefetch(&app->has_voted, app_vote_key(ahead->election_id, ahead->voter_id));
+        }
+        if (concurrent_map_insert_if_absent(&app->has_voted, app_vote_key(votes[i].election_id, votes[i].voter_id), 1,
+                                            NULL) < 0) {
+            return -1;
+        }
+        if (votes[i].id >= app->next_vote_id) app->next_vote_id = votes[i].id + 1;
+    }
+    concurrent_map_reclaim(&app->has_voted); /* loaders run before any other thread */
+    return 0;
+}
+
+int app_index_vote_ids(app_state_t *app, const eytzinger_t *stored) {
+    uint32_t count = app->votes.count, blocks = (count + VOTE_BLOCK_SIZE - 1) / VOTE_BLOCK_SIZE;
+    eytzinger_free(&app->vote_blocks);
+    app->indexed_votes = 0;
+    int rc;
+    if (stored && stored->count == blocks) {
+        rc = eytzinger_clone(&app->vote_blocks, stored);
+    } else {
+        const vote_rec_t *votes = (const vote_rec_t *)app->votes.data;
+        uint64_t *first_ids = (uint64_t *)mem_alloc(MEM_TAG_INDEX, ((size_t)blocks + 1) * sizeof(uint64_t));
+        if (!first_ids) return -1;
+        for (uint32_t b = 0; b < blocks; b++) first_ids[b] = votes[(size_t)b * VOTE_BLOCK_SIZE].id;
+        rc = eytzinger_build(&app->vote_blocks, first_ids, blocks);
+        mem_free(first_ids);
+    }
+    if (rc == 0) app->indexed_votes = count;
+    return rc;
+}
+
+/* Position of the first vote with an id >= id, or > id when upper. The
+ * block tree narrows an indexed id to one block; the rest is a binary
+ * search over at most VOTE_BLOCK_SIZE votes, or over the unindexed tail. */
+static uint32_t vote_bound(const app_state_t *app, uint64_t id, int upper) {
+    const vote_rec_t *votes = (const vote_rec_t *)app->votes.data;
+    uint32_t lo = app->indexed_votes, hi = app->votes.count;
+    if (lo > 0 && (upper ? id < votes[lo - 1].id : id <= votes[lo - 1].id)) {
+        uint32_t b = upper ? eytzinger_upper_bound(&app->vote_blocks, id) : eytzinger_lower_bound(&app->vote_blocks, id);
+        if (b == 0) return 0;
+        hi = b < app->vote_blocks.count ? b * VOTE_BLOCK_SIZE : app->indexed_votes;
+        lo = (b - 1) * VOTE_BLOCK_SIZE;
+    }
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (upper ? votes[mid].id <= id : votes[mid].id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void app_vote_range(const app_state_t *app, uint64_t first_id, uint64_t last_id, uint32_t *begin, uint32_t *end) {
+    *begin = vote_bound(app, first_id, 0);
+    *end = first_id <= last_id ? vote_bound(app, last_id, 1) : *begin;
+}
+
+/* Sized at twice the need, so sign-ups rebuild it rarely. */
+int app_reserve_email_filter(app_state_t *app, size_t users) {
+    if (app->email_filter.block_count && users <= app->email_filter.capacity) return 0;
+    bloom_t f;
+    if (bloom_init(&f, users < 512 ? 1024 : users * 2) != 0) return -1;
+    for (uint64_t i = 0; i < app->frozen_by_email.count; i++) bloom_add(&f, perfect_hash_key_at(&app->frozen_by_email, i));
+    hash_iter_t it;
+    uint64_t key;
+    hash_iter_init(&it, &app->user_by_email);
+    while (hash_iter_next(&it, &key, NULL)) bloom_add(&f, key);
+    bloom_free(&app->email_filter);
+    app->email_filter = f;
+    return 0;
+}
+
+static void drop_frozen_users(app_state_t *app) {
+    perfect_hash_free(&app->frozen_by_id);
+    perfect_hash_free(&app->frozen_by_email);
+    if (app->frozen_map.data) plat_unmap_file(&app->frozen_map);
+    memset(&app->frozen_map, 0, sizeof(app->frozen_map));
+    app->frozen_users = 0;
+}
+
+int app_freeze_users(app_state_t *app) {
+    uint32_t count = app->users.count;
+    if (count == 0 || count == app->frozen_users) return 0;
+    hash_pair_t *by_id = alloc_pairs(0, count);
+    hash_pair_t *by_email = alloc_pairs(0, count);
+    perfect_hash_t id_ix, email_ix;
+    int rc = by_id && by_email ? 0 : -1;
+    for (uint32_t i = 0; rc == 0 && i < count; i++) {
+        by_id[i].key = user_store_auth(&app->users, i)->id;
+        by_id[i].value = i;
+        by_email[i].key = app_email_hash(user_store_profile(&app->users, i)->email);
+        by_email[i].value = i;
+    }
+    trace_begin_u64("app.freeze_users", "users", count);
+    /* Fails, changing nothing, if old CSV data left two users one email. */
+    if (rc == 0) rc = perfect_hash_build(&id_ix, by_id, count);
+    if (rc == 0 && perfect_hash_build(&email_ix, by_email, count) != 0) {
+        perfect_hash_free(&id_ix);
+        rc = -1;
+    }
+    trace_end("app.freeze_users");
+    mem_free(by_id);
+    mem_free(by_email);
+    if (rc != 0) return -1;
+    drop_frozen_users(app);
+    app->frozen_by_id = id_ix;
+    app->frozen_by_email = email_ix;
+    app->frozen_users = count;
+    hash_table_free(&app->user_by_id);
+    hash_table_free(&app->user_by_email);
+    if (hash_table_init(&app->user_by_id, 64) != 0 || hash_table_init(&app->user_by_email, 64) != 0) return -1;
+    return 0;
+}
+
+int app_user_slot_by_id(const app_state_t *app, uint64_t id, uint32_t *slot) {
+    uint32_t s;
+    if (perfect_hash_get(&app->frozen_by_id, id, &s) != 0 && hash_table_get(&app->user_by_id, id, &s) != 0) return -1;
+    if (s >= app->users.count) return -1;
+    if (slot) *slot = s;
+    return 0;
+}
+
+int app_user_slot_by_email(const app_state_t *app, uint64_t email_hash, uint32_t *slot) {
+    uint32_t s;
+    if (!bloom_may_contain(&app->email_filter, email_hash)) return -1;
+    if (perfect_hash_get(&app->frozen_by_email, email_hash, &s) != 0 &&
+        hash_table_get(&app->user_by_email, email_hash, &s) != 0) {
+        return -1;
+    }
+    if (s >= app->users.count) return -1;
+    if (slot) *slot = s;
+    return 0;
 }
 
 void app_free(app_state_t *app) {
-    list_clear(&app->users, free_node);
-    list_clear(&app->elections, free_node);
-    list_clear(&app->votes, free_node);
+    app_wal_close(app);
+    drop_frozen_users(app);
+    user_store_free(&app->users);
+    arena_free(&app->elections);
+    arena_free(&app->votes);
     hash_table_free(&app->user_by_id);
     hash_table_free(&app->user_by_email);
     hash_table_free(&app->election_by_id);
-    hash_table_free(&app->has_voted);
+    concurrent_map_free(&app->has_voted);
+    eytzinger_free(&app->vote_blocks);
+    bloom_free(&app->email_filter);
+    str_pool_free(&app->strings);
 }
 
 int app_register_user(app_state_t *app, const char *name, const char *email, const char *password, role_t role) {
     if (role == ROLE_ADMIN && app->admin_exists) {
         return -1; /* only one admin allowed */
     }
-    uint64_t h = email_hash64(email);
-    uint64_t dummy;
-    if (hash_table_get(&app->user_by_email, h, &dummy) == 0) {
+    uint64_t h = app_email_hash(email);
+    if (app_user_slot_by_email(app, h, NULL) == 0) {
         return -1; /* already exists */
     }
-    user_rec_t *u = (user_rec_t *)calloc(1, sizeof(user_rec_t));
-    if (!u) return -1;
-    u->id = app->next_user_id++;
-    strncpy(u->name, name, MAX_NAME - 1);
-    strncpy(u->email, email, sizeof(u->email) - 1);
-    u->role = role;
-    u->active = 1;
+    user_auth_t auth;
+    user_profile_t profile;
+    memset(&auth, 0, sizeof(auth));
+    memset(&profile, 0, sizeof(profile));
+    auth.id = app->next_user_id;
+    auth.flags = USER_FLAG_ACTIVE | (role == ROLE_ADMIN ? USER_FLAG_ADMIN : 0);
+    strncpy(profile.name, name, MAX_NAME - 1);
+    strncpy(profile.email, email, EMAIL_LEN - 1);
     /* salt can be zeros for demo */
-    auth_hash_password(u->salt, password, u->pass_hash);
-    if (list_push_back(&app->users, u) != 0) return -1;
-    hash_table_put(&app->user_by_id, u->id, (uint64_t)(uintptr_t)u);
-    hash_table_put(&app->user_by_email, h, (uint64_t)(uintptr_t)u);
-    if (role == ROLE_ADMIN) {
-        app->admin_exists = 1;
-    }
-    return 0;
+    auth_hash_password(auth.salt, password, auth.pass_hash);
+    if (app_log_user(app, &auth, &profile) != 0) return -1;
+    if (app_attach_user(app, &auth, &profile) != 0) return fail_logged(app);
+    app->change_seq++;
+    return app_commit(app);
 }
 
 int app_login(app_state_t *app, const char *email, const char *password, const char *admin_pin_opt) {
-    uint64_t h = email_hash64(email);
-    uint64_t ptr = 0;
-    if (hash_table_get(&app->user_by_email, h, &ptr) != 0) return -1;
-    user_rec_t *u = (user_rec_t *)(uintptr_t)ptr;
+    uint64_t h = app_email_hash(email);
+    uint32_t idx = 0;
+    if (app_user_slot_by_email(app, h, &idx) != 0) return -1;
+    const user_auth_t *u = user_store_auth(&app->users, idx);
+    if (!u || !(u->flags & USER_FLAG_ACTIVE)) return -1;
     if (auth_verify_password(u, password) != 0) return -1;
-    if (u->role == ROLE_ADMIN) {
+    if (u->flags & USER_FLAG_ADMIN) {
         if (!admin_pin_opt || strcmp(admin_pin_opt, app->admin_pin) != 0) {
             return -1;
         }
     }
-    app->current_user = u;
+    app->current_user = idx;
     return 0;
 }
 
 void app_logout(app_state_t *app) {
-    app->current_user = NULL;
+    app->current_user = APP_NO_USER;
 }
 
-int app_create_election(app_state_t *app, const char *title, const char *desc, char candidates[][64], uint32_t cand_count) {
-    if (!app->current_user || app->current_user->role != ROLE_ADMIN) return -1;
-    election_rec_t *el = (election_rec_t *)calloc(1, sizeof(election_rec_t));
-    if (!el) return -1;
-    el->id = app->next_election_id++;
-    strncpy(el->title, title, TITLE_LEN - 1);
-    strncpy(el->description, desc, DESC_LEN - 1);
-    el->phase = ELECTION_CREATED;
-    el->candidate_count = cand_count;
-    for (uint32_t i = 0; i < cand_count; i++) {
-        strncpy(el->candidates[i], candidates[i], sizeof(el->candidates[i]) - 1);
-    }
-    list_push_back(&app->elections, el);
-    hash_table_put(&app->election_by_id, el->id, (uint64_t)(uintptr_t)el);
+const user_auth_t *app_current_user(const app_state_t *app) {
+    return user_store_auth(&app->users, app->current_user);
+}
+
+static int current_is_admin(const app_state_t *app) {
+    const user_auth_t *u = app_current_user(app);
+    return u && (u->flags & USER_FLAG_ADMIN);
+}
+
+int app_set_candidates(app_state_t *app, election_rec_t *el, const char *const *names, uint32_t count) {
+    str_ref_t *refs = (str_ref_t *)mem_alloc(MEM_TAG_MISC, (count ? count : 1) * sizeof(str_ref_t));
+    if (!refs) return -1;
+    for (uint32_t i = 0; i < count; i++) {
+        char name[CAND_NAME_LEN];
+        strncpy(name, names[i], sizeof(name) - 1);
+        name[sizeof(name) - 1] = 0;
+        if (str_pool_intern(&app->strings, name, &refs[i]) != 0) {
+            mem_free(refs);
+            return -1;
+        }
+    }
+    int rc = str_pool_add_refs(&app->strings, refs, count, &el->candidates);
+    mem_free(refs);
+    if (rc != 0) return -1;
+    el->candidate_count = count;
     return 0;
 }
 
+int app_set_description(app_state_t *app, election_rec_t *el, const char *desc) {
+    char buf[DESC_LEN];
+    strncpy(buf, desc, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+    return str_pool_intern(&app->strings, buf, &el->description);
+}
+
+const char *app_election_description(const app_state_t *app, const election_rec_t *el) {
+    return str_pool_get(&app->strings, el->description);
+}
+
+const char *app_election_candidate(const app_state_t *app, const election_rec_t *el, uint32_t index) {
+    if (index >= el->candidate_count) return "";
+    return str_pool_get(&app->strings, str_pool_refs(&app->strings, el->candidates)[index]);
+}
+
+int app_create_election(app_state_t *app, const char *title, const char *desc, const char *const *candidates, uint32_t cand_count) {
+    if (!current_is_admin(app)) return -1;
+    election_rec_t el;
+    memset(&el, 0, sizeof(el));
+    strncpy(el.title, title, TITLE_LEN - 1);
+    el.phase = ELECTION_CREATED;
+    if (app_set_description(app, &el, desc) != 0 || app_set_candidates(app, &el, candidates, cand_count) != 0) {
+        return -1;
+    }
+    el.id = app->next_election_id;
+    if (app_log_election(app, &el) != 0) return -1;
+    if (app_attach_election(app, &el) != 0) return fail_logged(app);
+    app->change_seq++;
+    return app_commit(app);
+}
+
 int app_open_voting(app_state_t *app, uint64_t election_id) {
-    election_rec_t *el = find_election_by_id(app, election_id);
-    if (!el || !app->current_user || app->current_user->role != ROLE_ADMIN) return -1;
+    election_rec_t *el = app_find_election(app, election_id);
+    if (!el || !current_is_admin(app)) return -1;
     if (el->phase == ELECTION_CREATED || el->phase == REGISTRATION_OPEN) {
+        if (app_log_phase(app, election_id, VOTING_OPEN) != 0) return -1;
         el->phase = VOTING_OPEN;
-        return 0;
+        app->change_seq++;
+        return app_commit(app);
     }
     return -1;
 }
 
 int app_close_voting(app_state_t *app, uint64_t election_id) {
-    election_rec_t *el = find_election_by_id(app, election_id);
-    if (!el || !app->current_user || app->current_user->role != ROLE_ADMIN) return -1;
+    election_rec_t *el = app_find_election(app, election_id);
+    if (!el || !current_is_admin(app)) return -1;
     if (el->phase == VOTING_OPEN) {
+        if (app_log_phase(app, election_id, VOTING_CLOSED) != 0) return -1;
         el->phase = VOTING_CLOSED;
-        return 0;
+        app->change_seq++;
+        return app_commit(app);
     }
     return -1;
 }
 
 int app_cast_vote(app_state_t *app, uint64_t election_id, uint32_t choice) {
-    if (!app->current_user) return -1;
-    election_rec_t *el = find_election_by_id(app, election_id);
+    const user_auth_t *voter = app_current_user(app);
+    if (!voter) return -1;
+    election_rec_t *el = app_find_election(app, election_id);
     if (!el || el->phase != VOTING_OPEN) return -1;
     if (choice >= el->candidate_count) return -1;
-    uint64_t key = vote_key(election_id, app->current_user->id);
-    uint64_t dummy;
-    if (hash_table_get(&app->has_voted, key, &dummy) == 0) {
+    if (!app_user_eligible(voter, el)) return -1;
+    /* Room is made before the vote is logged, so storing it cannot fail
+     * once the WAL holds it. */
+    if (arena_reserve_more(&app->votes, 1) != 0) return -1;
+    uint64_t key = app_vote_key(election_id, voter->id);
+    /* Claiming the key is the double-vote check: a single insert-if-absent,
+     * so of two casts racing for one voter and election exactly one wins. */
+    if (concurrent_map_insert_if_absent(&app->has_voted, key, 1, NULL) != 1) {
         return -1; /* already voted */
     }
-    vote_rec_t *v = (vote_rec_t *)calloc(1, sizeof(vote_rec_t));
-    if (!v) return -1;
-    v->id = app->next_vote_id++;
-    v->election_id = election_id;
-    v->voter_id = app->current_user->id;
-    v->choice = choice;
-    list_push_back(&app->votes, v);
-    hash_table_put(&app->has_voted, key, 1);
-    return 0;
+    vote_rec_t v;
+    memset(&v, 0, sizeof(v));
+    v.id = app->next_vote_id;
+    v.election_id = election_id;
+    v.voter_id = voter->id;
+    v.choice = choice;
+    if (app_log_vote(app, &v) != 0) {
+        concurrent_map_remove(&app->has_voted, key);
+        return -1;
+    }
+    if (store_vote(app, &v) != 0) return fail_logged(app);
+    app->change_seq++;
+    return app_commit(app);
 }
 
 int app_tally(app_state_t *app, uint64_t election_id) {
-    election_rec_t *el = find_election_by_id(app, election_id);
+    election_rec_t *el = app_find_election(app, election_id);
     if (!el) return -1;
-    uint64_t counts[MAX_CAND] = {0};
-    for (list_node_t *node = app->votes.head; node; node = node->next) {
-        vote_rec_t *v = (vote_rec_t *)node->data;
-        if (v->election_id == election_id && v->choice < el->candidate_count) {
-            counts[v->choice]++;
+    trace_begin_u64("app.tally", "election_id", election_id);
+    uint64_t *counts = (uint64_t *)mem_calloc(MEM_TAG_MISC, el->candidate_count ? el->candidate_count : 1, sizeof(uint64_t));
+    if (!counts) {
+        trace_end("app.tally");
+        return -1;
+    }
+    const vote_rec_t *votes = (const vote_rec_t *)app->votes.data;
+    for (uint32_t i = 0; i < app->votes.count; i++) {
+        if (votes[i].election_id == election_id && votes[i].choice < el->candidate_count) {
+            counts[votes[i].choice]++;
         }
     }
     selection_tree_t tree;
     if (selection_tree_build(&tree, counts, el->candidate_count) != 0) {
+        mem_free(counts);
+        trace_end("app.tally");
         return -1;
     }
     size_t win = selection_tree_winner(&tree);
     printf("Tally for election %" PRIu64 " (%s):\n", el->id, el->title);
     for (uint32_t i = 0; i < el->candidate_count; i++) {
-        printf("  [%u] %-20s : %" PRIu64 "\n", i, el->candidates[i], counts[i]);
+        printf("  [%u] %-20s : %" PRIu64 "\n", i, app_election_candidate(app, el, i), counts[i]);
     }
-    printf("Winner: [%zu] %s\n", win, el->candidates[win]);
+    printf("Winner: [%zu] %s\n", win, app_election_candidate(app, el, (uint32_t)win));
     selection_tree_free(&tree);
+    mem_free(counts);
+    trace_end("app.tally");
     return 0;
 }
 
 void app_list_elections(app_state_t *app) {
     puts("Elections:");
-    for (list_node_t *node = app->elections.head; node; node = node->next) {
-        election_rec_t *el = (election_rec_t *)node->data;
+    for (uint32_t i = 0; i < app->elections.count; i++) {
+        const election_rec_t *el = (const election_rec_t *)arena_at(&app->elections, i);
         printf("  ID=%" PRIu64 " title=%s phase=%d candidates=%u\n",
                el->id, el->title, el->phase, el->candidate_count);
     }
@@ -230,34 +565,39 @@ void app_list_elections(app_state_t *app) {
 
 void app_list_users(app_state_t *app) {
     puts("Users:");
-    for (list_node_t *node = app->users.head; node; node = node->next) {
-        user_rec_t *u = (user_rec_t *)node->data;
+    for (uint32_t i = 0; i < app->users.count; i++) {
+        const user_auth_t *u = user_store_auth(&app->users, i);
+        const user_profile_t *p = user_store_profile(&app->users, i);
         printf("  ID=%" PRIu64 " name=%s email=%s role=%s\n",
-               u->id, u->name, u->email, u->role == ROLE_ADMIN ? "admin" : "voter");
+               u->id, p->name, p->email, (u->flags & USER_FLAG_ADMIN) ? "admin" : "voter");
     }
 }
 
-int app_export_votes_csv(app_state_t *app, const char *path) {
-    FILE *f = fopen(path, "w");
-    if (!f) return -1;
-    fputs("id,election_id,voter_id,choice\n", f);
-    for (list_node_t *node = app->votes.head; node; node = node->next) {
-        vote_rec_t *v = (vote_rec_t *)node->data;
-        fprintf(f, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u\n",
-                v->id, v->election_id, v->voter_id, v->choice);
+void app_print_stats(app_state_t *app, FILE *out) {
+    fputs("Records:\n", out);
+    fprintf(out, "  users      %10u x %5zu bytes hot + %zu bytes cold\n",
+            app->users.count, sizeof(user_auth_t), sizeof(user_profile_t));
+    fprintf(out, "  elections  %10u x %5zu bytes\n", app->elections.count, sizeof(election_rec_t));
+    fprintf(out, "  votes      %10u x %5zu bytes\n", app->votes.count, sizeof(vote_rec_t));
+    fputs("Indexes (entries / buckets):\n", out);
+    fprintf(out, "  user_by_id     %10zu / %zu\n", app->user_by_id.size, app->user_by_id.capacity);
+    fprintf(out, "  user_by_email  %10zu / %zu\n", app->user_by_email.size, app->user_by_email.capacity);
+    if (app->frozen_users) {
+        fprintf(out, "  frozen users   %10u, %zu + %zu bytes (%s)\n", app->frozen_users, app->frozen_by_id.size,
+                app->frozen_by_email.size, app->frozen_map.data ? "mapped" : "built");
     }
-    fclose(f);
-    return 0;
+    fprintf(out, "  email filter   %10" PRIu64 " / %" PRIu64 ", %" PRIu64 " bytes\n", app->email_filter.count,
+            app->email_filter.capacity, app->email_filter.block_count * 64);
+    fprintf(out, "  election_by_id %10zu / %zu\n", app->election_by_id.size, app->election_by_id.capacity);
+    fprintf(out, "  has_voted      %10zu / %zu\n", concurrent_map_size(&app->has_voted),
+            concurrent_map_capacity(&app->has_voted));
+    fprintf(out, "  vote ids       %10u indexed in %u blocks, %u after\n", app->indexed_votes, app->vote_blocks.count,
+            app->votes.count - app->indexed_votes);
+    fprintf(out, "String pool: %u / %u bytes\n", app->strings.size, app->strings.capacity);
+    fputs("Memory by subsystem:\n", out);
+    mem_report(out);
 }
 
-typedef struct {
-    uint8_t admin_exists;
-    char admin_pin[32];
-    uint64_t next_user_id;
-    uint64_t next_election_id;
-    uint64_t next_vote_id;
-} state_header_t;
-
 static int ensure_dir(const char *dir) {
 #ifdef _WIN32
     _mkdir(dir);
@@ -267,91 +607,153 @@ static int ensure_dir(const char *dir) {
     return 0;
 }
 
-static void join_candidates(election_rec_t *el, char *buf, size_t bufsz) {
-    buf[0] = 0;
+static void write_candidates(app_state_t *app, election_rec_t *el, atomic_file_t *af) {
     for (uint32_t i = 0; i < el->candidate_count; i++) {
-        if (i > 0 && strlen(buf) + 1 < bufsz) {
-            strncat(buf, "|", bufsz - strlen(buf) - 1);
-        }
-        strncat(buf, el->candidates[i], bufsz - strlen(buf) - 1);
+        if (i > 0) atomic_file_puts(af, "|");
+        atomic_file_puts(af, app_election_candidate(app, el, i));
     }
 }
 
-static uint32_t split_candidates(const char *s, election_rec_t *el) {
-    char tmp[1024];
-    strncpy(tmp, s, sizeof(tmp) - 1);
-    tmp[sizeof(tmp) - 1] = 0;
+/* Splits "a|b|c" in place; s must stay alive until the names are interned. */
+static int split_candidates(app_state_t *app, char *s, election_rec_t *el) {
+    uint32_t cap = 1;
+    for (const char *p = s; *p; p++) {
+        if (*p == '|') cap++;
+    }
+    const char **names = (const char **)mem_alloc(MEM_TAG_MISC, cap * sizeof(char *));
+    if (!names) return -1;
     uint32_t count = 0;
-    char *tok = strtok(tmp, "|");
-    while (tok && count < MAX_CAND) {
-        strncpy(el->candidates[count], tok, sizeof(el->candidates[count]) - 1);
-        el->candidates[count][sizeof(el->candidates[count]) - 1] = 0;
-        count++;
+    char *tok = strtok(s, "|");
+    while (tok && count < cap) {
+        names[count++] = tok;
         tok = strtok(NULL, "|");
     }
-    el->candidate_count = count;
-    return count;
+    int rc = app_set_candidates(app, el, names, count);
+    mem_free(names);
+    return rc;
 }
 
+/* Each CSV is written to a temp file, fsynced and renamed into place, so a
+ * crash leaves either the previous or the new version of every file. */
 int app_save_to_disk(app_state_t *app, const char *dir) {
+    if (app->failed) return -1;
     ensure_dir(dir);
     char path[256];
+    atomic_file_t af;
     /* state.csv */
     snprintf(path, sizeof(path), "%s/state.csv", dir);
-    FILE *fs = fopen(path, "w");
-    if (fs) {
-        fprintf(fs, "admin_exists,admin_pin,next_user_id,next_election_id,next_vote_id\n");
-        fprintf(fs, "%u,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
-                app->admin_exists ? 1u : 0u, app->admin_pin,
-                app->next_user_id, app->next_election_id, app->next_vote_id);
-        fclose(fs);
+    trace_begin_str("save.state", "path", path);
+    FILE *fs = atomic_file_open(&af, path);
+    if (!fs) {
+        trace_end("save.state");
+        return -1;
     }
+    atomic_file_printf(&af, "admin_exists,admin_pin,next_user_id,next_election_id,next_vote_id,wal_lsn\n");
+    atomic_file_printf(&af, "%u,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+            app->admin_exists ? 1u : 0u, app->admin_pin,
+            app->next_user_id, app->next_election_id, app->next_vote_id, app->wal_lsn);
+    int rc = atomic_file_commit(&af);
+    trace_end("save.state");
+    if (rc != 0) return -1;
     /* users.csv */
     snprintf(path, sizeof(path), "%s/users.csv", dir);
-    FILE *fu = fopen(path, "w");
-    if (!fu) return -1;
-    fprintf(fu, "id,name,email,role,active,salt_hex,hash_hex\n");
-    for (list_node_t *n = app->users.head; n; n = n->next) {
-        user_rec_t *u = (user_rec_t *)n->data;
+    trace_begin_str("save.users", "path", path);
+    FILE *fu = atomic_file_open(&af, path);
+    if (!fu) {
+        trace_end("save.users");
+        return -1;
+    }
+    atomic_file_printf(&af, "id,name,email,role,active,salt_hex,hash_hex,groups\n");
+    for (uint32_t i = 0; i < app->users.count; i++) {
+        const user_auth_t *u = user_store_auth(&app->users, i);
+        const user_profile_t *p = user_store_profile(&app->users, i);
         char salt_hex[SALT_LEN * 2 + 1];
         char hash_hex[HASH_LEN * 2 + 1];
         hex_encode(u->salt, SALT_LEN, salt_hex, sizeof(salt_hex));
         hex_encode(u->pass_hash, HASH_LEN, hash_hex, sizeof(hash_hex));
-        fprintf(fu, "%" PRIu64 ",%s,%s,%u,%u,%s,%s\n",
-                u->id, u->name, u->email, (unsigned)u->role, (unsigned)u->active, salt_hex, hash_hex);
+        atomic_file_printf(&af, "%" PRIu64 ",%s,%s,%u,%u,%s,%s,%u\n",
+                u->id, p->name, p->email, (u->flags & USER_FLAG_ADMIN) ? 1u : 0u,
+                (u->flags & USER_FLAG_ACTIVE) ? 1u : 0u, salt_hex, hash_hex, (unsigned)u->groups);
     }
-    fclose(fu);
+    rc = atomic_file_commit(&af);
+    trace_end("save.users");
+    if (rc != 0) return -1;
     /* elections.csv */
     snprintf(path, sizeof(path), "%s/elections.csv", dir);
-    FILE *fe = fopen(path, "w");
-    if (!fe) return -1;
-    fprintf(fe, "id,title,description,phase,candidate_count,candidates\n");
-    for (list_node_t *n = app->elections.head; n; n = n->next) {
-        election_rec_t *el = (election_rec_t *)n->data;
-        char cand_buf[2048];
-        join_candidates(el, cand_buf, sizeof(cand_buf));
-        fprintf(fe, "%" PRIu64 ",%s,%s,%u,%u,%s\n",
-                el->id, el->title, el->description, (unsigned)el->phase, el->candidate_count, cand_buf);
-    }
-    fclose(fe);
+    trace_begin_str("save.elections", "path", path);
+    FILE *fe = atomic_file_open(&af, path);
+    if (!fe) {
+        trace_end("save.elections");
+        return -1;
+    }
+    atomic_file_printf(&af, "id,title,description,phase,candidate_count,candidates,eligible_groups\n");
+    for (uint32_t i = 0; i < app->elections.count; i++) {
+        election_rec_t *el = (election_rec_t *)arena_at(&app->elections, i);
+        atomic_file_printf(&af, "%" PRIu64 ",%s,%s,%u,%u,",
+                el->id, el->title, app_election_description(app, el), (unsigned)el->phase, el->candidate_count);
+        write_candidates(app, el, &af);
+        atomic_file_printf(&af, ",%u\n", (unsigned)el->eligible_groups);
+    }
+    rc = atomic_file_commit(&af);
+    trace_end("save.elections");
+    if (rc != 0) return -1;
     /* votes.csv */
     snprintf(path, sizeof(path), "%s/votes.csv", dir);
-    FILE *fv = fopen(path, "w");
-    if (!fv) return -1;
-    fprintf(fv, "id,election_id,voter_id,choice\n");
-    for (list_node_t *n = app->votes.head; n; n = n->next) {
-        vote_rec_t *v = (vote_rec_t *)n->data;
-        fprintf(fv, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u\n",
+    trace_begin_str("save.votes", "path", path);
+    FILE *fv = atomic_file_open(&af, path);
+    if (!fv) {
+        trace_end("save.votes");
+        return -1;
+    }
+    atomic_file_printf(&af, "id,election_id,voter_id,choice\n");
+    for (uint32_t i = 0; i < app->votes.count; i++) {
+        const vote_rec_t *v = (const vote_rec_t *)arena_at(&app->votes, i);
+        atomic_file_printf(&af, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u\n",
                 v->id, v->election_id, v->voter_id, v->choice);
     }
-    fclose(fv);
-    return 0;
+    rc = atomic_file_commit(&af);
+    trace_end("save.votes");
+    if (rc != 0) return -1;
+    return plat_fsync_dir(dir);
+}
+
+/* Checks the four CSVs in parallel before parsing any of them, so damaged
+ * data never reaches the tables. Files written before checksums existed
+ * load unverified. */
+static int verify_csv_files(const char *dir) {
+    static const char *const names[] = {"state.csv", "users.csv", "elections.csv", "votes.csv"};
+    char paths[4][256];
+    checksum_job_t jobs[4];
+    memset(jobs, 0, sizeof(jobs));
+    for (int i = 0; i < 4; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%s", dir, names[i]);
+        jobs[i].path = paths[i];
+        jobs[i].kind = CHECKSUM_TEXT;
+    }
+    trace_begin_str("load.verify", "dir", dir);
+    int rc = checksum_verify(jobs, 4);
+    trace_end("load.verify");
+    for (int i = 0; rc != 0 && i < 4; i++) {
+        if (jobs[i].status == CHECKSUM_OK || jobs[i].status == CHECKSUM_MISSING) continue;
+        char msg[512];
+        checksum_describe(&jobs[i], msg, sizeof(msg));
+        fprintf(stderr, "%s\n", msg);
+    }
+    return rc;
+}
+
+static int vote_id_cmp(const void *a, const void *b) {
+    uint64_t x = ((const vote_rec_t *)a)->id, y = ((const vote_rec_t *)b)->id;
+    return x < y ? -1 : x > y;
 }
 
 int app_load_from_disk(app_state_t *app, const char *dir) {
     char path[256];
+    int rc = 0;
+    if (verify_csv_files(dir) != 0) return -1;
     /* state.csv */
     snprintf(path, sizeof(path), "%s/state.csv", dir);
+    trace_begin_str("load.state", "path", path);
     FILE *fs = fopen(path, "r");
     if (fs) {
         char line[256];
@@ -367,84 +769,111 @@ int app_load_from_disk(app_state_t *app, const char *dir) {
             if (tok) app->next_election_id = strtoull(tok, NULL, 10);
             tok = strtok(NULL, ",");
             if (tok) app->next_vote_id = strtoull(tok, NULL, 10);
+            tok = strtok(NULL, ",");
+            if (tok) app->wal_lsn = strtoull(tok, NULL, 10);
         }
         fclose(fs);
     }
+    trace_end("load.state");
     /* users.csv */
     snprintf(path, sizeof(path), "%s/users.csv", dir);
+    trace_begin_str("load.users", "path", path);
     FILE *fu = fopen(path, "r");
+    uint32_t first = app->users.count;
     if (fu) {
         char line[512];
         fgets(line, sizeof(line), fu); /* header */
-        while (fgets(line, sizeof(line), fu)) {
+        while (rc == 0 && fgets(line, sizeof(line), fu)) {
+            if (line[0] == '#') continue; /* checksum line */
             char *tok = strtok(line, ",");
             if (!tok) continue;
-            user_rec_t *u = (user_rec_t *)calloc(1, sizeof(user_rec_t));
-            u->id = strtoull(tok, NULL, 10);
-            if ((tok = strtok(NULL, ","))) strncpy(u->name, tok, sizeof(u->name) - 1);
-            if ((tok = strtok(NULL, ","))) strncpy(u->email, tok, sizeof(u->email) - 1);
-            if ((tok = strtok(NULL, ","))) u->role = (role_t)atoi(tok);
-            if ((tok = strtok(NULL, ","))) u->active = (uint8_t)atoi(tok);
-            if ((tok = strtok(NULL, ","))) hex_decode(tok, u->salt, SALT_LEN);
-            if ((tok = strtok(NULL, ","))) {
-                tok[strcspn(tok, "\r\n")] = 0;
-                hex_decode(tok, u->pass_hash, HASH_LEN);
-            }
-            list_push_back(&app->users, u);
-            hash_table_put(&app->user_by_id, u->id, (uint64_t)(uintptr_t)u);
-            hash_table_put(&app->user_by_email, email_hash64(u->email), (uint64_t)(uintptr_t)u);
-            if (u->role == ROLE_ADMIN) app->admin_exists = 1;
-            if (u->id >= app->next_user_id) app->next_user_id = u->id + 1;
+            user_auth_t u;
+            user_profile_t p;
+            memset(&u, 0, sizeof(u));
+            memset(&p, 0, sizeof(p));
+            u.id = strtoull(tok, NULL, 10);
+            if ((tok = strtok(NULL, ","))) strncpy(p.name, tok, sizeof(p.name) - 1);
+            if ((tok = strtok(NULL, ","))) strncpy(p.email, tok, sizeof(p.email) - 1);
+            if ((tok = strtok(NULL, ",")) && atoi(tok) == ROLE_ADMIN) u.flags |= USER_FLAG_ADMIN;
+            if ((tok = strtok(NULL, ",")) && atoi(tok)) u.flags |= USER_FLAG_ACTIVE;
+            if ((tok = strtok(NULL, ","))) hex_decode(tok, u.salt, SALT_LEN);
+            if ((tok = strtok(NULL, ",\r\n"))) hex_decode(tok, u.pass_hash, HASH_LEN);
+            if ((tok = strtok(NULL, ",\r\n"))) u.groups = (uint32_t)strtoul(tok, NULL, 10);
+            rc = user_store_add(&app->users, &u, &p, NULL);
         }
         fclose(fu);
     }
+    if (rc == 0) rc = app_index_users(app, first);
+    trace_end("load.users");
+    if (rc != 0) return -1;
     /* elections.csv */
     snprintf(path, sizeof(path), "%s/elections.csv", dir);
+    trace_begin_str("load.elections", "path", path);
     FILE *fe = fopen(path, "r");
+    first = app->elections.count;
     if (fe) {
         char line[4096];
         fgets(line, sizeof(line), fe); /* header */
-        while (fgets(line, sizeof(line), fe)) {
+        while (rc == 0 && fgets(line, sizeof(line), fe)) {
+            if (line[0] == '#') continue; /* checksum line */
             char *tok = strtok(line, ",");
             if (!tok) continue;
-            election_rec_t *el = (election_rec_t *)calloc(1, sizeof(election_rec_t));
-            el->id = strtoull(tok, NULL, 10);
-            if ((tok = strtok(NULL, ","))) strncpy(el->title, tok, sizeof(el->title) - 1);
-            if ((tok = strtok(NULL, ","))) strncpy(el->description, tok, sizeof(el->description) - 1);
-            if ((tok = strtok(NULL, ","))) el->phase = (election_phase_t)atoi(tok);
-            if ((tok = strtok(NULL, ","))) el->candidate_count = (uint32_t)strtoul(tok, NULL, 10);
-            if ((tok = strtok(NULL, ","))) {
-                tok[strcspn(tok, "\r\n")] = 0;
-                split_candidates(tok, el);
+            election_rec_t el;
+            memset(&el, 0, sizeof(el));
+            el.id = strtoull(tok, NULL, 10);
+            if ((tok = strtok(NULL, ","))) strncpy(el.title, tok, sizeof(el.title) - 1);
+            if ((tok = strtok(NULL, ","))) app_set_description(app, &el, tok);
+            if ((tok = strtok(NULL, ","))) el.phase = (election_phase_t)atoi(tok);
+            if ((tok = strtok(NULL, ","))) el.candidate_count = (uint32_t)strtoul(tok, NULL, 10);
+            char *cands = strtok(NULL, ",\r\n");
+            if ((tok = strtok(NULL, ",\r\n"))) el.eligible_groups = (uint32_t)strtoul(tok, NULL, 10);
+            if (!cands || split_candidates(app, cands, &el) != 0) {
+                el.candidate_count = 0;
             }
-            list_push_back(&app->elections, el);
-            hash_table_put(&app->election_by_id, el->id, (uint64_t)(uintptr_t)el);
-            if (el->id >= app->next_election_id) app->next_election_id = el->id + 1;
+            rc = arena_push(&app->elections, &el, NULL);
         }
         fclose(fe);
     }
+    if (rc == 0) rc = app_index_elections(app, first);
+    trace_end("load.elections");
+    if (rc != 0) return -1;
     /* votes.csv */
     snprintf(path, sizeof(path), "%s/votes.csv", dir);
+    trace_begin_str("load.votes", "path", path);
     FILE *fv = fopen(path, "r");
+    first = app->votes.count;
     if (fv) {
         char line[256];
         fgets(line, sizeof(line), fv); /* header */
-        while (fgets(line, sizeof(line), fv)) {
-            vote_rec_t *v = (vote_rec_t *)calloc(1, sizeof(vote_rec_t));
+        while (rc == 0 && fgets(line, sizeof(line), fv)) {
+            if (line[0] == '#') continue; /* checksum line */
+            vote_rec_t v;
+            memset(&v, 0, sizeof(v));
             char *tok = strtok(line, ",");
-            if (!tok) { free(v); continue; }
-            v->id = strtoull(tok, NULL, 10);
-            if ((tok = strtok(NULL, ","))) v->election_id = strtoull(tok, NULL, 10);
-            if ((tok = strtok(NULL, ","))) v->voter_id = strtoull(tok, NULL, 10);
-            if ((tok = strtok(NULL, ","))) v->choice = (uint32_t)strtoul(tok, NULL, 10);
-            list_push_back(&app->votes, v);
-            uint64_t key = vote_key(v->election_id, v->voter_id);
-            hash_table_put(&app->has_voted, key, 1);
-            if (v->id >= app->next_vote_id) app->next_vote_id = v->id + 1;
+            if (!tok) continue;
+            v.id = strtoull(tok, NULL, 10);
+            if ((tok = strtok(NULL, ","))) v.election_id = strtoull(tok, NULL, 10);
+            if ((tok = strtok(NULL, ","))) v.voter_id = strtoull(tok, NULL, 10);
+            if ((tok = strtok(NULL, ","))) v.choice = (uint32_t)strtoul(tok, NULL, 10);
+            rc = arena_push(&app->votes, &v, NULL);
         }
         fclose(fv);
     }
-    app->current_user = NULL;
+    if (rc != 0) {
+        trace_end("load.votes");
+        return -1;
+    }
+    /* Range queries need the arena in id order, which a hand-edited or
+     * concatenated votes.csv need not be. */
+    vote_rec_t *votes = (vote_rec_t *)app->votes.data;
+    int sorted = 1;
+    for (uint32_t i = first + 1; i < app->votes.count && sorted; i++) sorted = votes[i].id >= votes[i - 1].id;
+    if (!sorted) qsort(votes + first, app->votes.count - first, sizeof(*votes), vote_id_cmp);
+    rc = app_index_votes(app, first);
+    if (rc == 0) rc = app_index_vote_ids(app, NULL);
+    trace_end("load.votes");
+    if (rc != 0) return -1;
+    app->current_user = APP_NO_USER;
     return 0;
 }
 
@@ -1,44 +1,113 @@
 #pragma once
 #include <stdint.h>
-#include "../core/linked_list.h"
+#include <stdio.h>
+#include "../core/arena.h"
+#include "../core/bloom.h"
+#include "../core/concurrent_map.h"
+#include "../core/eytzinger.h"
 #include "../core/hash_table.h"
+#include "../core/perfect_hash.h"
+#include "../core/platform.h"
+#include "../core/str_pool.h"
+#include "user_store.h"
+#include "../storage/wal.h"
 #include "../models/user.h"
 #include "../models/election.h"
 #include "../models/vote.h"
 
-typedef struct {
+typedef struct app_state {
     uint64_t next_user_id;
     uint64_t next_election_id;
     uint64_t next_vote_id;
     char admin_pin[32];
     int admin_exists;
-    linked_list_t users;
-    linked_list_t elections;
-    linked_list_t votes;
-    hash_table_t user_by_id;
-    hash_table_t user_by_email;
-    hash_table_t election_by_id;
-    hash_table_t has_voted; /* key = (election_id << 32) ^ voter_id */
-    user_rec_t *current_user;
+    user_store_t users;
+    arena_t elections;      /* election_rec_t */
+    arena_t votes;          /* vote_rec_t */
+    hash_table_t user_by_id;     /* user id -> user slot */
+    hash_table_t user_by_email;  /* email hash -> user slot */
+    /* Frozen counterparts over users [0, frozen_users), from app_freeze_users
+     * or mapped from the snapshot; the two tables above hold later users. */
+    perfect_hash_t frozen_by_id;
+    perfect_hash_t frozen_by_email;
+    uint32_t frozen_users;
+    plat_map_t frozen_map; /* snapshot file they were mapped from, if any */
+    /* Every user's email hash, frozen or not. A miss settles an email
+     * lookup without probing either index, as for most new sign-ups. */
+    bloom_t email_filter;
+    hash_table_t election_by_id; /* election id -> election index */
+    concurrent_map_t has_voted; /* key = (election_id << 32) ^ voter_id */
+    /* First id of each VOTE_BLOCK_SIZE run of votes [0, indexed_votes), for
+     * app_vote_range; later votes are searched directly. */
+    eytzinger_t vote_blocks;
+    uint32_t indexed_votes;
+    str_pool_t strings;     /* election descriptions and candidate names */
+    uint32_t current_user; /* user slot, APP_NO_USER when logged out */
+    uint64_t change_seq;   /* bumped by every successful mutation */
+    wal_t *wal;            /* NULL unless mutations are logged */
+    uint64_t wal_lsn;      /* last LSN logged or applied */
+    /* Set when a commit could not be made durable. Memory may then hold a
+     * change the log does not, so further changes, snapshots and CSV saves
+     * are refused; a restart recovers from whatever the log holds. */
+    int failed;
+    /* Called once each mutation is durable (may be NULL). */
+    void (*on_commit)(const struct app_state *app, void *ctx);
+    void *on_commit_ctx;
 } app_state_t;
 
+#define APP_NO_USER UINT32_MAX
+
 int app_init(app_state_t *app);
 void app_free(app_state_t *app);
 
 int app_register_user(app_state_t *app, const char *name, const char *email, const char *password, role_t role);
 int app_login(app_state_t *app, const char *email, const char *password, const char *admin_pin_opt);
 void app_logout(app_state_t *app);
+const user_auth_t *app_current_user(const app_state_t *app);
+/* Moves every current user into the frozen (perfect hash) id and email
+ * indexes, for when registration is over: lookups cost one or two memory
+ * accesses and the indexes about 13 bytes per user, and the snapshot
+ * carries them so loads map them instead of rebuilding. Users registered
+ * later go to the ordinary tables until the next freeze. */
+int app_freeze_users(app_state_t *app);
 
-int app_create_election(app_state_t *app, const char *title, const char *desc, char candidates[][64], uint32_t cand_count);
+int app_create_election(app_state_t *app, const char *title, const char *desc, const char *const *candidates, uint32_t cand_count);
+const char *app_election_description(const app_state_t *app, const election_rec_t *el);
+const char *app_election_candidate(const app_state_t *app, const election_rec_t *el, uint32_t index);
+election_rec_t *app_find_election(app_state_t *app, uint64_t election_id); /* valid until the next insert */
 int app_open_voting(app_state_t *app, uint64_t election_id);
 int app_close_voting(app_state_t *app, uint64_t election_id);
 int app_cast_vote(app_state_t *app, uint64_t election_id, uint32_t choice);
 int app_tally(app_state_t *app, uint64_t election_id);
+/* Positions [*begin, *end) of the votes with ids in [first_id, last_id].
+ * Votes are appended in id order, so the range is contiguous. */
+void app_vote_range(const app_state_t *app, uint64_t first_id, uint64_t last_id, uint32_t *begin, uint32_t *end);
 void app_list_elections(app_state_t *app);
 void app_list_users(app_state_t *app);
-int app_export_votes_csv(app_state_t *app, const char *path);
+void app_print_stats(app_state_t *app, FILE *out);
 int app_save_to_disk(app_state_t *app, const char *dir);
 int app_load_from_disk(app_state_t *app, const char *dir);
+/* Writes a new snapshot generation; 0 only once its MANIFEST is durable,
+ * so a caller may drop the WAL it covers only then. */
 int app_save(app_state_t *app, const char *dir);
+/* 1 when dir has no MANIFEST (nothing saved yet); -1, with the damaged
+ * file, block or records reported on stderr, when the snapshot it names
+ * cannot be loaded. */
 int app_load(app_state_t *app, const char *dir);
+/* Replays <dir> from wal_lsn + 1, then logs every mutation to a new segment;
+ * opts (may be NULL) picks the I/O engine and O_DIRECT. Fails, opening no
+ * writer, when the replay does. */
+int app_wal_open(app_state_t *app, const char *dir, const wal_options_t *opts);
+/* Replay only, for offline tools; *out_next_lsn (may be NULL) is where the
+ * log continues. -1 when a record cannot be applied, or one fails its CRC
+ * anywhere but the torn tail of the newest segment. */
+int app_wal_replay(app_state_t *app, const char *dir, uint64_t *out_next_lsn);
+void app_wal_close(app_state_t *app);
+/* Applies one logged mutation; records already reflected in state are skipped. */
+int app_apply_wal(app_state_t *app, const wal_record_hdr_t *hdr, const void *payload);
+/* Repeatedly kills a process mid-snapshot in dir and verifies the result
+ * still loads as one generation; returns -1 if any round failed. */
+int app_crash_harness(const char *dir, unsigned rounds, FILE *out);
+/* Publishes a read-only shared snapshot for reader processes (see shm_view.h). */
+int app_publish_shm(const app_state_t *app, const char *path, uint64_t generation);
 
@@ -0,0 +1,304 @@
+#include "export.h"
+#include "app_internal.h"
+#include "../core/crc32c.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include "../core/trace.h"
+#include "../storage/atomic_file.h"
+#include "../storage/checksum.h"
+#include "../storage/vote_segment.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPORT_BUF (1u << 20)
+/* Longest formatted vote: a JSON line with five 20-digit numbers. */
+#define EXPORT_MAX_LINE 192u
+
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+/* Writes v in decimal at p, two digits per division; returns the end. */
+static char *put_u64(char *p, uint64_t v) {
+    char tmp[20];
+    char *t = tmp + sizeof(tmp);
+    while (v >= 100) {
+        unsigned d = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--t = digit_pairs[d + 1];
+        *--t = digit_pairs[d];
+    }
+    if (v >= 10) {
+        unsigned d = (unsigned)v * 2;
+        *--t = digit_pairs[d + 1];
+        *--t = digit_pairs[d];
+    } else {
+        *--t = (char)('0' + v);
+    }
+    size_t n = (size_t)(tmp + sizeof(tmp) - t);
+    memcpy(p, t, n);
+    return p + n;
+}
+
+static char *put_i64(char *p, int64_t v) {
+    if (v >= 0) return put_u64(p, (uint64_t)v);
+    *p++ = '-';
+    return put_u64(p, 0 - (uint64_t)v);
+}
+
+static char *put_lit(char *p, const char *s, size_t n) {
+    memcpy(p, s, n);
+    return p + n;
+}
+#define PUT_LIT(p, s) put_lit((p), (s), sizeof(s) - 1)
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+    uint64_t bytes;
+    int failed;
+} export_out_t;
+
+static void out_flush(export_out_t *o) {
+    if (o->len && !o->failed && plat_write(o->fd, o->buf, o->len) != 0) o->failed = 1;
+    o->bytes += o->len;
+    o->len = 0;
+}
+
+/* Room for n more bytes at the returned pointer; commit with out->len. */
+static char *out_reserve(export_out_t *o, size_t n) {
+    if (EXPORT_BUF - o->len < n) out_flush(o);
+    return o->buf + o->len;
+}
+
+/* The id range is cut out of the arena by app_vote_range; the election
+ * filter is applied vote by vote. */
+static int vote_matches(const vote_rec_t *v, const export_options_t *opts) {
+    return opts->election_id == 0 || v->election_id == opts->election_id;
+}
+
+static int unfiltered(const export_options_t *opts) {
+    return opts->election_id == 0 && opts->first_id == 0 && opts->last_id == UINT64_MAX;
+}
+
+/* CSV lines go through the CRC as they are formatted, with a check line
+ * every CHECKSUM_TEXT_LINES lines, matching what atomic_file_printf writes. */
+static void export_csv(app_state_t *app, const export_options_t *opts, export_out_t *out, uint64_t *count) {
+    static const char header[] = "id,election_id,voter_id,choice\n";
+    char *p = out_reserve(out, sizeof(header));
+    memcpy(p, header, sizeof(header) - 1);
+    out->len += sizeof(header) - 1;
+    uint32_t crc = crc32c(0, header, sizeof(header) - 1), lines = 1;
+    const vote_rec_t *votes = (const vote_rec_t *)app->votes.data;
+    uint32_t begin, end;
+    app_vote_range(app, opts->first_id, opts->last_id, &begin, &end);
+    for (uint32_t i = begin; i < end; i++) {
+        const vote_rec_t *v = &votes[i];
+        if (!vote_matches(v, opts)) continue;
+        char *s = out_reserve(out, EXPORT_MAX_LINE);
+        p = put_u64(s, v->id);
+        *p++ = ',';
+        p = put_u64(p, v->election_id);
+        *p++ = ',';
+        p = put_u64(p, v->voter_id);
+        *p++ = ',';
+        p = put_u64(p, v->choice);
+        *p++ = '\n';
+        crc = crc32c(crc, s, (size_t)(p - s));
+        out->len += (size_t)(p - s);
+        (*count)++;
+        if (++lines == CHECKSUM_TEXT_LINES) {
+            out->len += (size_t)checksum_text_line(out_reserve(out, 64), 64, crc, lines);
+            crc = 0;
+            lines = 0;
+        }
+    }
+    if (lines) out->len += (size_t)checksum_text_line(out_reserve(out, 64), 64, crc, lines);
+}
+
+static void export_jsonl(app_state_t *app, const export_options_t *opts, export_out_t *out, uint64_t *count) {
+    const vote_rec_t *votes = (const vote_rec_t *)app->votes.data;
+    uint32_t begin, end;
+    app_vote_range(app, opts->first_id, opts->last_id, &begin, &end);
+    for (uint32_t i = begin; i < end; i++) {
+        const vote_rec_t *v = &votes[i];
+        if (!vote_matches(v, opts)) continue;
+        char *s = out_reserve(out, EXPORT_MAX_LINE);
+        char *p = PUT_LIT(s, "{\"id\":");
+        p = put_u64(p, v->id);
+        p = PUT_LIT(p, ",\"election_id\":");
+        p = put_u64(p, v->election_id);
+        p = PUT_LIT(p, ",\"voter_id\":");
+        p = put_u64(p, v->voter_id);
+        p = PUT_LIT(p, ",\"choice\":");
+        p = put_u64(p, v->choice);
+        p = PUT_LIT(p, ",\"timestamp\":");
+        p = put_i64(p, (int64_t)v->timestamp);
+        p = PUT_LIT(p, "}\n");
+        out->len += (size_t)(p - s);
+        (*count)++;
+    }
+}
+
+/* Serves the snapshot's stream when it holds exactly this state; otherwise
+ * encodes the selected votes into a temp file and sends that. */
+static int export_columnar(app_state_t *app, const export_options_t *opts, int fd, export_stats_t *stats) {
+    char path[300];
+    uint64_t off, len;
+    if (unfiltered(opts) && opts->data_dir &&
+        app_snapshot_votes_stream(opts->data_dir, app->wal_lsn, app->votes.count, path, sizeof(path), &off, &len) == 0) {
+        int in = plat_open_read(path);
+        if (in >= 0) {
+            int rc = plat_sendfile(fd, in, off, len);
+            plat_close_fd(in);
+            if (rc >= 0) {
+                stats->zero_copy = rc == 1;
+                stats->votes = app->votes.count;
+                stats->bytes = len;
+                return 0;
+            }
+        }
+    }
+    uint32_t begin, end;
+    app_vote_range(app, opts->first_id, opts->last_id, &begin, &end);
+    const vote_rec_t *votes = (const vote_rec_t *)app->votes.data + begin;
+    uint32_t *sel = NULL;
+    uint64_t count = end - begin;
+    if (opts->election_id != 0) {
+        sel = (uint32_t *)mem_alloc(MEM_TAG_MISC, (count ? count : 1) * sizeof(uint32_t));
+        if (!sel) return -1;
+        count = 0;
+        for (uint32_t i = 0; i < end - begin; i++) {
+            if (vote_matches(&votes[i], opts)) sel[count++] = i;
+        }
+    }
+    FILE *tmp = tmpfile();
+    uint64_t bytes = 0;
+    int rc = tmp && vote_seg_write(tmp, votes, sel, count, &bytes) == 0 && fflush(tmp) == 0 &&
+                     plat_sendfile(fd, fileno(tmp), 0, bytes) >= 0
+                 ? 0
+                 : -1;
+    if (tmp) fclose(tmp);
+    mem_free(sel);
+    stats->votes = count;
+    stats->bytes = bytes;
+    return rc;
+}
+
+void export_options_init(export_options_t *opts, export_format_t format) {
+    memset(opts, 0, sizeof(*opts));
+    opts->format = format;
+    opts->last_id = UINT64_MAX;
+}
+
+int export_parse_id_range(const char *s, export_options_t *opts) {
+    opts->first_id = 0;
+    opts->last_id = UINT64_MAX;
+    if (!s || !*s) return 0;
+    char *end;
+    const char *dash = strchr(s, '-');
+    if (dash != s) {
+        opts->first_id = strtoull(s, &end, 10);
+        if (end == s || (*end && end != dash)) return -1;
+    }
+    if (!dash) {
+        opts->last_id = opts->first_id;
+    } else if (dash[1]) {
+        opts->last_id = strtoull(dash + 1, &end, 10);
+        if (end == dash + 1 || *end) return -1;
+    }
+    return opts->first_id <= opts->last_id ? 0 : -1;
+}
+
+int export_format_from_name(const char *name, export_format_t *out) {
+    if (!name || !*name || strcmp(name, "csv") == 0) *out = EXPORT_CSV;
+    else if (strcmp(name, "jsonl") == 0) *out = EXPORT_JSONL;
+    else if (strcmp(name, "columnar") == 0) *out = EXPORT_COLUMNAR;
+    else return -1;
+    return 0;
+}
+
+const char *export_format_name(export_format_t format) {
+    switch (format) {
+    case EXPORT_CSV: return "csv";
+    case EXPORT_JSONL: return "jsonl";
+    case EXPORT_COLUMNAR: return "columnar";
+    }
+    return "?";
+}
+
+int app_export_votes(app_state_t *app, const export_options_t *opts, int fd, export_stats_t *stats) {
+    export_stats_t local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    uint64_t start = plat_now_ns();
+    trace_begin_str("export.votes", "format", export_format_name(opts->format));
+    int rc;
+    if (opts->format == EXPORT_COLUMNAR) {
+        rc = export_columnar(app, opts, fd, stats);
+    } else {
+        export_out_t out;
+        memset(&out, 0, sizeof(out));
+        out.fd = fd;
+        out.buf = (char *)mem_alloc(MEM_TAG_MISC, EXPORT_BUF);
+        if (!out.buf) {
+            trace_end("export.votes");
+            return -1;
+        }
+        if (opts->format == EXPORT_JSONL) export_jsonl(app, opts, &out, &stats->votes);
+        else export_csv(app, opts, &out, &stats->votes);
+        out_flush(&out);
+        mem_free(out.buf);
+        stats->bytes = out.bytes;
+        rc = out.failed ? -1 : 0;
+    }
+    trace_end("export.votes");
+    stats->elapsed_ns = plat_now_ns() - start;
+    return rc;
+}
+
+int app_export_votes_to_path(app_state_t *app, const export_options_t *opts, const char *path, export_stats_t *stats) {
+    char tmp[300];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return -1;
+    int fd = plat_open_write(tmp, PLAT_OPEN_TRUNC);
+    if (fd < 0) return -1;
+    int rc = app_export_votes(app, opts, fd, stats);
+    if (rc == 0) rc = plat_fdatasync(fd);
+    plat_close_fd(fd);
+    if (rc == 0) rc = plat_replace_file(tmp, path);
+    if (rc != 0) remove(tmp);
+    return rc;
+}
+
+int export_merge_segments(const char *const *paths, size_t count, const char *out_path, vote_seg_merge_stats_t *stats) {
+    plat_map_t *maps = (plat_map_t *)mem_calloc(MEM_TAG_MISC, count ? count : 1, sizeof(plat_map_t));
+    vote_seg_view_t *views = (vote_seg_view_t *)mem_calloc(MEM_TAG_MISC, count ? count : 1, sizeof(vote_seg_view_t));
+    int rc = maps && views ? 0 : -1;
+    for (size_t i = 0; i < count && rc == 0; i++) {
+        /* Blocks end before the index, so the decoders' slack stays inside the map. */
+        if (plat_map_file(&maps[i], paths[i]) != 0 ||
+            vote_seg_view_open(&views[i], (const uint8_t *)maps[i].data, maps[i].size) != 0) {
+            fprintf(stderr, "%s: not a vote segment stream\n", paths[i]);
+            rc = -1;
+        }
+    }
+    trace_begin_u64("export.merge", "inputs", count);
+    atomic_file_t af;
+    FILE *f = rc == 0 ? atomic_file_open(&af, out_path) : NULL;
+    if (rc == 0 && !f) rc = -1;
+    if (rc == 0 && vote_seg_merge(f, views, count, NULL, NULL, stats) != 0) {
+        atomic_file_abort(&af);
+        rc = -1;
+    } else if (rc == 0) {
+        rc = atomic_file_commit(&af);
+    }
+    trace_end("export.merge");
+    for (size_t i = 0; maps && i < count; i++) {
+        if (maps[i].data) plat_unmap_file(&maps[i]);
+    }
+    mem_free(maps);
+    mem_free(views);
+    return rc;
+}
@@ -0,0 +1,393 @@
+#include "import.h"
+#include "app_internal.h"
+#include "../auth/auth.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include "../core/trace.h"
+#include <string.h>
+
+#define IMPORT_MAX_THREADS 64
+#define IMPORT_MIN_CHUNK (1u << 20)
+#define IMPORT_MAX_PASSWORD 256
+#define IMPORT_BATCH 512 /* keys per batched index lookup */
+#define IMPORT_PREFETCH 16 /* rows between prefetching a key and inserting it */
+
+typedef struct {
+    const char *p;
+    size_t len;
+} field_t;
+
+typedef struct {
+    const char *line;
+    uint64_t email_hash;
+    uint32_t slot; /* user slot once indexed; UINT32_MAX for a duplicate */
+    uint32_t groups;
+} voter_row_t;
+
+typedef struct {
+    uint64_t election_id;
+    uint64_t voter_id;
+    uint32_t choice;
+    uint32_t election; /* index into the elections arena */
+    uint64_t line;     /* within the chunk */
+} ballot_row_t;
+
+typedef struct import_job import_job_t;
+
+typedef struct {
+    import_job_t *job;
+    const char *begin;
+    const char *end;
+    int first; /* holds the file's first line */
+    void *rows;
+    size_t row_size;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t lines;     /* every line, for line numbers */
+    uint64_t data_rows;
+    uint64_t rejected;
+    uint64_t first_bad; /* 1-based within the chunk; 0 if none */
+    int failed;
+} import_chunk_t;
+
+struct import_job {
+    app_state_t *app;
+    import_kind_t kind;
+    import_chunk_t chunks[IMPORT_MAX_THREADS];
+    unsigned count;
+    void (*fn)(import_chunk_t *c);
+    uint32_t first_slot;
+    uint64_t first_id;
+};
+
+/* Splits [s, e) at commas; returns the field count, or max + 1 when there
+ * are more than max. */
+static int split_fields(const char *s, const char *e, field_t *f, int max) {
+    for (int n = 0; n < max; n++) {
+        const char *c = (const char *)memchr(s, ',', (size_t)(e - s));
+        f[n].p = s;
+        f[n].len = (size_t)((c ? c : e) - s);
+        if (!c) return n + 1;
+        s = c + 1;
+    }
+    return max + 1;
+}
+
+static int field_u64(const field_t *f, uint64_t *out) {
+    if (f->len == 0 || f->len > 20) return -1;
+    uint64_t v = 0;
+    for (size_t i = 0; i < f->len; i++) {
+        unsigned d = (unsigned)(f->p[i] - '0');
+        if (d > 9 || v > (UINT64_MAX - d) / 10) return -1;
+        v = v * 10 + d;
+    }
+    *out = v;
+    return 0;
+}
+
+static const char *line_end(const char *s, const char *end) {
+    const char *nl = (const char *)memchr(s, '\n', (size_t)(end - s));
+    return nl ? nl : end;
+}
+
+static void *push_row(import_chunk_t *c) {
+    if (c->count == c->capacity) {
+        uint64_t cap = c->capacity ? c->capacity * 2 : (uint64_t)(c->end - c->begin) / 48 + 16;
+        void *rows = mem_realloc(MEM_TAG_MISC, c->rows, (size_t)cap * c->row_size);
+        if (!rows) {
+            c->failed = 1;
+            return NULL;
+        }
+        c->rows = rows;
+        c->capacity = cap;
+    }
+    return (uint8_t *)c->rows + (size_t)c->count++ * c->row_size;
+}
+
+static int parse_voter(import_chunk_t *c, const char *s, const char *e) {
+    field_t f[4];
+    int n = split_fields(s, e, f, 4);
+    uint64_t groups = 0;
+    if (n < 3 || n > 4 || f[0].len == 0 || f[0].len >= MAX_NAME || f[1].len == 0 || f[1].len >= EMAIL_LEN ||
+        f[2].len == 0 || f[2].len >= IMPORT_MAX_PASSWORD || (n == 4 && (field_u64(&f[3], &groups) != 0 || groups > UINT32_MAX))) {
+        return -1;
+    }
+    char email[EMAIL_LEN];
+    memcpy(email, f[1].p, f[1].len);
+    email[f[1].len] = 0;
+    voter_row_t *r = (voter_row_t *)push_row(c);
+    if (!r) return 0;
+    r->line = s;
+    r->email_hash = app_email_hash(email);
+    r->slot = UINT32_MAX;
+    r->groups = (uint32_t)groups;
+    return 0;
+}
+
+/* The tables are only read while chunks parse, so ballots are validated
+ * here: the election per row (a small table), voters in batches by
+ * check_voters. Duplicates are left to the ordered pass. */
+static int parse_ballot(import_chunk_t *c, const char *s, const char *e) {
+    field_t f[3];
+    uint64_t election_id, voter_id, choice;
+    if (split_fields(s, e, f, 3) != 3 || field_u64(&f[0], &election_id) != 0 || field_u64(&f[1], &voter_id) != 0 ||
+        field_u64(&f[2], &choice) != 0) {
+        return -1;
+    }
+    app_state_t *app = c->job->app;
+    uint32_t idx;
+    if (hash_table_get(&app->election_by_id, election_id, &idx) != 0) return -1;
+    const election_rec_t *el = (const election_rec_t *)arena_at(&app->elections, idx);
+    if (el->phase != VOTING_OPEN || choice >= el->candidate_count) return -1;
+    ballot_row_t *r = (ballot_row_t *)push_row(c);
+    if (!r) return 0;
+    r->election_id = election_id;
+    r->voter_id = voter_id;
+    r->choice = (uint32_t)choice;
+    r->election = idx;
+    r->line = c->lines;
+    return 0;
+}
+
+static void reject(import_chunk_t *c, uint64_t line) {
+    c->rejected++;
+    if (!c->first_bad || line < c->first_bad) c->first_bad = line;
+}
+
+/* Drops ballots from unknown or ineligible voters, resolving voter ids a
+ * batch at a time. */
+static void check_voters(import_chunk_t *c) {
+    app_state_t *app = c->job->app;
+    ballot_row_t *rows = (ballot_row_t *)c->rows;
+    uint64_t keys[IMPORT_BATCH];
+    uint32_t slots[IMPORT_BATCH];
+    uint8_t found[IMPORT_BATCH];
+    uint64_t kept = 0;
+    for (uint64_t i = 0; i < c->count; i += IMPORT_BATCH) {
+        size_t n = c->count - i < IMPORT_BATCH ? (size_t)(c->count - i) : IMPORT_BATCH;
+        for (size_t k = 0; k < n; k++) keys[k] = rows[i + k].voter_id;
+        hash_table_get_many(&app->user_by_id, keys, n, slots, found);
+        for (size_t k = 0; k < n; k++) {
+            const ballot_row_t *r = &rows[i + k];
+            /* Voters from before the last freeze are only in the frozen index. */
+            if (!found[k]) found[k] = app_user_slot_by_id(app, keys[k], &slots[k]) == 0;
+            if (!found[k] || !app_user_eligible(user_store_auth(&app->users, slots[k]),
+                                                (const election_rec_t *)arena_at(&app->elections, r->election))) {
+                reject(c, r->line);
+                continue;
+            }
+            rows[kept++] = *r;
+        }
+    }
+    c->count = kept;
+}
+
+static void parse_chunk(import_chunk_t *c) {
+    int voters = c->job->kind == IMPORT_VOTERS;
+    for (const char *s = c->begin; s < c->end && !c->failed;) {
+        const char *e = line_end(s, c->end);
+        const char *next = e < c->end ? e + 1 : e;
+        c->lines++;
+        if (e > s && e[-1] == '\r') e--;
+        int header = c->first && c->lines == 1 &&
+                     (voters ? strncmp(s, "name,", 5) == 0 : strncmp(s, "election_id,", 12) == 0);
+        if (e > s && *s != '#' && !header) {
+            c->data_rows++;
+            if ((voters ? parse_voter(c, s, e) : parse_ballot(c, s, e)) != 0) reject(c, c->lines);
+        }
+        s = next;
+    }
+    if (!voters && !c->failed) check_voters(c);
+}
+
+/* Fills the slots the ordered pass gave this chunk's new voters. */
+static void fill_voters(import_chunk_t *c) {
+    app_state_t *app = c->job->app;
+    const voter_row_t *rows = (const voter_row_t *)c->rows;
+    for (uint64_t i = 0; i < c->count; i++) {
+        const voter_row_t *r = &rows[i];
+        if (r->slot == UINT32_MAX) continue;
+        const char *e = line_end(r->line, c->end);
+        if (e > r->line && e[-1] == '\r') e--;
+        field_t f[4];
+        split_fields(r->line, e, f, 4);
+        user_auth_t *u = user_store_auth(&app->users, r->slot);
+        user_profile_t *p = user_store_profile(&app->users, r->slot);
+        u->id = c->job->first_id + (r->slot - c->job->first_slot);
+        u->flags = USER_FLAG_ACTIVE;
+        u->groups = r->groups;
+        char password[IMPORT_MAX_PASSWORD];
+        memcpy(password, f[2].p, f[2].len);
+        password[f[2].len] = 0;
+        auth_hash_password(u->salt, password, u->pass_hash);
+        memcpy(p->name, f[0].p, f[0].len);
+        memcpy(p->email, f[1].p, f[1].len);
+    }
+}
+
+static void *chunk_thread(void *arg) {
+    import_chunk_t *c = (import_chunk_t *)arg;
+    c->job->fn(c);
+    return NULL;
+}
+
+/* One chunk per thread; the calling thread takes the first. */
+static void run_chunks(import_job_t *job, void (*fn)(import_chunk_t *c)) {
+    plat_thread_t workers[IMPORT_MAX_THREADS];
+    int started[IMPORT_MAX_THREADS];
+    job->fn = fn;
+    for (unsigned i = 1; i < job->count; i++) {
+        started[i] = plat_thread_create(&workers[i], chunk_thread, &job->chunks[i]) == 0;
+    }
+    fn(&job->chunks[0]);
+    for (unsigned i = 1; i < job->count; i++) {
+        if (started[i]) plat_thread_join(&workers[i]);
+        else fn(&job->chunks[i]);
+    }
+}
+
+/* Indexes new voters' emails in file order so the first row with an email
+ * wins, then bulk-builds the id index; records are filled afterwards, in
+ * parallel. */
+static int index_voters(import_job_t *job, uint64_t total, import_stats_t *stats) {
+    app_state_t *app = job->app;
+    if (hash_table_reserve(&app->user_by_email, app->user_by_email.size + total) != 0 ||
+        app_reserve_email_filter(app, app->users.count + total) != 0) {
+        return -1;
+    }
+    job->first_slot = app->users.count;
+    job->first_id = app->next_user_id;
+    uint32_t slot = job->first_slot;
+    for (unsigned i = 0; i < job->count; i++) {
+        voter_row_t *rows = (voter_row_t *)job->chunks[i].rows;
+        for (uint64_t r = 0; r < job->chunks[i].count; r++) {
+            if (bloom_may_contain(&app->email_filter, rows[r].email_hash) &&
+                perfect_hash_get(&app->frozen_by_email, rows[r].email_hash, NULL) == 0) {
+                stats->duplicates++;
+                continue;
+            }
+            int inserted;
+            uint32_t *value = hash_table_upsert(&app->user_by_email, rows[r].email_hash, &inserted);
+            if (!value || slot == UINT32_MAX) return -1;
+            if (!inserted) {
+                stats->duplicates++;
+                continue;
+            }
+            *value = slot;
+            rows[r].slot = slot++;
+            bloom_add(&app->email_filter, rows[r].email_hash);
+        }
+    }
+    uint32_t added = slot - job->first_slot;
+    hash_pair_t *pairs = (hash_pair_t *)mem_alloc(MEM_TAG_INDEX, (added ? added : 1) * sizeof(hash_pair_t));
+    if (!pairs) return -1;
+    for (uint32_t i = 0; i < added; i++) {
+        pairs[i].key = job->first_id + i;
+        pairs[i].value = job->first_slot + i;
+    }
+    int rc = hash_table_build_from_pairs(&app->user_by_id, pairs, added);
+    mem_free(pairs);
+    if (rc != 0 || user_store_extend(&app->users, added, NULL) != 0) return -1;
+    app->next_user_id += added;
+    stats->imported = added;
+    return 0;
+}
+
+static int attach_ballots(import_job_t *job, uint64_t total, import_stats_t *stats) {
+    app_state_t *app = job->app;
+    if (concurrent_map_reserve(&app->has_voted, concurrent_map_size(&app->has_voted) + total) != 0 ||
+        arena_reserve(&app->votes, (size_t)app->votes.count + total) != 0) {
+        return -1;
+    }
+    concurrent_map_reclaim(&app->has_voted); /* only this thread attaches */
+    vote_rec_t v;
+    memset(&v, 0, sizeof(v));
+    for (unsigned i = 0; i < job->count; i++) {
+        const ballot_row_t *rows = (const ballot_row_t *)job->chunks[i].rows;
+        for (uint64_t b = 0; b < job->chunks[i].count; b++) {
+            if (b + IMPORT_PREFETCH < job->chunks[i].count) {
+                const ballot_row_t *ahead = &rows[b + IMPORT_PREFETCH];
+                concurrent_map_prefetch(&app->has_voted, app_vote_key(ahead->election_id, ahead->voter_id));
+            }
+            v.id = app->next_vote_id;
+            v.election_id = rows[b].election_id;
+            v.voter_id = rows[b].voter_id;
+            v.choice = rows[b].choice;
+            int rc = app_attach_vote(app, &v); /* the insert-if-absent is the duplicate check */
+            if (rc < 0) return -1;
+            if (rc > 0) stats->duplicates++;
+            else stats->imported++;
+        }
+    }
+    return app_index_vote_ids(app, NULL);
+}
+
+int import_kind_from_name(const char *name, import_kind_t *out) {
+    if (!name) return -1;
+    if (strcmp(name, "voters") == 0) *out = IMPORT_VOTERS;
+    else if (strcmp(name, "ballots") == 0) *out = IMPORT_BALLOTS;
+    else return -1;
+    return 0;
+}
+
+int app_import_csv(app_state_t *app, import_kind_t kind, const char *path, import_stats_t *stats) {
+    import_stats_t local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    plat_map_t map;
+    if (plat_map_file(&map, path) != 0) return -1;
+    import_job_t *job = (import_job_t *)mem_calloc(MEM_TAG_MISC, 1, sizeof(import_job_t));
+    if (!job) {
+        plat_unmap_file(&map);
+        return -1;
+    }
+    trace_begin_str("import.csv", "path", path);
+    job->app = app;
+    job->kind = kind;
+    const char *data = (const char *)map.data;
+    unsigned threads = plat_cpu_count();
+    if (threads > IMPORT_MAX_THREADS) threads = IMPORT_MAX_THREADS;
+    if (threads > map.size / IMPORT_MIN_CHUNK + 1) threads = (unsigned)(map.size / IMPORT_MIN_CHUNK + 1);
+    /* Cut at the first line start past each even split. */
+    const char *begin = data;
+    for (unsigned i = 0; i < threads && begin < data + map.size; i++) {
+        const char *end = data + map.size * (i + 1) / threads;
+        if (end < begin) end = begin;
+        if (end < data + map.size) end = line_end(end, data + map.size);
+        if (end < data + map.size) end++;
+        import_chunk_t *c = &job->chunks[job->count++];
+        c->job = job;
+        c->begin = begin;
+        c->end = end;
+        c->first = i == 0;
+        c->row_size = kind == IMPORT_VOTERS ? sizeof(voter_row_t) : sizeof(ballot_row_t);
+        begin = end;
+    }
+    stats->threads = job->count;
+    int rc = 0;
+    uint64_t t0 = plat_now_ns();
+    if (job->count) run_chunks(job, parse_chunk);
+    uint64_t total = 0, line = 0;
+    for (unsigned i = 0; i < job->count; i++) {
+        import_chunk_t *c = &job->chunks[i];
+        if (c->failed) rc = -1;
+        total += c->count;
+        stats->rows += c->data_rows;
+        stats->rejected += c->rejected;
+        if (c->first_bad && !stats->first_bad_line) stats->first_bad_line = line + c->first_bad;
+        line += c->lines;
+    }
+    uint64_t t1 = plat_now_ns();
+    stats->parse_ns = t1 - t0;
+    if (rc == 0) rc = kind == IMPORT_VOTERS ? index_voters(job, total, stats) : attach_ballots(job, total, stats);
+    uint64_t t2 = plat_now_ns();
+    stats->index_ns = t2 - t1;
+    if (rc == 0 && kind == IMPORT_VOTERS && stats->imported) run_chunks(job, fill_voters);
+    stats->fill_ns = plat_now_ns() - t2;
+    if (rc == 0 && stats->imported) app->change_seq++;
+    trace_end("import.csv");
+    for (unsigned i = 0; i < job->count; i++) mem_free(job->chunks[i].rows);
+    mem_free(job);
+    plat_unmap_file(&map);
+    return rc;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "app.h"
+
+/* Helpers shared by the app modules (CSV persistence, binary snapshots, WAL);
+ * not part of the public app API. */
+
+uint64_t app_email_hash(const char *email);
+uint64_t app_vote_key(uint64_t election_id, uint64_t voter_id);
+int app_user_eligible(const user_auth_t *u, const election_rec_t *el);
+/* User slot by id or email hash, frozen index first; slot may be NULL. */
+int app_user_slot_by_id(const app_state_t *app, uint64_t id, uint32_t *slot);
+int app_user_slot_by_email(const app_state_t *app, uint64_t email_hash, uint32_t *slot);
+
+/* Makes the email filter hold users users in all, rebuilding it from the
+ * email indexes when it is too small; callers then add the hashes the
+ * indexes do not have yet. */
+int app_reserve_email_filter(app_state_t *app, size_t users);
+
+/* Copy a record into its arena, index it and advance the matching next-id
+ * counter. */
+int app_attach_user(app_state_t *app, const user_auth_t *auth, const user_profile_t *profile);
+int app_attach_election(app_state_t *app, const election_rec_t *el);
+/* 1, storing nothing, when the voter already voted in that election. */
+int app_attach_vote(app_state_t *app, const vote_rec_t *v);
+/* Bulk counterparts for loaders: records from index first on were stored
+ * without indexing; each index is built in one pass. */
+int app_index_users(app_state_t *app, uint32_t first);
+int app_index_elections(app_state_t *app, uint32_t first);
+int app_index_votes(app_state_t *app, uint32_t first);
+/* Rebuilds the vote id index over every vote; stored (may be NULL) is the
+ * same tree read from a snapshot's vote segment, adopted instead. */
+int app_index_vote_ids(app_state_t *app, const eytzinger_t *stored);
+
+int app_set_description(app_state_t *app, election_rec_t *el, const char *desc);
+int app_set_candidates(app_state_t *app, election_rec_t *el, const char *const *names, uint32_t count);
+
+/* Redo-log a mutation before applying it; no-ops when the WAL is off. */
+int app_log_user(app_state_t *app, const user_auth_t *auth, const user_profile_t *profile);
+int app_log_election(app_state_t *app, const election_rec_t *el);
+int app_log_phase(app_state_t *app, uint64_t election_id, election_phase_t phase);
+int app_log_vote(app_state_t *app, const vote_rec_t *v);
+/* Waits until the mutations logged so far are durable. The log write runs
+ * while the caller applies its change in memory. Every mutation entry point
+ * commits before returning, so one interactive request costs one
+ * write+fdatasync; only a caller that logs several records before one
+ * commit gets them grouped into a single sync. */
+int app_commit(app_state_t *app);
+
+/* Finds the vote segment stream in dir's current snapshot generation when
+ * that generation holds exactly wal_lsn and vote_count, so exports can
+ * serve it byte for byte. */
+int app_snapshot_votes_stream(const char *dir, uint64_t wal_lsn, uint32_t vote_count, char *path, size_t path_len,
+                              uint64_t *out_off, uint64_t *out_len);
@@ -0,0 +1,238 @@
+#include "app.h"
+#include "shm_view.h"
+#include "../core/mem.h"
+#include "../core/trace.h"
+#include "../tally/tally.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t align8(uint64_t x) {
+    return (x + 7) & ~(uint64_t)7;
+}
+
+static int index_cmp(const void *a, const void *b) {
+    uint64_t x = ((const shm_index_entry_t *)a)->id, y = ((const shm_index_entry_t *)b)->id;
+    return x < y ? -1 : x > y;
+}
+
+static int write_replace(const char *path, const void *buf, size_t size) {
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.%llu.tmp", path, (unsigned long long)plat_process_id());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int rc = fwrite(buf, 1, size, f) == size ? 0 : -1;
+    if (fclose(f) != 0) rc = -1;
+    if (rc == 0) rc = plat_replace_file(tmp, path);
+    if (rc != 0) remove(tmp);
+    return rc;
+}
+
+int app_publish_shm(const app_state_t *app, const char *path, uint64_t generation) {
+    uint32_t n = app->elections.count;
+    const election_rec_t *els = (const election_rec_t *)app->elections.data;
+    uint64_t counts_len = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        counts_len += els[i].candidate_count;
+    }
+    if (counts_len > UINT32_MAX) return -1;
+
+    shm_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SHM_MAGIC, sizeof(hdr.magic));
+    hdr.version = SHM_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.generation = generation;
+    hdr.published_at_us = plat_wall_us();
+    hdr.change_seq = app->change_seq;
+    hdr.writer_pid = plat_process_id();
+    hdr.user_count = app->users.count;
+    hdr.election_count = n;
+    hdr.vote_count = app->votes.count;
+    hdr.next_user_id = app->next_user_id;
+    hdr.next_election_id = app->next_election_id;
+    hdr.next_vote_id = app->next_vote_id;
+    hdr.elections_off = align8(sizeof(hdr));
+    hdr.index_off = align8(hdr.elections_off + (uint64_t)n * sizeof(election_rec_t));
+    hdr.results_off = align8(hdr.index_off + (uint64_t)n * sizeof(shm_index_entry_t));
+    hdr.counts_off = align8(hdr.results_off + (uint64_t)n * sizeof(shm_result_t));
+    hdr.counts_len = counts_len;
+    hdr.strings_off = align8(hdr.counts_off + counts_len * sizeof(uint64_t));
+    hdr.strings_size = app->strings.size;
+    hdr.total_size = hdr.strings_off + hdr.strings_size;
+
+    trace_begin_u64("shm.publish", "bytes", hdr.total_size);
+    uint8_t *buf = (uint8_t *)mem_calloc(MEM_TAG_MISC, 1, (size_t)hdr.total_size);
+    if (!buf) {
+        trace_end("shm.publish");
+        return -1;
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    if (n) memcpy(buf + hdr.elections_off, els, (size_t)n * sizeof(election_rec_t));
+    memcpy(buf + hdr.strings_off, app->strings.data, app->strings.size);
+
+    shm_index_entry_t *index = (shm_index_entry_t *)(void *)(buf + hdr.index_off);
+    shm_result_t *results = (shm_result_t *)(void *)(buf + hdr.results_off);
+    uint64_t *counts = (uint64_t *)(void *)(buf + hdr.counts_off);
+    uint32_t first = 0;
+    int sorted = 1;
+    for (uint32_t i = 0; i < n; i++) {
+        index[i].id = els[i].id;
+        index[i].slot = i;
+        if (i > 0 && els[i].id < els[i - 1].id) sorted = 0;
+        results[i].counts_first = first;
+        results[i].winner = SHM_NO_WINNER;
+        first += els[i].candidate_count;
+    }
+    if (!sorted) qsort(index, n, sizeof(*index), index_cmp);
+
+    const vote_rec_t *votes = (const vote_rec_t *)app->votes.data;
+    for (uint32_t i = 0; i < app->votes.count; i++) {
+        uint32_t slot;
+        if (hash_table_get(&app->election_by_id, votes[i].election_id, &slot) != 0) continue;
+        if (votes[i].choice >= els[slot].candidate_count) continue;
+        counts[results[slot].counts_first + votes[i].choice]++;
+        results[slot].total_votes++;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        size_t win;
+        if (results[i].total_votes &&
+            tally_winner(counts + results[i].counts_first, els[i].candidate_count, &win) == 0) {
+            results[i].winner = (uint32_t)win;
+        }
+    }
+
+    int rc = write_replace(path, buf, (size_t)hdr.total_size);
+    mem_free(buf);
+    trace_end("shm.publish");
+    return rc;
+}
+
+/* --- reader side --- */
+
+static int section_ok(const shm_header_t *h, uint64_t off, uint64_t count, uint64_t elem) {
+    if (off % 8 != 0 || off < sizeof(*h) || off > h->total_size) return 0;
+    return count <= (h->total_size - off) / elem;
+}
+
+static int ref_ok(const shm_header_t *h, uint64_t ref) {
+    return ref < h->strings_size;
+}
+
+/* Checks every offset once so the accessors below can trust the layout. */
+static int shm_validate(const plat_map_t *m) {
+    if (m->size < sizeof(shm_header_t)) return -1;
+    const shm_header_t *h = (const shm_header_t *)m->data;
+    if (memcmp(h->magic, SHM_MAGIC, sizeof(h->magic)) != 0 || h->version != SHM_VERSION ||
+        h->header_size != sizeof(*h) || h->total_size != m->size || h->election_count > UINT32_MAX) {
+        return -1;
+    }
+    uint64_t n = h->election_count;
+    if (!section_ok(h, h->elections_off, n, sizeof(election_rec_t)) ||
+        !section_ok(h, h->index_off, n, sizeof(shm_index_entry_t)) ||
+        !section_ok(h, h->results_off, n, sizeof(shm_result_t)) ||
+        !section_ok(h, h->counts_off, h->counts_len, sizeof(uint64_t)) ||
+        !section_ok(h, h->strings_off, h->strings_size, 1) || h->strings_size == 0) {
+        return -1;
+    }
+    const uint8_t *base = (const uint8_t *)m->data;
+    const char *pool = (const char *)base + h->strings_off;
+    if (pool[0] != 0 || pool[h->strings_size - 1] != 0) return -1;
+    const election_rec_t *els = (const election_rec_t *)(const void *)(base + h->elections_off);
+    const shm_index_entry_t *index = (const shm_index_entry_t *)(const void *)(base + h->index_off);
+    const shm_result_t *results = (const shm_result_t *)(const void *)(base + h->results_off);
+    for (uint64_t i = 0; i < n; i++) {
+        const election_rec_t *el = &els[i];
+        if (memchr(el->title, 0, sizeof(el->title)) == NULL || !ref_ok(h, el->description)) return -1;
+        if (index[i].slot >= n || (i > 0 && index[i].id < index[i - 1].id)) return -1;
+        if ((uint64_t)results[i].counts_first + el->candidate_count > h->counts_len) return -1;
+        if (el->candidate_count == 0) continue;
+        if (el->candidates % sizeof(str_ref_t) != 0 ||
+            (uint64_t)el->candidates + (uint64_t)el->candidate_count * sizeof(str_ref_t) > h->strings_size) {
+            return -1;
+        }
+        const str_ref_t *refs = (const str_ref_t *)(const void *)(pool + el->candidates);
+        for (uint32_t c = 0; c < el->candidate_count; c++) {
+            if (!ref_ok(h, refs[c])) return -1;
+        }
+    }
+    return 0;
+}
+
+static int shm_map(const char *path, plat_map_t *m, uint64_t *out_id) {
+    if (plat_file_id(path, out_id) != 0 || plat_map_file(m, path) != 0) return -1;
+    if (shm_validate(m) != 0) {
+        plat_unmap_file(m);
+        return -1;
+    }
+    return 0;
+}
+
+int shm_view_open(shm_view_t *v, const char *path) {
+    memset(v, 0, sizeof(*v));
+    if (strlen(path) >= sizeof(v->path)) return -1;
+    strcpy(v->path, path);
+    if (shm_map(path, &v->map, &v->file_id) != 0) return -1;
+    v->hdr = (const shm_header_t *)v->map.data;
+    return 0;
+}
+
+int shm_view_refresh(shm_view_t *v) {
+    uint64_t id;
+    if (plat_file_id(v->path, &id) != 0) return -1;
+    if (v->hdr && id == v->file_id) return 0;
+    plat_map_t next;
+    if (shm_map(v->path, &next, &id) != 0) return -1;
+    plat_map_t old = v->map;
+    v->map = next;
+    v->hdr = (const shm_header_t *)next.data;
+    v->file_id = id;
+    plat_unmap_file(&old);
+    return 1;
+}
+
+void shm_view_close(shm_view_t *v) {
+    plat_unmap_file(&v->map);
+    v->hdr = NULL;
+}
+
+static const uint8_t *view_base(const shm_view_t *v) {
+    return (const uint8_t *)v->map.data;
+}
+
+const election_rec_t *shm_view_election(const shm_view_t *v, uint32_t slot) {
+    if (slot >= v->hdr->election_count) return NULL;
+    return (const election_rec_t *)(const void *)(view_base(v) + v->hdr->elections_off) + slot;
+}
+
+const election_rec_t *shm_view_find_election(const shm_view_t *v, uint64_t id, uint32_t *out_slot) {
+    const shm_index_entry_t *index = (const shm_index_entry_t *)(const void *)(view_base(v) + v->hdr->index_off);
+    size_t lo = 0, hi = (size_t)v->hdr->election_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index[mid].id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == v->hdr->election_count || index[lo].id != id) return NULL;
+    if (out_slot) *out_slot = index[lo].slot;
+    return shm_view_election(v, index[lo].slot);
+}
+
+const shm_result_t *shm_view_result(const shm_view_t *v, uint32_t slot) {
+    if (slot >= v->hdr->election_count) return NULL;
+    return (const shm_result_t *)(const void *)(view_base(v) + v->hdr->results_off) + slot;
+}
+
+const uint64_t *shm_view_counts(const shm_view_t *v, const shm_result_t *r) {
+    return (const uint64_t *)(const void *)(view_base(v) + v->hdr->counts_off) + r->counts_first;
+}
+
+const char *shm_view_string(const shm_view_t *v, str_ref_t ref) {
+    return (const char *)view_base(v) + v->hdr->strings_off + ref;
+}
+
+const char *shm_view_candidate(const shm_view_t *v, const election_rec_t *el, uint32_t index) {
+    if (index >= el->candidate_count) return "";
+    const str_ref_t *refs = (const str_ref_t *)(const void *)(view_base(v) + v->hdr->strings_off + el->candidates);
+    return shm_view_string(v, refs[index]);
+}
@@ -0,0 +1,612 @@
+#include "app_internal.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include "../core/trace.h"
+#include "../storage/atomic_file.h"
+#include "../storage/checksum.h"
+#include "../core/crc32c.h"
+#include "../storage/vote_segment.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Binary snapshot: state, users, elections and votes files, each a
+ * snap_header_t followed by fixed-size host-endian records. The users file
+ * holds the hot auth records followed by the cold profiles as a blob; the
+ * elections file carries the string pool as its blob. Blobs start on a page
+ * boundary, so they can be mapped directly instead of read. The votes
+ * file holds a compressed vote segment stream (see vote_segment.h) instead
+ * of raw records; its record_size is 0. Each file ends with a CRC32C table
+ * over 64 KB blocks (see storage/checksum.h); load checks all four files
+ * in parallel before trusting any of them, and names the records a bad
+ * block covers. When user indexes are frozen, the users file also carries
+ * both perfect-hash blobs (by id, then by email) from the first page after
+ * the profiles; load maps them in place of rebuilding those indexes.
+ *
+ * Every save is a new generation: the four files are written as
+ * <name>-<generation>.bin and fsynced, then MANIFEST (naming the generation,
+ * its files and their sizes) is replaced atomically. MANIFEST is the only
+ * commit point, so a crash at any step leaves the previous generation
+ * loadable; its files are removed once the new MANIFEST is durable. */
+
+#define SNAP_MAGIC "OVSNAP2"
+#define SNAP_PAGE 4096u
+#define MANIFEST_MAGIC "OVMANI1"
+#define SNAP_FILES 4
+
+enum { SNAP_STATE = 1, SNAP_USERS, SNAP_ELECTIONS, SNAP_VOTES };
+
+typedef struct {
+    char magic[8];
+    uint32_t kind;
+    uint32_t record_size;
+    uint64_t count;
+    uint64_t blob_offset;
+    uint64_t blob_size;
+} snap_header_t;
+
+typedef struct {
+    uint8_t admin_exists;
+    char admin_pin[32];
+    uint64_t next_user_id;
+    uint64_t next_election_id;
+    uint64_t next_vote_id;
+    uint64_t wal_lsn; /* last WAL record reflected in this snapshot */
+} state_header_t;
+
+typedef struct {
+    char name[32];
+    uint64_t size;
+} manifest_entry_t;
+
+typedef struct {
+    char magic[8];
+    uint64_t generation;
+    uint64_t wal_lsn;
+    uint32_t file_count;
+    uint32_t crc; /* CRC32C of the manifest with crc = 0 */
+    manifest_entry_t files[SNAP_FILES]; /* indexed by kind - 1 */
+} manifest_t;
+
+static const char *const snap_names[SNAP_FILES] = {"state", "users", "elections", "votes"};
+
+static void snap_path(const char *dir, uint32_t kind, uint64_t gen, char *out, size_t len) {
+    snprintf(out, len, "%s/%s-%06llu.bin", dir, snap_names[kind - 1], (unsigned long long)gen);
+}
+
+static FILE *snap_create(const char *dir, uint64_t gen, uint32_t kind, uint32_t record_size,
+                         uint64_t count, snap_header_t *hdr) {
+    char path[256];
+    snap_path(dir, kind, gen, path, sizeof(path));
+    FILE *f = fopen(path, "wb+");
+    if (!f) return NULL;
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+    hdr->kind = kind;
+    hdr->record_size = record_size;
+    hdr->count = count;
+    if (fwrite(hdr, sizeof(*hdr), 1, f) != 1) {
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+/* Opens a generation file and checks it against its manifest entry. */
+static FILE *snap_open(const char *dir, const manifest_t *m, uint32_t kind, uint32_t record_size,
+                       snap_header_t *hdr) {
+    char path[256];
+    snap_path(dir, kind, m->generation, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "%s: cannot be opened\n", path);
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) != 0 || (uint64_t)ftell(f) != m->files[kind - 1].size || fseek(f, 0, SEEK_SET) != 0 ||
+        fread(hdr, sizeof(*hdr), 1, f) != 1 || memcmp(hdr->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) != 0 ||
+        hdr->kind != kind || hdr->record_size != record_size) {
+        fprintf(stderr, "%s: size or header does not match MANIFEST\n", path);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+static int write_arena(FILE *f, const arena_t *a) {
+    if (a->count == 0) return 0;
+    return fwrite(a->data, a->elem_size, a->count, f) == a->count ? 0 : -1;
+}
+
+/* Reads count records into the arena's spare capacity; the caller
+ * validates them and then bumps a->count. */
+static int read_arena(FILE *f, arena_t *a, uint64_t count) {
+    if (count > UINT32_MAX - a->count || arena_reserve(a, (size_t)(a->count + count)) != 0) return -1;
+    uint8_t *dst = a->data + (size_t)a->count * a->elem_size;
+    return fread(dst, a->elem_size, (size_t)count, f) == count ? 0 : -1;
+}
+
+/* Seals a finished generation file with its checksums, makes it durable
+ * and records its size. */
+static int snap_close(FILE *f, int rc, manifest_t *m, uint32_t kind) {
+    if (rc == 0) rc = checksum_seal(f);
+    if (rc == 0 && fseek(f, 0, SEEK_END) != 0) rc = -1;
+    if (rc == 0) m->files[kind - 1].size = (uint64_t)ftell(f);
+    if (rc == 0 && plat_fsync_file(f) != 0) rc = -1;
+    if (fclose(f) != 0) rc = -1;
+    return rc;
+}
+
+static int save_votes(app_state_t *app, const char *dir, manifest_t *m) {
+    snap_header_t hdr;
+    FILE *f = snap_create(dir, m->generation, SNAP_VOTES, 0, app->votes.count, &hdr);
+    if (!f) return -1;
+    uint64_t bytes = 0;
+    trace_begin_u64("save.votes", "votes", app->votes.count);
+    int rc = vote_seg_write(f, (const vote_rec_t *)app->votes.data, NULL, app->votes.count, &bytes);
+    trace_end("save.votes");
+    return snap_close(f, rc, m, SNAP_VOTES);
+}
+
+/* Pads to the next page, records where the blob starts and rewrites the
+ * header. The header goes last so a torn write leaves a file whose
+ * blob_size is still 0 and fails validation. */
+static int begin_blob(FILE *f, snap_header_t *hdr, uint64_t blob_size) {
+    static const char zeros[SNAP_PAGE];
+    uint64_t end = sizeof(*hdr) + hdr->count * hdr->record_size;
+    hdr->blob_offset = (end + SNAP_PAGE - 1) / SNAP_PAGE * SNAP_PAGE;
+    hdr->blob_size = blob_size;
+    size_t pad = (size_t)(hdr->blob_offset - end);
+    return fwrite(zeros, 1, pad, f) == pad ? 0 : -1;
+}
+
+static int finish_blob(FILE *f, const snap_header_t *hdr) {
+    if (fseek(f, 0, SEEK_SET) != 0 || fwrite(hdr, sizeof(*hdr), 1, f) != 1) return -1;
+    return 0;
+}
+
+/* Page where the frozen user indexes start, past the profiles. */
+static uint64_t frozen_users_offset(const snap_header_t *hdr) {
+    return (hdr->blob_offset + hdr->blob_size + SNAP_PAGE - 1) / SNAP_PAGE * SNAP_PAGE;
+}
+
+static int write_frozen_users(FILE *f, const app_state_t *app, const snap_header_t *hdr) {
+    static const char zeros[SNAP_PAGE];
+    size_t pad = (size_t)(frozen_users_offset(hdr) - (hdr->blob_offset + hdr->blob_size));
+    const perfect_hash_t *by_id = &app->frozen_by_id, *by_email = &app->frozen_by_email;
+    return fwrite(zeros, 1, pad, f) == pad && fwrite(by_id->data, 1, by_id->size, f) == by_id->size &&
+                   fwrite(by_email->data, 1, by_email->size, f) == by_email->size
+               ? 0
+               : -1;
+}
+
+static int save_users(app_state_t *app, const char *dir, manifest_t *m) {
+    snap_header_t hdr;
+    const user_store_t *st = &app->users;
+    FILE *f = snap_create(dir, m->generation, SNAP_USERS, sizeof(user_auth_t), st->count, &hdr);
+    if (!f) return -1;
+    int rc = 0;
+    if (st->count && fwrite(st->auth, sizeof(user_auth_t), st->count, f) != st->count) rc = -1;
+    if (rc == 0) rc = begin_blob(f, &hdr, (uint64_t)st->count * sizeof(user_profile_t));
+    for (uint32_t i = 0; rc == 0 && i < st->count; i += USER_PROFILE_PAGE) {
+        uint32_t n = st->count - i < USER_PROFILE_PAGE ? st->count - i : USER_PROFILE_PAGE;
+        if (fwrite(user_store_profile(st, i), sizeof(user_profile_t), n, f) != n) rc = -1;
+    }
+    if (rc == 0 && app->frozen_users) rc = write_frozen_users(f, app, &hdr);
+    if (rc == 0) rc = finish_blob(f, &hdr);
+    return snap_close(f, rc, m, SNAP_USERS);
+}
+
+static int save_elections(app_state_t *app, const char *dir, manifest_t *m) {
+    snap_header_t hdr;
+    FILE *f = snap_create(dir, m->generation, SNAP_ELECTIONS, sizeof(election_rec_t),
+                          app->elections.count, &hdr);
+    if (!f) return -1;
+    int rc = write_arena(f, &app->elections);
+    if (rc == 0) rc = begin_blob(f, &hdr, app->strings.size);
+    if (rc == 0 && fwrite(app->strings.data, 1, app->strings.size, f) != app->strings.size) rc = -1;
+    if (rc == 0) rc = finish_blob(f, &hdr);
+    return snap_close(f, rc, m, SNAP_ELECTIONS);
+}
+
+static uint32_t manifest_crc(const manifest_t *m) {
+    manifest_t copy = *m;
+    copy.crc = 0;
+    return crc32c(0, &copy, sizeof(copy));
+}
+
+/* 1 when dir has no MANIFEST at all; -1, reported, when it is unreadable
+ * or damaged. */
+static int read_manifest(const char *dir, manifest_t *m) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/MANIFEST", dir);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        if (errno == ENOENT) return 1;
+        fprintf(stderr, "%s: cannot be opened\n", path);
+        return -1;
+    }
+    int rc = fread(m, sizeof(*m), 1, f) == 1 && memcmp(m->magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) == 0 &&
+                     m->file_count == SNAP_FILES ? 0 : -1;
+    fclose(f);
+    if (rc != 0) {
+        fprintf(stderr, "%s: truncated or not a manifest\n", path);
+    } else if (m->crc != manifest_crc(m)) {
+        fprintf(stderr, "%s: fails its checksum\n", path);
+        rc = -1;
+    }
+    return rc;
+}
+
+/* Returns 0 once MANIFEST and its directory entry are durable. On -1,
+ * *in_place says whether MANIFEST was renamed into place anyway (only its
+ * dir fsync failed), in which case either MANIFEST may be the one found
+ * after a crash. */
+static int write_manifest(const char *dir, const manifest_t *m, int *in_place) {
+    char path[256];
+    *in_place = 0;
+    snprintf(path, sizeof(path), "%s/MANIFEST", dir);
+    atomic_file_t af;
+    FILE *f = atomic_file_open(&af, path);
+    if (!f) return -1;
+    if (fwrite(m, sizeof(*m), 1, f) != 1) {
+        atomic_file_abort(&af);
+        return -1;
+    }
+    if (atomic_file_commit(&af) != 0) return -1;
+    /* MANIFEST is in place from here on; a failing fsync only means the
+     * rename may not survive a crash, so it is retried, never undone. */
+    *in_place = 1;
+    return plat_fsync_dir(dir) == 0 || plat_fsync_dir(dir) == 0 ? 0 : -1;
+}
+
+static void remove_generation(const char *dir, uint64_t gen) {
+    for (uint32_t kind = SNAP_STATE; kind <= SNAP_VOTES; kind++) {
+        char path[256];
+        snap_path(dir, kind, gen, path, sizeof(path));
+        remove(path);
+    }
+}
+
+typedef struct {
+    const char *dir;
+    uint64_t keep;
+} stale_scan_t;
+
+static int remove_if_stale(const char *name, void *ctx) {
+    const stale_scan_t *scan = (const stale_scan_t *)ctx;
+    for (uint32_t kind = SNAP_STATE; kind <= SNAP_VOTES; kind++) {
+        size_t n = strlen(snap_names[kind - 1]);
+        unsigned long long gen;
+        char tail[8];
+        if (strncmp(name, snap_names[kind - 1], n) != 0 || sscanf(name + n, "-%llu%7s", &gen, tail) != 2 ||
+            strcmp(tail, ".bin") != 0 || gen == scan->keep)
+            continue;
+        char path[256];
+        snap_path(scan->dir, kind, gen, path, sizeof(path));
+        remove(path);
+    }
+    return 0;
+}
+
+/* Every generation but keep, including any a save whose MANIFEST rename
+ * was not known to be durable had to leave behind. */
+static void remove_stale_generations(const char *dir, uint64_t keep) {
+    stale_scan_t scan = {dir, keep};
+    plat_list_dir(dir, remove_if_stale, &scan);
+}
+
+int app_save(app_state_t *app, const char *dir) {
+    if (app->failed) return -1;
+    concurrent_map_reclaim(&app->has_voted); /* savers hold the app */
+    trace_begin_str("save.snapshot", "dir", dir);
+    manifest_t prev, m;
+    int have_prev = read_manifest(dir, &prev) == 0;
+    memset(&m, 0, sizeof(m));
+    memcpy(m.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+    m.generation = have_prev ? prev.generation + 1 : 1;
+    m.wal_lsn = app->wal_lsn;
+    m.file_count = SNAP_FILES;
+    for (uint32_t kind = SNAP_STATE; kind <= SNAP_VOTES; kind++) {
+        snprintf(m.files[kind - 1].name, sizeof(m.files[kind - 1].name), "%s-%06llu.bin", snap_names[kind - 1],
+                 (unsigned long long)m.generation);
+    }
+    int rc = 0;
+    state_header_t st;
+    memset(&st, 0, sizeof(st));
+    st.admin_exists = app->admin_exists ? 1 : 0;
+    memcpy(st.admin_pin, app->admin_pin, sizeof(st.admin_pin));
+    st.next_user_id = app->next_user_id;
+    st.next_election_id = app->next_election_id;
+    st.next_vote_id = app->next_vote_id;
+    st.wal_lsn = app->wal_lsn;
+    snap_header_t hdr;
+    FILE *f = snap_create(dir, m.generation, SNAP_STATE, sizeof(st), 1, &hdr);
+    if (!f) rc = -1;
+    else rc = snap_close(f, fwrite(&st, sizeof(st), 1, f) == 1 ? 0 : -1, &m, SNAP_STATE);
+    if (rc == 0) rc = save_users(app, dir, &m);
+    if (rc == 0) rc = save_elections(app, dir, &m);
+    if (rc == 0) rc = save_votes(app, dir, &m);
+    /* The generation files must be durable before MANIFEST points at them. */
+    if (rc == 0) rc = plat_fsync_dir(dir);
+    m.crc = manifest_crc(&m);
+    int in_place = 0;
+    if (rc == 0) {
+        rc = write_manifest(dir, &m, &in_place);
+        if (rc != 0 && in_place) {
+            /* A failed save: both generations stay, and callers keep the
+             * WAL this one would have covered. */
+            fprintf(stderr, "MANIFEST for generation %llu is in place but %s could not be fsynced; keeping the previous generation\n",
+                    (unsigned long long)m.generation, dir);
+        }
+    }
+    if (rc == 0) remove_stale_generations(dir, m.generation);
+    else if (!in_place) remove_generation(dir, m.generation);
+    trace_end("save.snapshot");
+    return rc;
+}
+
+static int load_state(app_state_t *app, FILE *f) {
+    state_header_t st;
+    if (fread(&st, sizeof(st), 1, f) != 1) return -1;
+    app->admin_exists = st.admin_exists;
+    memcpy(app->admin_pin, st.admin_pin, sizeof(app->admin_pin));
+    app->admin_pin[sizeof(app->admin_pin) - 1] = 0;
+    app->next_user_id = st.next_user_id;
+    app->next_election_id = st.next_election_id;
+    app->next_vote_id = st.next_vote_id;
+    app->wal_lsn = st.wal_lsn;
+    return 0;
+}
+
+/* Adopts the frozen user indexes stored after the profiles, mapping the
+ * file rather than reading them; returns how many users they cover (0 if
+ * the file has none). data_size is the file's length before its checksums. */
+static uint32_t map_frozen_users(app_state_t *app, const char *path, const snap_header_t *hdr, uint64_t data_size) {
+    uint64_t at = frozen_users_offset(hdr);
+    if (data_size <= at) return 0;
+    plat_map_t map;
+    if (plat_map_file(&map, path) != 0) return 0;
+    const uint8_t *base = (const uint8_t *)map.data + at;
+    size_t avail = (size_t)(data_size - at);
+    perfect_hash_t by_id, by_email;
+    if (map.size < data_size || perfect_hash_open(&by_id, base, avail) != 0 ||
+        perfect_hash_open(&by_email, base + by_id.size, avail - by_id.size) != 0 || by_id.count != by_email.count ||
+        by_id.count > hdr->count) {
+        plat_unmap_file(&map);
+        return 0;
+    }
+    app->frozen_by_id = by_id;
+    app->frozen_by_email = by_email;
+    app->frozen_users = (uint32_t)by_id.count;
+    app->frozen_map = map;
+    return app->frozen_users;
+}
+
+/* Hot records and cold profiles are streamed in lockstep, one page at a
+ * time, through a second handle on the same file. */
+static int load_users(app_state_t *app, const char *dir, uint64_t gen, FILE *f, const snap_header_t *hdr,
+                      uint64_t data_size) {
+    if (hdr->count > UINT32_MAX || hdr->blob_size != hdr->count * sizeof(user_profile_t)) return -1;
+    uint32_t first = app->users.count;
+    if (user_store_reserve(&app->users, (size_t)first + hdr->count) != 0) return -1;
+    char path[256];
+    snap_path(dir, SNAP_USERS, gen, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    user_auth_t *auth = (user_auth_t *)mem_alloc(MEM_TAG_MISC, USER_PROFILE_PAGE * sizeof(user_auth_t));
+    user_profile_t *prof = (user_profile_t *)mem_alloc(MEM_TAG_MISC, USER_PROFILE_PAGE * sizeof(user_profile_t));
+    int rc = (auth && prof && fseek(fp, (long)hdr->blob_offset, SEEK_SET) == 0) ? 0 : -1;
+    for (uint64_t i = 0; rc == 0 && i < hdr->count; i += USER_PROFILE_PAGE) {
+        size_t n = hdr->count - i < USER_PROFILE_PAGE ? (size_t)(hdr->count - i) : USER_PROFILE_PAGE;
+        if (fread(auth, sizeof(*auth), n, f) != n || fread(prof, sizeof(*prof), n, fp) != n) {
+            rc = -1;
+            break;
+        }
+        for (size_t k = 0; rc == 0 && k < n; k++) {
+            prof[k].name[MAX_NAME - 1] = 0;
+            prof[k].email[EMAIL_LEN - 1] = 0;
+            rc = user_store_add(&app->users, &auth[k], &prof[k], NULL);
+        }
+    }
+    uint32_t indexed = first;
+    if (rc == 0 && first == 0) indexed = map_frozen_users(app, path, hdr, data_size);
+    if (rc == 0) rc = app_index_users(app, indexed);
+    mem_free(auth);
+    mem_free(prof);
+    fclose(fp);
+    return rc;
+}
+
+static int load_elections(app_state_t *app, FILE *f, const snap_header_t *hdr) {
+    if (hdr->blob_size == 0 || hdr->blob_size > UINT32_MAX) return -1;
+    long records_at = ftell(f);
+    char *blob = (char *)mem_alloc(MEM_TAG_MISC, (size_t)hdr->blob_size);
+    if (!blob) return -1;
+    int rc = 0;
+    if (fseek(f, (long)hdr->blob_offset, SEEK_SET) != 0 || fread(blob, 1, (size_t)hdr->blob_size, f) != hdr->blob_size ||
+        str_pool_load(&app->strings, blob, (uint32_t)hdr->blob_size) != 0) {
+        rc = -1;
+    }
+    mem_free(blob);
+    if (rc != 0 || fseek(f, records_at, SEEK_SET) != 0) return -1;
+    uint32_t base = app->elections.count;
+    if (read_arena(f, &app->elections, hdr->count) != 0) return -1;
+    for (uint32_t i = 0; i < (uint32_t)hdr->count; i++) {
+        election_rec_t *el = (election_rec_t *)(app->elections.data + (size_t)(base + i) * sizeof(election_rec_t));
+        if (el->description >= app->strings.size ||
+            (el->candidate_count &&
+             (uint64_t)el->candidates + (uint64_t)el->candidate_count * sizeof(str_ref_t) > app->strings.size)) {
+            return -1;
+        }
+        str_pool_reindex(&app->strings, el->description);
+        for (uint32_t c = 0; c < el->candidate_count; c++) {
+            str_pool_reindex(&app->strings, str_pool_refs(&app->strings, el->candidates)[c]);
+        }
+        app->elections.count++;
+    }
+    return app_index_elections(app, base);
+}
+
+/* Reads the compressed stream in one go and decodes it straight into the
+ * arena's spare capacity. */
+static int load_votes(app_state_t *app, FILE *f, const char *name, uint64_t count, uint64_t stream_size) {
+    uint32_t base = app->votes.count;
+    if (count > UINT32_MAX - base || stream_size > SIZE_MAX - VOTE_SEG_SLACK ||
+        arena_reserve(&app->votes, (size_t)(base + count)) != 0) {
+        return -1;
+    }
+    uint8_t *buf = (uint8_t *)mem_calloc(MEM_TAG_VOTES, 1, (size_t)stream_size + VOTE_SEG_SLACK);
+    if (!buf) return -1;
+    vote_seg_view_t view;
+    vote_rec_t *votes = (vote_rec_t *)app->votes.data + base;
+    uint32_t bad = UINT32_MAX;
+    int rc = fread(buf, 1, (size_t)stream_size, f) == stream_size && vote_seg_view_open(&view, buf, (size_t)stream_size) == 0 &&
+                     view.hdr->vote_count == count && vote_seg_view_decode_all(&view, votes, &bad) == 0
+                 ? 0
+                 : -1;
+    app->votes.count += rc == 0 ? (uint32_t)count : 0;
+    /* The stream's block search tree is the vote id index, when it alone
+     * fills the arena. */
+    if (rc == 0) rc = app_index_vote_ids(app, base == 0 && view.ids_sorted ? &view.search : NULL);
+    mem_free(buf);
+    if (rc != 0 && bad != UINT32_MAX) {
+        fprintf(stderr, "%s: vote block %u (votes %llu-%llu) fails its checksum\n", name, bad,
+                (unsigned long long)bad * VOTE_BLOCK_SIZE, (unsigned long long)bad * VOTE_BLOCK_SIZE + VOTE_BLOCK_SIZE - 1);
+    }
+    if (rc != 0) return -1;
+    return app_index_votes(app, base);
+}
+
+int app_snapshot_votes_stream(const char *dir, uint64_t wal_lsn, uint32_t vote_count, char *path, size_t path_len,
+                              uint64_t *out_off, uint64_t *out_len) {
+    manifest_t m;
+    if (read_manifest(dir, &m) != 0 || m.wal_lsn != wal_lsn) return -1;
+    snap_header_t hdr;
+    FILE *f = snap_open(dir, &m, SNAP_VOTES, 0, &hdr);
+    if (!f) return -1;
+    vote_seg_header_t seg;
+    int rc = hdr.count == vote_count && fread(&seg, sizeof(seg), 1, f) == 1 &&
+                     memcmp(seg.magic, VOTE_SEG_MAGIC, sizeof(VOTE_SEG_MAGIC)) == 0 && seg.vote_count == vote_count &&
+                     sizeof(hdr) + seg.total_size <= m.files[SNAP_VOTES - 1].size
+                 ? 0
+                 : -1;
+    fclose(f);
+    if (rc != 0) return -1;
+    snap_path(dir, SNAP_VOTES, m.generation, path, path_len);
+    *out_off = sizeof(hdr);
+    *out_len = seg.total_size;
+    return 0;
+}
+
+static const uint32_t snap_record_sizes[SNAP_FILES] = {sizeof(state_header_t), sizeof(user_auth_t),
+                                                        sizeof(election_rec_t), 0};
+
+/* Maps a damaged votes-file range onto the vote segment block it hits. */
+static int vote_block_of(FILE *f, const snap_header_t *hdr, uint64_t data_size, uint64_t off, uint64_t *out_block) {
+    uint64_t stream_size = data_size - sizeof(*hdr);
+    if (off < sizeof(*hdr) || stream_size > SIZE_MAX - VOTE_SEG_SLACK) return -1;
+    uint8_t *buf = (uint8_t *)mem_calloc(MEM_TAG_MISC, 1, (size_t)stream_size + VOTE_SEG_SLACK);
+    vote_seg_view_t view;
+    int64_t b = -1;
+    if (buf && fread(buf, 1, (size_t)stream_size, f) == stream_size && vote_seg_view_open(&view, buf, (size_t)stream_size) == 0) {
+        b = vote_seg_view_block_at(&view, off - sizeof(*hdr));
+    }
+    mem_free(buf);
+    if (b < 0) return -1;
+    *out_block = (uint64_t)b;
+    return 0;
+}
+
+/* Prints a failed check, adding which records the bad block covers when the
+ * file's header is still readable. */
+static void report_damage(const char *dir, const manifest_t *m, uint32_t kind, const checksum_job_t *job) {
+    char msg[512];
+    checksum_describe(job, msg, sizeof(msg));
+    snap_header_t hdr;
+    uint32_t rs = snap_record_sizes[kind - 1];
+    FILE *f = job->status == CHECKSUM_MISMATCH ? snap_open(dir, m, kind, rs, &hdr) : NULL;
+    if (!f) {
+        fprintf(stderr, "%s\n", msg);
+        return;
+    }
+    uint64_t lo = job->bad_offset, hi = job->bad_offset + job->bad_len; /* [lo, hi) */
+    uint64_t rec_end = sizeof(hdr) + hdr.count * rs;
+    uint64_t block;
+    if (rs && lo < rec_end && hi > sizeof(hdr)) {
+        uint64_t first = lo > sizeof(hdr) ? (lo - sizeof(hdr)) / rs : 0;
+        uint64_t last = ((hi < rec_end ? hi : rec_end) - sizeof(hdr) - 1) / rs;
+        fprintf(stderr, "%s; %s records %llu-%llu\n", msg, snap_names[kind - 1], (unsigned long long)first,
+                (unsigned long long)last);
+    } else if (kind == SNAP_USERS && lo >= frozen_users_offset(&hdr)) {
+        fprintf(stderr, "%s; frozen user indexes\n", msg);
+    } else if (kind == SNAP_USERS && hdr.blob_size && hi > hdr.blob_offset) {
+        uint64_t first = lo > hdr.blob_offset ? (lo - hdr.blob_offset) / sizeof(user_profile_t) : 0;
+        fprintf(stderr, "%s; user profiles from %llu\n", msg, (unsigned long long)first);
+    } else if (kind == SNAP_ELECTIONS && hdr.blob_size && hi > hdr.blob_offset) {
+        fprintf(stderr, "%s; election string pool\n", msg);
+    } else if (kind == SNAP_VOTES && vote_block_of(f, &hdr, job->data_size, lo, &block) == 0) {
+        fprintf(stderr, "%s; vote block %llu (votes %llu-%llu)\n", msg, (unsigned long long)block,
+                (unsigned long long)(block * VOTE_BLOCK_SIZE), (unsigned long long)(block * VOTE_BLOCK_SIZE + VOTE_BLOCK_SIZE - 1));
+    } else {
+        fprintf(stderr, "%s\n", msg);
+    }
+    fclose(f);
+}
+
+/* Checks every file of the generation in parallel; fills data_size with
+ * each file's length before its checksum table. */
+static int verify_generation(const char *dir, const manifest_t *m, uint64_t data_size[SNAP_FILES]) {
+    char paths[SNAP_FILES][256];
+    checksum_job_t jobs[SNAP_FILES];
+    memset(jobs, 0, sizeof(jobs));
+    for (uint32_t kind = SNAP_STATE; kind <= SNAP_VOTES; kind++) {
+        snap_path(dir, kind, m->generation, paths[kind - 1], sizeof(paths[kind - 1]));
+        jobs[kind - 1].path = paths[kind - 1];
+        jobs[kind - 1].kind = CHECKSUM_BINARY;
+    }
+    trace_begin_str("load.verify", "dir", dir);
+    int rc = checksum_verify(jobs, SNAP_FILES);
+    trace_end("load.verify");
+    for (uint32_t kind = SNAP_STATE; kind <= SNAP_VOTES; kind++) {
+        const checksum_job_t *job = &jobs[kind - 1];
+        if (job->status != CHECKSUM_OK) {
+            rc = -1;
+            report_damage(dir, m, kind, job);
+        }
+        data_size[kind - 1] = job->data_size;
+    }
+    return rc;
+}
+
+int app_load(app_state_t *app, const char *dir) {
+    manifest_t m;
+    uint64_t data_size[SNAP_FILES];
+    int rc = read_manifest(dir, &m);
+    if (rc != 0) return rc;
+    if (verify_generation(dir, &m, data_size) != 0) return -1;
+    snap_header_t hs, hu, he, hv;
+    FILE *fs = snap_open(dir, &m, SNAP_STATE, sizeof(state_header_t), &hs);
+    FILE *fu = snap_open(dir, &m, SNAP_USERS, sizeof(user_auth_t), &hu);
+    FILE *fe = snap_open(dir, &m, SNAP_ELECTIONS, sizeof(election_rec_t), &he);
+    FILE *fv = snap_open(dir, &m, SNAP_VOTES, 0, &hv);
+    rc = (fs && fu && fe && fv) ? 0 : -1;
+    trace_begin_str("load.snapshot", "dir", dir);
+    /* State goes last so its counters replace the ones derived from records. */
+    if (rc == 0) rc = load_users(app, dir, m.generation, fu, &hu, data_size[SNAP_USERS - 1]);
+    if (rc == 0) rc = load_elections(app, fe, &he);
+    if (rc == 0 && data_size[SNAP_VOTES - 1] < sizeof(snap_header_t)) rc = -1;
+    if (rc == 0) rc = load_votes(app, fv, m.files[SNAP_VOTES - 1].name, hv.count, data_size[SNAP_VOTES - 1] - sizeof(snap_header_t));
+    if (rc == 0) rc = load_state(app, fs);
+    if (rc == 0 && app->wal_lsn != m.wal_lsn) rc = -1;
+    trace_end("load.snapshot");
+    if (fs && fu && fe && fv && rc != 0) {
+        fprintf(stderr, "%s: generation %llu fails validation while loading\n", dir,
+                (unsigned long long)m.generation);
+    }
+    if (fs) fclose(fs);
+    if (fu) fclose(fu);
+    if (fe) fclose(fe);
+    if (fv) fclose(fv);
+    app->current_user = APP_NO_USER;
+    return rc;
+}
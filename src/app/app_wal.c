@@ -0,0 +1,269 @@
+#include "app_internal.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include "../core/trace.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Logical redo records. Mutations log before they touch memory; replay
+ * applies records in LSN order and skips anything already present, so a
+ * snapshot taken mid-log plus a full replay converges on the same state. */
+
+enum { WAL_USER_ADD = 1, WAL_ELECTION_ADD, WAL_ELECTION_PHASE, WAL_VOTE_CAST };
+
+typedef struct {
+    user_auth_t auth;
+    user_profile_t profile;
+} wal_user_t;
+
+/* Followed by title, description and each candidate name, NUL-terminated. */
+typedef struct {
+    uint64_t id;
+    int64_t start_time;
+    int64_t end_time;
+    uint32_t phase;
+    uint32_t candidate_count;
+    uint32_t eligible_groups;
+    uint32_t reserved;
+} wal_election_t;
+
+typedef struct {
+    uint64_t id;
+    uint32_t phase;
+    uint32_t reserved;
+} wal_phase_t;
+
+static int app_log(app_state_t *app, uint16_t type, const void *data, uint32_t len) {
+    if (app->failed) return -1;
+    if (!app->wal) return 0;
+    uint64_t lsn;
+    if (wal_append(app->wal, type, data, len, &lsn) != 0) return -1;
+    app->wal_lsn = lsn;
+    return 0;
+}
+
+int app_log_user(app_state_t *app, const user_auth_t *auth, const user_profile_t *profile) {
+    wal_user_t rec;
+    rec.auth = *auth;
+    rec.profile = *profile;
+    return app_log(app, WAL_USER_ADD, &rec, sizeof(rec));
+}
+
+static size_t put_string(uint8_t *buf, size_t off, const char *s) {
+    size_t n = strlen(s) + 1;
+    memcpy(buf + off, s, n);
+    return off + n;
+}
+
+int app_log_election(app_state_t *app, const election_rec_t *el) {
+    if (app->failed) return -1;
+    if (!app->wal) return 0;
+    size_t len = sizeof(wal_election_t) + strlen(el->title) + 1 + strlen(app_election_description(app, el)) + 1;
+    for (uint32_t i = 0; i < el->candidate_count; i++) {
+        len += strlen(app_election_candidate(app, el, i)) + 1;
+    }
+    if (len > WAL_MAX_RECORD) return -1;
+    uint8_t *buf = (uint8_t *)mem_alloc(MEM_TAG_WAL, len);
+    if (!buf) return -1;
+    wal_election_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.id = el->id;
+    hdr.start_time = (int64_t)el->start_time;
+    hdr.end_time = (int64_t)el->end_time;
+    hdr.phase = (uint32_t)el->phase;
+    hdr.candidate_count = el->candidate_count;
+    hdr.eligible_groups = el->eligible_groups;
+    memcpy(buf, &hdr, sizeof(hdr));
+    size_t off = put_string(buf, sizeof(hdr), el->title);
+    off = put_string(buf, off, app_election_description(app, el));
+    for (uint32_t i = 0; i < el->candidate_count; i++) {
+        off = put_string(buf, off, app_election_candidate(app, el, i));
+    }
+    int rc = app_log(app, WAL_ELECTION_ADD, buf, (uint32_t)len);
+    mem_free(buf);
+    return rc;
+}
+
+int app_log_phase(app_state_t *app, uint64_t election_id, election_phase_t phase) {
+    wal_phase_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.id = election_id;
+    rec.phase = (uint32_t)phase;
+    return app_log(app, WAL_ELECTION_PHASE, &rec, sizeof(rec));
+}
+
+int app_log_vote(app_state_t *app, const vote_rec_t *v) {
+    return app_log(app, WAL_VOTE_CAST, v, sizeof(*v));
+}
+
+int app_commit(app_state_t *app) {
+    if (app->wal && wal_sync(app->wal, app->wal_lsn) != 0) {
+        /* Whether the record reached the disk is unknown, so the change
+         * can be neither kept nor undone safely. */
+        if (!app->failed) {
+            fprintf(stderr, "WAL commit of LSN %llu failed; refusing further changes and snapshots\n",
+                    (unsigned long long)app->wal_lsn);
+        }
+        app->failed = 1;
+        return -1;
+    }
+    /* Mutations run one at a time on the app's thread, so none is in
+     * has_voted now and tables left by a resize can go. */
+    concurrent_map_reclaim(&app->has_voted);
+    if (app->on_commit) app->on_commit(app, app->on_commit_ctx);
+    return 0;
+}
+
+/* Returns the string at *off and advances past it, or NULL if the payload
+ * ends without a terminator. */
+static const char *next_string(const uint8_t *p, uint32_t len, size_t *off) {
+    if (*off >= len) return NULL;
+    const char *s = (const char *)p + *off;
+    const char *nul = (const char *)memchr(s, 0, len - *off);
+    if (!nul) return NULL;
+    *off += (size_t)(nul - s) + 1;
+    return s;
+}
+
+static int apply_election(app_state_t *app, const uint8_t *p, uint32_t len) {
+    wal_election_t hdr;
+    if (len < sizeof(hdr)) return -1;
+    memcpy(&hdr, p, sizeof(hdr));
+    if (hash_table_get(&app->election_by_id, hdr.id, NULL) == 0) return 0;
+    if (hdr.candidate_count > len) return -1; /* each name takes at least one byte */
+    size_t off = sizeof(hdr);
+    const char *title = next_string(p, len, &off);
+    const char *desc = next_string(p, len, &off);
+    if (!title || !desc) return -1;
+    const char **names = (const char **)mem_alloc(MEM_TAG_MISC, (hdr.candidate_count ? hdr.candidate_count : 1) * sizeof(char *));
+    if (!names) return -1;
+    int rc = 0;
+    for (uint32_t i = 0; i < hdr.candidate_count && rc == 0; i++) {
+        if (!(names[i] = next_string(p, len, &off))) rc = -1;
+    }
+    election_rec_t el;
+    memset(&el, 0, sizeof(el));
+    el.id = hdr.id;
+    strncpy(el.title, title, TITLE_LEN - 1);
+    el.phase = (election_phase_t)hdr.phase;
+    el.start_time = (time_t)hdr.start_time;
+    el.end_time = (time_t)hdr.end_time;
+    el.eligible_groups = hdr.eligible_groups;
+    if (rc == 0) rc = app_set_description(app, &el, desc);
+    if (rc == 0) rc = app_set_candidates(app, &el, names, hdr.candidate_count);
+    if (rc == 0) rc = app_attach_election(app, &el);
+    mem_free(names);
+    return rc;
+}
+
+int app_apply_wal(app_state_t *app, const wal_record_hdr_t *hdr, const void *payload) {
+    const uint8_t *p = (const uint8_t *)payload;
+    int rc = 0;
+    switch (hdr->type) {
+    case WAL_USER_ADD: {
+        wal_user_t rec;
+        if (hdr->len != sizeof(rec)) return -1;
+        memcpy(&rec, p, sizeof(rec));
+        rec.profile.name[MAX_NAME - 1] = 0;
+        rec.profile.email[EMAIL_LEN - 1] = 0;
+        if (app_user_slot_by_id(app, rec.auth.id, NULL) != 0) rc = app_attach_user(app, &rec.auth, &rec.profile);
+        break;
+    }
+    case WAL_ELECTION_ADD:
+        rc = apply_election(app, p, hdr->len);
+        break;
+    case WAL_ELECTION_PHASE: {
+        wal_phase_t rec;
+        if (hdr->len != sizeof(rec)) return -1;
+        memcpy(&rec, p, sizeof(rec));
+        election_rec_t *el = app_find_election(app, rec.id);
+        if (!el) return -1;
+        el->phase = (election_phase_t)rec.phase;
+        break;
+    }
+    case WAL_VOTE_CAST: {
+        vote_rec_t v;
+        if (hdr->len != sizeof(v)) return -1;
+        memcpy(&v, p, sizeof(v));
+        rc = app_attach_vote(app, &v);
+        if (rc > 0) rc = 0; /* already applied */
+        break;
+    }
+    default:
+        return -1;
+    }
+    if (rc != 0) return -1;
+    if (hdr->lsn > app->wal_lsn) app->wal_lsn = hdr->lsn;
+    app->change_seq++;
+    return 0;
+}
+
+int app_wal_replay(app_state_t *app, const char *dir, uint64_t *out_next_lsn) {
+    wal_reader_t r;
+    if (plat_make_dir(dir) != 0 || wal_reader_open(&r, dir, app->wal_lsn + 1) != 0) return -1;
+    trace_begin_str("wal.replay", "dir", dir);
+    wal_record_hdr_t hdr;
+    const void *payload;
+    uint64_t replayed = 0;
+    int rc, failed = 0;
+    while ((rc = wal_reader_next(&r, &hdr, &payload)) == 1) {
+        if (app_apply_wal(app, &hdr, payload) != 0) {
+            fprintf(stderr, "WAL record LSN %llu in %s could not be applied\n", (unsigned long long)hdr.lsn, dir);
+            failed = 1;
+            break;
+        }
+        replayed++;
+    }
+    uint64_t next_lsn = r.next_lsn;
+    /* Replay stops at the first record that is torn or fails its CRC. Only
+     * the last write before a crash can be torn, so an intact record behind
+     * it, in its segment or a later one, means committed records would be
+     * lost. */
+    if (!failed && (rc < 0 || r.bad_lsn)) {
+        int tail = wal_reader_stopped_at_tail(&r);
+        if (r.bad_lsn) {
+            fprintf(stderr, "WAL record LSN %llu in %s/%020llu.wal at offset %llu fails its checksum\n",
+                    (unsigned long long)r.bad_lsn, dir, (unsigned long long)r.bad_segment,
+                    (unsigned long long)r.bad_offset);
+        } else if (r.truncated) {
+            fprintf(stderr, "WAL in %s has no segment holding LSN %llu\n", dir, (unsigned long long)next_lsn);
+        } else {
+            fprintf(stderr, "WAL segment %s/%020llu.wal is damaged before LSN %llu\n", dir,
+                    (unsigned long long)r.segment_start, (unsigned long long)next_lsn);
+        }
+        if (tail == 1) {
+            fprintf(stderr, "It is the torn tail of the last write; the log continues at LSN %llu\n",
+                    (unsigned long long)next_lsn);
+        } else {
+            fprintf(stderr, "Committed records follow it, so the log cannot be replayed past LSN %llu\n",
+                    (unsigned long long)(next_lsn - 1));
+            failed = 1;
+        }
+    }
+    wal_reader_close(&r);
+    trace_end("wal.replay");
+    if (replayed) fprintf(stderr, "Replayed %llu WAL records\n", (unsigned long long)replayed);
+    if (failed) return -1;
+    if (out_next_lsn) *out_next_lsn = next_lsn;
+    return 0;
+}
+
+int app_wal_open(app_state_t *app, const char *dir, const wal_options_t *opts) {
+    uint64_t next_lsn;
+    if (app_wal_replay(app, dir, &next_lsn) != 0) return -1;
+    wal_t *wal = (wal_t *)mem_alloc(MEM_TAG_WAL, sizeof(wal_t));
+    if (!wal) return -1;
+    if (wal_open(wal, dir, next_lsn, opts) != 0) {
+        mem_free(wal);
+        return -1;
+    }
+    app->wal = wal;
+    return 0;
+}
+
+void app_wal_close(app_state_t *app) {
+    if (!app->wal) return;
+    wal_close(app->wal);
+    mem_free(app->wal);
+    app->wal = NULL;
+}
@@ -0,0 +1,119 @@
+#include "bgsave.h"
+#include "../core/trace.h"
+#include <string.h>
+
+typedef struct {
+    app_state_t *app;
+    const char *dir;
+} bgsave_job_t;
+
+/* Runs in the forked child, where only the forking thread exists. It may
+ * allocate (malloc is fork-safe and the mem_* counters are lock-free),
+ * use stdio (the C library holds its stream locks across fork) and trace
+ * (trace.c does the same with its lock), but must not reach the WAL or
+ * the compactor, whose locks and queues belong to threads it lacks. */
+static int bgsave_child(void *arg) {
+    bgsave_job_t *job = (bgsave_job_t *)arg;
+    job->app->wal = NULL;
+    return app_save(job->app, job->dir) == 0 ? 0 : 1;
+}
+
+void bgsave_init(bgsave_t *b, const char *dir, unsigned interval_secs) {
+    memset(b, 0, sizeof(*b));
+    strncpy(b->dir, dir, sizeof(b->dir) - 1);
+    b->interval_ns = (uint64_t)interval_secs * 1000000000ULL;
+    b->last_start_ns = plat_now_ns();
+    b->child.pid = -1;
+    b->child.fd = -1;
+}
+
+/* ok means app_save returned 0: the manifest and its directory entry are
+ * durable, so the WAL it covers can go. A manifest renamed into place whose
+ * dir fsync failed is a failed save and truncates nothing. */
+static int install(bgsave_t *b, app_state_t *app, int ok) {
+    if (!ok) {
+        b->failed++;
+        return -1;
+    }
+    b->taken++;
+    b->saved_seq = b->pending_seq;
+    if (app->wal) {
+        int removed = wal_truncate(app->wal->dir, b->pending_lsn);
+        if (removed > 0) b->segments_removed += (uint64_t)removed;
+    }
+    return 0;
+}
+
+/* Starting a new segment first means every older segment is covered by the
+ * snapshot about to be written. If the rotate fails that no longer holds,
+ * so the snapshot is skipped and nothing is truncated. */
+static int prepare(bgsave_t *b, app_state_t *app) {
+    b->last_start_ns = plat_now_ns();
+    if (app->wal && wal_rotate(app->wal) != 0) {
+        fprintf(stderr, "Could not start a new WAL segment; snapshot skipped\n");
+        b->failed++;
+        return -1;
+    }
+    b->pending_lsn = app->wal_lsn;
+    b->pending_seq = app->change_seq;
+    return 0;
+}
+
+static int save_inline(bgsave_t *b, app_state_t *app) {
+    if (prepare(b, app) != 0) return -1;
+    uint64_t t0 = plat_now_ns();
+    int ok = app_save(app, b->dir) == 0;
+    b->last_fork_ns = 0;
+    b->last_write_ns = plat_now_ns() - t0;
+    b->last_total_ns = b->last_write_ns;
+    return install(b, app, ok);
+}
+
+int bgsave_start(bgsave_t *b, app_state_t *app) {
+    if (b->running) return 1;
+    if (app->failed || prepare(b, app) != 0) return -1;
+    bgsave_job_t job = {app, b->dir};
+    trace_begin("bgsave.fork");
+    uint64_t t0 = plat_now_ns();
+    int rc = plat_fork_child(&b->child, bgsave_child, &job);
+    uint64_t fork_ns = plat_now_ns() - t0;
+    trace_end("bgsave.fork");
+    if (rc != 0) return save_inline(b, app);
+    b->running = 1;
+    b->started_ns = t0;
+    b->last_fork_ns = fork_ns;
+    if (fork_ns > b->max_fork_ns) b->max_fork_ns = fork_ns;
+    return 0;
+}
+
+int bgsave_poll(bgsave_t *b, app_state_t *app, int wait) {
+    if (!b->running) return 0;
+    int status = -1;
+    int rc = plat_child_poll(&b->child, wait, &status);
+    if (rc == 0) return 0;
+    b->running = 0;
+    b->last_write_ns = b->child.run_ns;
+    int installed = install(b, app, rc == 1 && status == 0) == 0;
+    b->last_total_ns = plat_now_ns() - b->started_ns;
+    return installed;
+}
+
+void bgsave_tick(bgsave_t *b, app_state_t *app) {
+    bgsave_poll(b, app, 0);
+    if (b->running || b->interval_ns == 0 || app->change_seq == b->saved_seq || app->failed) return;
+    if (plat_now_ns() - b->last_start_ns < b->interval_ns) return;
+    bgsave_start(b, app);
+}
+
+int bgsave_finish(bgsave_t *b, app_state_t *app) {
+    bgsave_poll(b, app, 1);
+    return save_inline(b, app);
+}
+
+void bgsave_print_stats(const bgsave_t *b, FILE *out) {
+    fprintf(out, "Snapshots: %llu installed, %llu failed, %s\n", (unsigned long long)b->taken,
+            (unsigned long long)b->failed, b->running ? "one running" : "idle");
+    fprintf(out, "  last fork %.3f ms (max %.3f ms), child write %.3f ms, fork to install %.3f ms\n",
+            b->last_fork_ns / 1e6, b->max_fork_ns / 1e6, b->last_write_ns / 1e6, b->last_total_ns / 1e6);
+    fprintf(out, "  WAL segments truncated: %llu\n", (unsigned long long)b->segments_removed);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "app.h"
+#include "../core/platform.h"
+
+/* Periodic binary snapshots that do not stall the caller. A forked child
+ * writes a new snapshot generation from its copy-on-write image and commits
+ * its manifest while the parent keeps serving; once the child is reaped the
+ * parent drops the WAL segments the snapshot covers. Where fork is
+ * unavailable the snapshot is written inline. */
+
+typedef struct {
+    char dir[256];
+    uint64_t interval_ns;
+    uint64_t last_start_ns;
+    uint64_t saved_seq;    /* change_seq covered by the newest installed snapshot */
+    int running;
+    plat_child_t child;
+    uint64_t pending_lsn;  /* WAL LSN covered by the running child's snapshot */
+    uint64_t pending_seq;
+    uint64_t started_ns;
+    /* metrics */
+    uint64_t taken;
+    uint64_t failed;
+    uint64_t last_fork_ns;
+    uint64_t max_fork_ns;
+    uint64_t last_write_ns; /* time the child spent writing */
+    uint64_t last_total_ns; /* fork to install */
+    uint64_t segments_removed;
+} bgsave_t;
+
+void bgsave_init(bgsave_t *b, const char *dir, unsigned interval_secs);
+/* Starts a snapshot unless one is running; returns 1 if one was already
+ * running, 0 if started (or written inline), -1 on error. */
+int bgsave_start(bgsave_t *b, app_state_t *app);
+/* Reaps a finished child and truncates the WAL behind its snapshot; returns
+ * 1 if one was installed. With wait set, blocks until the running child exits. */
+int bgsave_poll(bgsave_t *b, app_state_t *app, int wait);
+/* Called between requests: reaps, then starts a snapshot if the interval
+ * has passed and state changed since the last one. */
+void bgsave_tick(bgsave_t *b, app_state_t *app);
+/* Waits for any running child, then writes a final snapshot inline. */
+int bgsave_finish(bgsave_t *b, app_state_t *app);
+void bgsave_print_stats(const bgsave_t *b, FILE *out);
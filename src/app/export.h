@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include "app.h"
+#include "../storage/vote_segment.h"
+
+/* Streaming vote export. Votes matching a filter (one election and/or a
+ * vote id range) are formatted straight into a 1 MB buffer that is written
+ * to a raw fd, so the output can be a file, stdout, a pipe or a socket.
+ *   EXPORT_CSV       id,election_id,voter_id,choice plus CRC32C check lines
+ *                    (storage/checksum.h); "Aggregate CSV files" reads it
+ *   EXPORT_JSONL     one JSON object per vote
+ *   EXPORT_COLUMNAR  a vote segment stream (storage/vote_segment.h)
+ * An unfiltered columnar export is the votes stream of a current snapshot
+ * byte for byte, so it is sent from that file with sendfile. */
+
+typedef enum { EXPORT_CSV = 0, EXPORT_JSONL, EXPORT_COLUMNAR } export_format_t;
+
+typedef struct {
+    export_format_t format;
+    uint64_t election_id; /* 0: every election */
+    uint64_t first_id;    /* vote id range, inclusive */
+    uint64_t last_id;
+    const char *data_dir; /* snapshot directory for zero-copy columnar exports; may be NULL */
+} export_options_t;
+
+typedef struct {
+    uint64_t votes;
+    uint64_t bytes;
+    uint64_t elapsed_ns;
+    int zero_copy; /* sent from the snapshot file without formatting */
+} export_stats_t;
+
+void export_options_init(export_options_t *opts, export_format_t format); /* every vote */
+int export_format_from_name(const char *name, export_format_t *out);
+/* Sets the vote id range from "first-last", "first-", "-last" or a single
+ * id; NULL or "" selects every id. */
+int export_parse_id_range(const char *s, export_options_t *opts);
+const char *export_format_name(export_format_t format);
+
+int app_export_votes(app_state_t *app, const export_options_t *opts, int fd, export_stats_t *stats);
+/* Writes path.tmp, fsyncs it and renames it over path. */
+int app_export_votes_to_path(app_state_t *app, const export_options_t *opts, const char *path, export_stats_t *stats);
+
+/* Merges columnar exports (vote segment streams in vote id order, such as
+ * one per machine) into one stream at out_path, in a single pass; exact
+ * copies of a vote are kept once (see vote_seg_merge). Written to
+ * out_path.tmp, fsynced and renamed. */
+int export_merge_segments(const char *const *paths, size_t count, const char *out_path, vote_seg_merge_stats_t *stats);
@@ -0,0 +1,125 @@
+#include "follower.h"
+#include <stdio.h>
+#include <string.h>
+
+#define FOLLOWER_BATCH 256 /* records applied per lock hold */
+
+/* Latches state; the reader is left on the record at stalled_lsn. */
+static void follower_stall(follower_t *f, follower_state_t state, uint64_t lsn) {
+    f->status.state = state;
+    f->status.stalled_lsn = lsn;
+    fprintf(stderr, "Follower stalled at LSN %llu: %s\n", (unsigned long long)lsn, follower_state_name(state));
+}
+
+/* Applies up to one batch; returns 1 if more records may be waiting. */
+static int follower_poll(follower_t *f) {
+    wal_record_hdr_t hdr;
+    const void *payload;
+    int rc = 0;
+    if (f->status.state != FOLLOWER_STREAMING) return 0;
+    for (int n = 0; n < FOLLOWER_BATCH; n++) {
+        rc = wal_reader_next(&f->reader, &hdr, &payload);
+        if (rc != 1) break;
+        if (app_apply_wal(&f->app, &hdr, payload) != 0) {
+            /* The reader already moved past it; put it back on the record
+             * so next_lsn stays applied_lsn + 1. */
+            char dir[sizeof(f->reader.dir)];
+            memcpy(dir, f->reader.dir, sizeof(dir));
+            wal_reader_close(&f->reader);
+            wal_reader_open(&f->reader, dir, hdr.lsn);
+            follower_stall(f, FOLLOWER_STALLED_APPLY, hdr.lsn);
+            rc = 0;
+            break;
+        }
+        uint64_t now = plat_wall_us();
+        f->status.applied_lsn = hdr.lsn;
+        f->status.applied_records++;
+        f->status.last_commit_us = hdr.time_us;
+        f->status.last_apply_delay_us = now > hdr.time_us ? now - hdr.time_us : 0;
+    }
+    if (rc < 0) {
+        follower_stall(f, f->reader.truncated ? FOLLOWER_STALLED_TRUNCATED : FOLLOWER_STALLED_DAMAGED,
+                       f->reader.next_lsn);
+    }
+    f->status.last_poll_us = plat_wall_us();
+    return rc == 1;
+}
+
+static void *follower_main(void *arg) {
+    follower_t *f = (follower_t *)arg;
+    while (!plat_atomic_load_u64(&f->stop)) {
+        plat_mutex_lock(&f->lock);
+        int more = follower_poll(f);
+        plat_mutex_unlock(&f->lock);
+        if (!more) plat_sleep_ms(f->poll_ms);
+    }
+    return NULL;
+}
+
+int follower_start(follower_t *f, const char *data_dir, unsigned poll_ms) {
+    memset(f, 0, sizeof(*f));
+    f->poll_ms = poll_ms ? poll_ms : 100;
+    if (app_init(&f->app) != 0) return -1;
+    int rc = app_load(&f->app, data_dir);
+    if (rc < 0) {
+        app_free(&f->app);
+        return -1;
+    }
+    if (rc > 0) {
+        /* Nothing saved as a snapshot yet: start from the CSV files. */
+        app_free(&f->app);
+        if (app_init(&f->app) != 0) return -1;
+        if (app_load_from_disk(&f->app, data_dir) != 0) {
+            app_free(&f->app);
+            return -1;
+        }
+    }
+    char wal_dir[300];
+    snprintf(wal_dir, sizeof(wal_dir), "%s/wal", data_dir);
+    if (wal_reader_open(&f->reader, wal_dir, f->app.wal_lsn + 1) != 0) {
+        fprintf(stderr, "WAL in %s does not reach back to LSN %llu\n", wal_dir,
+                (unsigned long long)(f->app.wal_lsn + 1));
+        app_free(&f->app);
+        return -1;
+    }
+    f->status.applied_lsn = f->app.wal_lsn;
+    /* Catch up before serving anything. */
+    while (follower_poll(f)) {
+    }
+    if (plat_mutex_init(&f->lock) != 0) {
+        wal_reader_close(&f->reader);
+        app_free(&f->app);
+        return -1;
+    }
+    if (plat_thread_create(&f->thread, follower_main, f) != 0) {
+        plat_mutex_destroy(&f->lock);
+        wal_reader_close(&f->reader);
+        app_free(&f->app);
+        return -1;
+    }
+    return 0;
+}
+
+void follower_stop(follower_t *f) {
+    plat_atomic_add_u64(&f->stop, 1);
+    plat_thread_join(&f->thread);
+    plat_mutex_destroy(&f->lock);
+    wal_reader_close(&f->reader);
+    app_free(&f->app);
+}
+
+void follower_get_status(follower_t *f, follower_status_t *out) {
+    plat_mutex_lock(&f->lock);
+    *out = f->status;
+    plat_mutex_unlock(&f->lock);
+}
+
+const char *follower_state_name(follower_state_t state) {
+    switch (state) {
+    case FOLLOWER_STREAMING: return "streaming";
+    case FOLLOWER_STALLED_APPLY: return "stalled: record could not be applied";
+    case FOLLOWER_STALLED_DAMAGED: return "stalled: WAL is damaged";
+    case FOLLOWER_STALLED_TRUNCATED: return "stalled: WAL truncated past applied_lsn";
+    }
+    return "unknown";
+}
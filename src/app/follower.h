@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include "app.h"
+#include "../core/platform.h"
+#include "../storage/wal.h"
+
+/* Hot standby / read replica. Loads the primary's last snapshot from a
+ * shared data directory, then a background thread tails <dir>/wal and
+ * replays new records into a private app_state_t. Callers hold lock while
+ * reading app; the thread takes it only to apply a batch. */
+
+/* Once stalled the follower stops applying until it is restarted. */
+typedef enum {
+    FOLLOWER_STREAMING = 0,
+    FOLLOWER_STALLED_APPLY,     /* the record at stalled_lsn cannot be applied */
+    FOLLOWER_STALLED_DAMAGED,   /* the log is corrupt at stalled_lsn */
+    FOLLOWER_STALLED_TRUNCATED  /* the primary removed segments from stalled_lsn on */
+} follower_state_t;
+
+typedef struct {
+    uint64_t applied_lsn;
+    uint64_t applied_records;     /* since follower_start */
+    uint64_t last_commit_us;      /* primary wall clock of the last applied record */
+    uint64_t last_apply_delay_us; /* apply time minus commit time of that record */
+    uint64_t last_poll_us;
+    follower_state_t state;
+    uint64_t stalled_lsn;         /* first LSN not applied once stalled */
+} follower_status_t;
+
+typedef struct {
+    app_state_t app;
+    plat_mutex_t lock;
+    plat_thread_t thread;
+    wal_reader_t reader;
+    unsigned poll_ms;
+    volatile uint64_t stop;
+    follower_status_t status;
+} follower_t;
+
+int follower_start(follower_t *f, const char *data_dir, unsigned poll_ms);
+void follower_stop(follower_t *f);
+void follower_get_status(follower_t *f, follower_status_t *out);
+const char *follower_state_name(follower_state_t state);
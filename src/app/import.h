@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include "app.h"
+
+/* Bulk import of voter rolls and ballots from CSV, bypassing the per-record
+ * register/vote path. The file is mapped and split into one line-aligned
+ * chunk per core. Workers parse their chunk (and hash emails); a single
+ * pass in file order then deduplicates and inserts into indexes presized for
+ * the whole file, and voters' records are filled in, passwords hashed, back
+ * on all cores. The caller persists the result (the import is not logged).
+ *   IMPORT_VOTERS   name,email,password[,groups]  (first email wins)
+ *   IMPORT_BALLOTS  election_id,voter_id,choice   (one ballot per voter and
+ *                   election; the election must be open for voting)
+ * A leading header line and '#' lines are skipped. */
+
+typedef enum { IMPORT_VOTERS = 0, IMPORT_BALLOTS } import_kind_t;
+
+typedef struct {
+    uint64_t rows;       /* data lines read */
+    uint64_t imported;
+    uint64_t duplicates; /* email already registered, or voter already voted */
+    uint64_t rejected;   /* malformed or failing validation */
+    uint64_t first_bad_line; /* 1-based line of the first rejected row; 0 if none */
+    unsigned threads;
+    uint64_t parse_ns;
+    uint64_t index_ns;
+    uint64_t fill_ns;
+} import_stats_t;
+
+int import_kind_from_name(const char *name, import_kind_t *out);
+int app_import_csv(app_state_t *app, import_kind_t kind, const char *path, import_stats_t *stats);
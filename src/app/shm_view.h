@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+#include "../core/platform.h"
+#include "../core/str_pool.h"
+#include "../models/election.h"
+
+/* Read-only shared snapshot served to reader processes. The writer lays the
+ * whole file out in one buffer using byte offsets from the start of the
+ * file, writes it to a temporary name and renames it over the published
+ * path. Readers map it read-only; a refresh maps the new file and swaps to
+ * it, while the previous mapping keeps the old generation alive until the
+ * reader lets go of it.
+ *
+ * Layout (every section 8-byte aligned):
+ *   shm_header_t
+ *   election_rec_t[election_count]     string refs point into the pool section
+ *   shm_index_entry_t[election_count]  sorted by election id
+ *   shm_result_t[election_count]
+ *   uint64_t counts[counts_len]        per-candidate vote counts
+ *   pool bytes[strings_size]           str_pool_t buffer, offset 0 = "" */
+
+#define SHM_MAGIC "OVSHM01"
+#define SHM_VERSION 2u
+#define SHM_NO_WINNER UINT32_MAX
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t generation;
+    uint64_t published_at_us; /* wall clock, so readers can tell how old it is */
+    uint64_t change_seq;      /* writer's app change_seq it reflects */
+    uint64_t writer_pid;
+    uint64_t user_count;
+    uint64_t election_count;
+    uint64_t vote_count;
+    uint64_t next_user_id;
+    uint64_t next_election_id;
+    uint64_t next_vote_id;
+    uint64_t total_size;
+    uint64_t elections_off;
+    uint64_t index_off;
+    uint64_t results_off;
+    uint64_t counts_off;
+    uint64_t counts_len;
+    uint64_t strings_off;
+    uint64_t strings_size;
+} shm_header_t;
+
+typedef struct {
+    uint64_t id;
+    uint32_t slot;
+    uint32_t reserved;
+} shm_index_entry_t;
+
+typedef struct {
+    uint64_t total_votes;
+    uint32_t counts_first; /* first entry in the counts section */
+    uint32_t winner;       /* candidate index, SHM_NO_WINNER if no votes */
+} shm_result_t;
+
+typedef struct {
+    char path[256];
+    plat_map_t map;
+    const shm_header_t *hdr;
+    uint64_t file_id;
+} shm_view_t;
+
+int shm_view_open(shm_view_t *v, const char *path);
+/* Returns 1 after swapping to a newer file, 0 if unchanged, -1 if the new
+ * file could not be mapped or validated (the old generation stays live). */
+int shm_view_refresh(shm_view_t *v);
+void shm_view_close(shm_view_t *v);
+
+const election_rec_t *shm_view_election(const shm_view_t *v, uint32_t slot);
+const election_rec_t *shm_view_find_election(const shm_view_t *v, uint64_t id, uint32_t *out_slot);
+const shm_result_t *shm_view_result(const shm_view_t *v, uint32_t slot);
+const uint64_t *shm_view_counts(const shm_view_t *v, const shm_result_t *r);
+const char *shm_view_string(const shm_view_t *v, str_ref_t ref);
+const char *shm_view_candidate(const shm_view_t *v, const election_rec_t *el, uint32_t index);
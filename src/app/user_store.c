@@ -0,0 +1,77 @@
+#include "user_store.h"
+#include "../core/mem.h"
+#include <string.h>
+
+int user_store_init(user_store_t *st, size_t initial_capacity) {
+    memset(st, 0, sizeof(*st));
+    return user_store_reserve(st, initial_capacity ? initial_capacity : 64);
+}
+
+void user_store_free(user_store_t *st) {
+    for (uint32_t i = 0; i < st->page_count; i++) {
+        mem_free(st->pages[i]);
+    }
+    mem_free(st->pages);
+    mem_free(st->auth);
+    memset(st, 0, sizeof(*st));
+}
+
+int user_store_reserve(user_store_t *st, size_t capacity) {
+    if (capacity <= st->capacity) return 0;
+    if (capacity > UINT32_MAX) return -1;
+    user_auth_t *auth = (user_auth_t *)mem_realloc(MEM_TAG_USERS, st->auth, capacity * sizeof(user_auth_t));
+    if (!auth) return -1;
+    st->auth = auth;
+    st->capacity = (uint32_t)capacity;
+    return 0;
+}
+
+static int add_page(user_store_t *st) {
+    if (st->page_count == st->page_capacity) {
+        uint32_t cap = st->page_capacity ? st->page_capacity * 2 : 8;
+        user_profile_t **pages = (user_profile_t **)mem_realloc(MEM_TAG_USERS, st->pages, cap * sizeof(*pages));
+        if (!pages) return -1;
+        st->pages = pages;
+        st->page_capacity = cap;
+    }
+    user_profile_t *page = (user_profile_t *)mem_calloc(MEM_TAG_USERS, USER_PROFILE_PAGE, sizeof(user_profile_t));
+    if (!page) return -1;
+    st->pages[st->page_count++] = page;
+    return 0;
+}
+
+int user_store_extend(user_store_t *st, uint32_t n, uint32_t *out_first) {
+    if (n > UINT32_MAX - st->count || user_store_reserve(st, (size_t)st->count + n) != 0) return -1;
+    uint32_t end = st->count + n;
+    while ((uint64_t)st->page_count * USER_PROFILE_PAGE < end) {
+        if (add_page(st) != 0) return -1;
+    }
+    memset(&st->auth[st->count], 0, (size_t)n * sizeof(user_auth_t));
+    if (out_first) *out_first = st->count;
+    st->count = end;
+    return 0;
+}
+
+int user_store_add(user_store_t *st, const user_auth_t *auth, const user_profile_t *profile, uint32_t *out_index) {
+    if (st->count == UINT32_MAX) return -1;
+    if (st->count == st->capacity && user_store_reserve(st, (size_t)st->capacity * 2) != 0) return -1;
+    uint32_t idx = st->count;
+    if (idx / USER_PROFILE_PAGE >= st->page_count && add_page(st) != 0) return -1;
+    st->auth[idx] = *auth;
+    st->pages[idx / USER_PROFILE_PAGE][idx % USER_PROFILE_PAGE] = *profile;
+    st->count++;
+    if (out_index) *out_index = idx;
+    return 0;
+}
+
+void user_store_pop(user_store_t *st) {
+    if (st->count) st->count--;
+}
+
+user_auth_t *user_store_auth(const user_store_t *st, uint32_t index) {
+    return index < st->count ? &st->auth[index] : NULL;
+}
+
+user_profile_t *user_store_profile(const user_store_t *st, uint32_t index) {
+    return index < st->count ? &st->pages[index / USER_PROFILE_PAGE][index % USER_PROFILE_PAGE] : NULL;
+}
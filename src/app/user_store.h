@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "../models/user.h"
+
+/* Users split by access pattern: a dense array of hot auth records plus
+ * cold profiles kept in separately allocated fixed-size pages. Both halves
+ * share the same slot index, which is what the app's indexes store. */
+
+#define USER_PROFILE_PAGE 256 /* profiles per cold page (48 KB) */
+
+typedef struct {
+    user_auth_t *auth;
+    uint32_t count;
+    uint32_t capacity;
+    user_profile_t **pages;
+    uint32_t page_count;
+    uint32_t page_capacity;
+} user_store_t;
+
+int user_store_init(user_store_t *st, size_t initial_capacity);
+void user_store_free(user_store_t *st);
+int user_store_reserve(user_store_t *st, size_t capacity);
+/* Appends n zeroed slots starting at *out_first, for callers that fill them
+ * in place (possibly from several threads). */
+int user_store_extend(user_store_t *st, uint32_t n, uint32_t *out_first);
+int user_store_add(user_store_t *st, const user_auth_t *auth, const user_profile_t *profile, uint32_t *out_index);
+/* Drops the last slot, undoing a user_store_add. */
+void user_store_pop(user_store_t *st);
+user_auth_t *user_store_auth(const user_store_t *st, uint32_t index);
+user_profile_t *user_store_profile(const user_store_t *st, uint32_t index);
@@ -1,6 +1,6 @@
 #include "audit.h"
+#include "../core/mem.h"
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 int audit_init(audit_ctx_t *ctx) {
@@ -9,7 +9,7 @@ int audit_init(audit_ctx_t *ctx) {
 }
 
 int audit_append(audit_ctx_t *ctx, const char *entry) {
-    char *dup = strdup(entry);
+    char *dup = mem_strdup(MEM_TAG_AUDIT, entry);
     if (!dup) {
         return -1;
     }
@@ -26,13 +26,13 @@ void audit_flush(audit_ctx_t *ctx, const char *path) {
         if (line) {
             fputs(line, f);
             fputc('\n', f);
-            free(line);
+            mem_free(line);
         }
     }
     fclose(f);
 }
 
 void audit_close(audit_ctx_t *ctx) {
-    queue_clear(&ctx->pending, free);
+    queue_clear(&ctx->pending, mem_free);
 }
 
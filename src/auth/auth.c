@@ -27,7 +27,7 @@ int auth_hash_password(const uint8_t *salt, const char *password, uint8_t *out_h
     return 0;
 }
 
-int auth_verify_password(const user_rec_t *user, const char *password) {
+int auth_verify_password(const user_auth_t *user, const char *password) {
     uint8_t hash[HASH_LEN];
     auth_hash_password(user->salt, password, hash);
     return memcmp(hash, user->pass_hash, HASH_LEN) == 0 ? 0 : -1;
@@ -1,6 +1,16 @@
 #include "cli.h"
 #include "../app/app.h"
+#include "../app/bgsave.h"
+#include "../app/export.h"
+#include "../app/import.h"
+#include "../app/follower.h"
+#include "../app/shm_view.h"
 #include "../core/hash_table.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include "../core/trace.h"
+#include "../storage/checksum.h"
+#include "../storage/compactor.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -32,79 +42,297 @@ static int prompt_uint32(const char *label, uint32_t *out) {
     return 0;
 }
 
+static void print_export_stats(FILE *out, const export_options_t *opts, const export_stats_t *st) {
+    double secs = st->elapsed_ns / 1e9;
+    fprintf(out, "Exported %" PRIu64 " votes as %s: %" PRIu64 " bytes in %.1f ms (%.0f MB/s)%s\n", st->votes,
+            export_format_name(opts->format), st->bytes, secs * 1e3, secs > 0 ? st->bytes / secs / 1e6 : 0.0,
+            st->zero_copy ? ", sent from the snapshot with sendfile" : "");
+}
+
+#define AGG_MAX_THREADS 16
+#define AGG_KEYS 65536 /* distinct (election, choice) pairs before the serial fallback */
+
+/* Files are handed out one at a time to the aggregation workers. */
+typedef struct {
+    char **files;
+    const checksum_job_t *jobs;
+    size_t count;
+    volatile uint64_t next;
+    hash_table_t *counts;      /* (election, choice) -> votes, low 32 bits */
+    hash_table_t *carries;     /* (election, choice) -> wraps of its count */
+    plat_mutex_t carry_lock;
+    int atomic;
+    volatile uint64_t overflow;
+    uint8_t *unreadable;
+} agg_pool_t;
+
+/* Digits up to the next comma or line end; *p is left past the comma. */
+static int agg_field(const char **p, const char *end, uint64_t *out) {
+    const char *s = *p;
+    uint64_t v = 0;
+    int digits = 0;
+    while (s < end && *s >= '0' && *s <= '9') {
+        v = v * 10 + (uint64_t)(*s++ - '0');
+        digits++;
+    }
+    while (s < end && *s != ',' && *s != '\n') s++;
+    int more = s < end && *s == ',';
+    *p = more ? s + 1 : s;
+    *out = v;
+    return digits ? (more ? 1 : 0) : -1;
+}
+
+/* One vote for key. A count passing 2^32 carries into a second table, so
+ * tallies stay 64-bit while the hot table keeps 32-bit values; carries are
+ * rare enough to take a lock. */
+static int agg_count(agg_pool_t *pool, uint64_t key) {
+    int rc = pool->atomic ? hash_table_add_atomic(pool->counts, key, 1) : hash_table_add(pool->counts, key, 1, NULL);
+    if (rc <= 0) return rc;
+    plat_mutex_lock(&pool->carry_lock);
+    rc = hash_table_add(pool->carries, key, 1, NULL);
+    plat_mutex_unlock(&pool->carry_lock);
+    return rc < 0 ? -1 : 0;
+}
+
+/* Counts one export's id,election_id,voter_id,choice rows. */
+static void agg_file(agg_pool_t *pool, size_t i) {
+    plat_map_t map;
+    if (plat_map_file(&map, pool->files[i]) != 0) {
+        pool->unreadable[i] = 1;
+        return;
+    }
+    trace_begin_str("tally.csv_file", "path", pool->files[i]);
+    const char *s = (const char *)map.data, *end = s + map.size;
+    while (s < end) {
+        const char *nl = (const char *)memchr(s, '\n', (size_t)(end - s));
+        const char *e = nl ? nl : end;
+        if (s[0] != '#' && !(e - s >= 3 && strncmp(s, "id,", 3) == 0)) { /* checksum, header */
+            const char *p = s;
+            uint64_t id, eid, vid, choice;
+            if (agg_field(&p, e, &id) == 1 && agg_field(&p, e, &eid) == 1 && agg_field(&p, e, &vid) == 1 &&
+                agg_field(&p, e, &choice) >= 0) {
+                uint64_t key = (eid << 32) | (choice & 0xffffffffULL);
+                if (agg_count(pool, key) != 0) {
+                    plat_atomic_add_u64(&pool->overflow, 1);
+                    break;
+                }
+            }
+        }
+        s = nl ? nl + 1 : end;
+    }
+    trace_end("tally.csv_file");
+    plat_unmap_file(&map);
+}
+
+static void *agg_worker(void *arg) {
+    agg_pool_t *pool = (agg_pool_t *)arg;
+    for (;;) {
+        uint64_t i = plat_atomic_add_u64(&pool->next, 1) - 1;
+        if (i >= pool->count || plat_atomic_load_u64(&pool->overflow)) break;
+        checksum_status_t st = pool->jobs[i].status;
+        if (st == CHECKSUM_OK || st == CHECKSUM_UNFRAMED) agg_file(pool, (size_t)i);
+    }
+    return NULL;
+}
+
+/* Parses the files on up to one thread per file, adding into one table
+ * with atomic fetch-add. A table that fills up (more distinct pairs than
+ * AGG_KEYS) is recounted on this thread with a growable table. */
+static int aggregate_files(agg_pool_t *pool) {
+    unsigned threads = plat_cpu_count();
+    if (threads > AGG_MAX_THREADS) threads = AGG_MAX_THREADS;
+    if (threads > pool->count) threads = (unsigned)pool->count;
+    if (threads < 1) threads = 1;
+    if (hash_table_reserve(pool->counts, AGG_KEYS) != 0) return -1;
+    pool->atomic = threads > 1;
+    plat_thread_t workers[AGG_MAX_THREADS];
+    unsigned started = 0;
+    while (started + 1 < threads && plat_thread_create(&workers[started], agg_worker, pool) == 0) started++;
+    agg_worker(pool);
+    for (unsigned t = 0; t < started; t++) plat_thread_join(&workers[t]);
+    if (!pool->overflow) return 0;
+    hash_table_free(pool->counts);
+    hash_table_free(pool->carries);
+    if (hash_table_init(pool->counts, 128) != 0 || hash_table_init(pool->carries, 8) != 0) return -1;
+    pool->atomic = 0;
+    pool->next = 0;
+    pool->overflow = 0;
+    agg_worker(pool);
+    return pool->overflow ? -1 : 0;
+}
+
 static int tally_from_csv_files(char *paths_csv) {
-    char *paths = strdup(paths_csv);
+    char *paths = mem_strdup(MEM_TAG_MISC, paths_csv);
     if (!paths) return -1;
     size_t file_cap = 8, file_count = 0;
-    char **files = malloc(file_cap * sizeof(char *));
+    char **files = mem_alloc(MEM_TAG_MISC, file_cap * sizeof(char *));
     if (!files) {
-        free(paths);
+        mem_free(paths);
         return -1;
     }
     char *tok = strtok(paths, ",");
     while (tok) {
         if (file_count == file_cap) {
             file_cap *= 2;
-            char **nf = realloc(files, file_cap * sizeof(char *));
-            if (!nf) { free(files); free(paths); return -1; }
+            char **nf = mem_realloc(MEM_TAG_MISC, files, file_cap * sizeof(char *));
+            if (!nf) { mem_free(files); mem_free(paths); return -1; }
             files = nf;
         }
         files[file_count++] = tok;
         tok = strtok(NULL, ",");
     }
 
-    hash_table_t counts;
-    hash_table_init(&counts, 128);
+    /* Damaged exports are left out rather than counted. */
+    checksum_job_t *jobs = mem_calloc(MEM_TAG_MISC, file_count ? file_count : 1, sizeof(checksum_job_t));
+    if (!jobs) { mem_free(files); mem_free(paths); return -1; }
+    for (size_t i = 0; i < file_count; i++) {
+        jobs[i].path = files[i];
+        jobs[i].kind = CHECKSUM_TEXT;
+    }
+    checksum_verify(jobs, (unsigned)file_count);
 
-    char line[256];
     for (size_t i = 0; i < file_count; i++) {
-        FILE *f = fopen(files[i], "r");
-        if (!f) {
+        checksum_status_t st = jobs[i].status;
+        if (st != CHECKSUM_OK && st != CHECKSUM_UNFRAMED && st != CHECKSUM_MISSING) {
+            char msg[512];
+            checksum_describe(&jobs[i], msg, sizeof(msg));
+            fprintf(stderr, "Skipping %s\n", msg);
+        } else if (st == CHECKSUM_MISSING) {
             fprintf(stderr, "Could not open %s\n", files[i]);
-            continue;
-        }
-        while (fgets(line, sizeof(line), f)) {
-            if (strncmp(line, "id,", 3) == 0) continue; /* header */
-            char *id_s = strtok(line, ",");
-            char *eid_s = strtok(NULL, ",");
-            (void)id_s;
-            char *vid_s = strtok(NULL, ",");
-            (void)vid_s;
-            char *choice_s = strtok(NULL, ",");
-            if (!eid_s || !choice_s) continue;
-            uint64_t eid = strtoull(eid_s, NULL, 10);
-            uint64_t choice = strtoull(choice_s, NULL, 10);
-            uint64_t key = (eid << 32) | (choice & 0xffffffffULL);
-            uint64_t val = 0;
-            if (hash_table_get(&counts, key, &val) == 0) {
-                val++;
-                hash_table_put(&counts, key, val);
-            } else {
-                hash_table_put(&counts, key, 1);
-            }
         }
-        fclose(f);
+    }
+    hash_table_t counts, carries;
+    agg_pool_t pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.files = files;
+    pool.jobs = jobs;
+    pool.count = file_count;
+    pool.counts = &counts;
+    pool.carries = &carries;
+    memset(&counts, 0, sizeof(counts));
+    memset(&carries, 0, sizeof(carries));
+    pool.unreadable = mem_calloc(MEM_TAG_MISC, file_count ? file_count : 1, 1);
+    if (!pool.unreadable || hash_table_init(&counts, 128) != 0 || hash_table_init(&carries, 8) != 0 ||
+        plat_mutex_init(&pool.carry_lock) != 0) {
+        hash_table_free(&counts);
+        hash_table_free(&carries);
+        mem_free(pool.unreadable);
+        mem_free(jobs);
+        mem_free(files);
+        mem_free(paths);
+        return -1;
+    }
+    if (aggregate_files(&pool) != 0) fprintf(stderr, "Aggregation ran out of memory\n");
+    for (size_t i = 0; i < file_count; i++) {
+        if (pool.unreadable[i]) fprintf(stderr, "Could not open %s\n", files[i]);
     }
 
     puts("Aggregated tally (from CSV files):");
-    for (size_t i = 0; i < counts.capacity; i++) {
-        hash_bucket_t *b = &counts.buckets[i];
-        if (b->state == 1) {
-            uint64_t key = b->key;
-            uint64_t eid = key >> 32;
-            uint32_t choice = (uint32_t)(key & 0xffffffffULL);
-            printf("  election=%" PRIu64 " choice=%u -> %" PRIu64 " votes\n", eid, choice, b->value);
-        }
+    hash_iter_t it;
+    uint64_t key;
+    uint32_t low, wraps;
+    hash_iter_init(&it, &counts);
+    while (counts.buckets && hash_iter_next(&it, &key, &low)) {
+        uint64_t eid = key >> 32;
+        uint32_t choice = (uint32_t)(key & 0xffffffffULL);
+        uint64_t votes = low;
+        if (carries.buckets && hash_table_get(&carries, key, &wraps) == 0) votes += (uint64_t)wraps << 32;
+        printf("  election=%" PRIu64 " choice=%u -> %" PRIu64 " votes\n", eid, choice, votes);
     }
 
+    plat_mutex_destroy(&pool.carry_lock);
     hash_table_free(&counts);
-    free(files);
-    free(paths);
+    hash_table_free(&carries);
+    mem_free(pool.unreadable);
+    mem_free(jobs);
+    mem_free(files);
+    mem_free(paths);
     return 0;
 }
 
+#define SHM_DEFAULT_PATH "data/live.shm"
+
+/* Shared snapshot publishing for reader processes, enabled by
+ * ONLINEVOTE_SHM=<path>. Every commit publishes a new generation unless
+ * one went out less than ONLINEVOTE_SHM_INTERVAL_MS (default 0) ago, which
+ * batches bursts; a change held back that way is published before the CLI
+ * next waits for input, so an idle primary never leaves readers behind. */
+typedef struct {
+    const char *path;
+    uint64_t interval_ns;
+    uint64_t last_ns;
+    uint64_t published_seq;
+    uint64_t generation;
+    int published;
+} shm_publisher_t;
+
+static shm_publisher_t publisher;
+
+static void publisher_init(void) {
+    publisher.path = getenv("ONLINEVOTE_SHM");
+    if (!publisher.path || !*publisher.path) {
+        publisher.path = NULL;
+        return;
+    }
+    const char *ms = getenv("ONLINEVOTE_SHM_INTERVAL_MS");
+    publisher.interval_ns = ms ? strtoull(ms, NULL, 10) * 1000000ULL : 0;
+    /* Continue the generation numbering of a previous writer. */
+    shm_view_t prev;
+    if (shm_view_open(&prev, publisher.path) == 0) {
+        publisher.generation = prev.hdr->generation;
+        shm_view_close(&prev);
+    }
+}
+
+static void publish_shm(const app_state_t *app, int force) {
+    if (!publisher.path || app->failed) return;
+    if (publisher.published && app->change_seq == publisher.published_seq) return;
+    uint64_t now = plat_now_ns();
+    if (!force && publisher.published && now - publisher.last_ns < publisher.interval_ns) return;
+    if (app_publish_shm(app, publisher.path, publisher.generation + 1) != 0) {
+        fprintf(stderr, "Could not publish shared snapshot to %s\n", publisher.path);
+        return;
+    }
+    publisher.generation++;
+    publisher.published_seq = app->change_seq;
+    publisher.last_ns = now;
+    publisher.published = 1;
+}
+
+static void publish_after_commit(const app_state_t *app, void *ctx) {
+    (void)ctx;
+    publish_shm(app, 0);
+}
+
+static bgsave_t bgsave;
+static compactor_t compactor;
+static int compactor_running;
+
+/* ONLINEVOTE_COMPACT_DIR names a segment directory to keep compacted in the
+ * background, at ONLINEVOTE_COMPACT_MBPS megabytes per second of I/O. */
+static void compactor_init_from_env(void) {
+    const char *dir = getenv("ONLINEVOTE_COMPACT_DIR");
+    if (!dir || !*dir) return;
+    const char *mbps = getenv("ONLINEVOTE_COMPACT_MBPS");
+    compact_options_t opts;
+    compact_options_init(&opts);
+    opts.budget_bytes_per_sec = (mbps ? strtoull(mbps, NULL, 10) : 16) << 20;
+    opts.small_bytes = COMPACT_SMALL_BYTES;
+    opts.max_inputs = COMPACT_MAX_INPUTS;
+    if (compactor_start(&compactor, dir, &opts, 10000) == 0) compactor_running = 1;
+    else fprintf(stderr, "Could not start compacting %s\n", dir);
+}
+
+/* Housekeeping between requests: reap or start background snapshots and
+ * publish any change still held back from the shared snapshot. */
+static void cli_tick(app_state_t *app) {
+    bgsave_tick(&bgsave, app);
+    publish_shm(app, 1);
+}
+
 static void menu_loop(app_state_t *app) {
     for (;;) {
+        cli_tick(app);
         printf("\nLogin as (1=Admin, 2=Voter, 0=Exit): ");
         char line[16]; read_line(line, sizeof(line));
         int role_choice = atoi(line);
@@ -125,10 +353,13 @@ static void menu_loop(app_state_t *app) {
                 puts("3) Open voting");
                 puts("4) Close voting");
                 puts("5) Tally election");
-                puts("6) Export local votes to CSV");
+                puts("6) Export votes");
                 puts("7) Aggregate CSV files");
                 puts("8) List users");
                 puts("9) Logout");
+                puts("10) Show stats");
+                puts("11) Freeze user indexes");
+                cli_tick(app);
                 printf("Choose: ");
                 char a[16]; read_line(a, sizeof(a));
                 int c = atoi(a);
@@ -138,13 +369,15 @@ static void menu_loop(app_state_t *app) {
                     printf("Title: "); read_line(title, sizeof(title));
                     printf("Description: "); read_line(desc, sizeof(desc));
                     printf("Candidates (comma separated): "); read_line(candline, sizeof(candline));
-                    char candidates[MAX_CAND][64];
+                    uint32_t cap = 1;
+                    for (const char *p = candline; *p; p++) {
+                        if (*p == ',') cap++;
+                    }
+                    const char **candidates = (const char **)mem_alloc(MEM_TAG_MISC, cap * sizeof(char *));
                     uint32_t count = 0;
-                    char *tok = strtok(candline, ",");
-                    while (tok && count < MAX_CAND) {
-                        strncpy(candidates[count], tok, 63);
-                        candidates[count][63] = 0;
-                        count++;
+                    char *tok = candidates ? strtok(candline, ",") : NULL;
+                    while (tok && count < cap) {
+                        candidates[count++] = tok;
                         tok = strtok(NULL, ",");
                     }
                     if (count == 0) {
@@ -154,6 +387,7 @@ static void menu_loop(app_state_t *app) {
                     } else {
                         puts("Failed to create election (need admin login?).");
                     }
+                    mem_free(candidates);
                 } else if (c == 2) {
                     app_list_elections(app);
                 } else if (c == 3) {
@@ -175,11 +409,30 @@ static void menu_loop(app_state_t *app) {
                     else
                         puts("Tally failed.");
                 } else if (c == 6) {
-                    char path[256];
-                    printf("CSV output path: ");
+                    char fmt[32], path[256];
+                    export_format_t format;
+                    printf("Format (csv, jsonl, columnar) [csv]: ");
+                    read_line(fmt, sizeof(fmt));
+                    if (export_format_from_name(fmt, &format) != 0) {
+                        puts("Unknown format.");
+                        continue;
+                    }
+                    export_options_t opts;
+                    export_options_init(&opts, format);
+                    opts.data_dir = "data";
+                    if (prompt_uint64("Election ID (0 = all)", &opts.election_id) != 0) opts.election_id = 0;
+                    char range[64];
+                    printf("Vote IDs (first-last, blank = all): ");
+                    read_line(range, sizeof(range));
+                    if (export_parse_id_range(range, &opts) != 0) {
+                        puts("Bad vote ID range.");
+                        continue;
+                    }
+                    printf("Output path: ");
                     read_line(path, sizeof(path));
-                    if (app_export_votes_csv(app, path) == 0)
-                        puts("Exported votes CSV.");
+                    export_stats_t st;
+                    if (app_export_votes_to_path(app, &opts, path, &st) == 0)
+                        print_export_stats(stdout, &opts, &st);
                     else
                         puts("Export failed.");
                 } else if (c == 7) {
@@ -190,6 +443,22 @@ static void menu_loop(app_state_t *app) {
                         puts("Aggregation failed.");
                 } else if (c == 8) {
                     app_list_users(app);
+                } else if (c == 10) {
+                    app_print_stats(app, stdout);
+                    bgsave_print_stats(&bgsave, stdout);
+                    if (compactor_running) {
+                        compact_stats_t cst;
+                        compactor_get_stats(&compactor, &cst);
+                        compact_print_stats(&cst, stdout);
+                    }
+                    if (app->wal) wal_print_stats(app->wal, stdout);
+                } else if (c == 11) {
+                    uint64_t start = plat_now_ns();
+                    if (app_freeze_users(app) == 0)
+                        printf("Froze %u users in %.1f ms; the next snapshot keeps the indexes.\n", app->frozen_users,
+                               (plat_now_ns() - start) / 1e6);
+                    else
+                        puts("Freeze failed.");
                 } else {
                     puts("Unknown choice.");
                 }
@@ -203,6 +472,7 @@ static void menu_loop(app_state_t *app) {
                 puts("4) Cast vote");
                 puts("5) Logout");
                 puts("0) Back");
+                cli_tick(app);
                 printf("Choose: ");
                 char vline[16]; read_line(vline, sizeof(vline));
                 int vc = atoi(vline);
@@ -229,16 +499,12 @@ static void menu_loop(app_state_t *app) {
                 } else if (vc == 4) {
                     uint64_t eid;
                     if (prompt_uint64("Election ID", &eid) != 0) { puts("bad id"); continue; }
-                    election_rec_t *el = NULL;
-                    for (list_node_t *n = app->elections.head; n; n = n->next) {
-                        election_rec_t *cand = (election_rec_t *)n->data;
-                        if (cand->id == eid) { el = cand; break; }
-                    }
+                    const election_rec_t *el = app_find_election(app, eid);
                     if (!el) { puts("Election not found."); continue; }
                     if (el->phase != VOTING_OPEN) { puts("Voting not open."); continue; }
                     puts("Candidates:");
                     for (uint32_t i = 0; i < el->candidate_count; i++) {
-                        printf("  [%u] %s\n", i, el->candidates[i]);
+                        printf("  [%u] %s\n", i, app_election_candidate(app, el, i));
                     }
                     uint32_t pick;
                     if (prompt_uint32("Choice index", &pick) != 0) { puts("bad choice"); continue; }
@@ -259,20 +525,363 @@ static void menu_loop(app_state_t *app) {
     }
 }
 
-int cli_run(int argc, char **argv) {
-    (void)argc; (void)argv;
-    app_state_t app;
-    if (app_init(&app) != 0) {
+static void reader_show_results(const shm_view_t *view, uint64_t eid) {
+    uint32_t slot;
+    const election_rec_t *el = shm_view_find_election(view, eid, &slot);
+    if (!el) {
+        puts("Election not found.");
+        return;
+    }
+    const shm_result_t *r = shm_view_result(view, slot);
+    const uint64_t *counts = shm_view_counts(view, r);
+    printf("Results for election %" PRIu64 " (%s), %" PRIu64 " votes:\n", el->id, el->title, r->total_votes);
+    for (uint32_t i = 0; i < el->candidate_count; i++) {
+        printf("  [%u] %-20s : %" PRIu64 "\n", i, shm_view_candidate(view, el, i), counts[i]);
+    }
+    if (r->winner != SHM_NO_WINNER) {
+        printf("Leading: [%u] %s\n", r->winner, shm_view_candidate(view, el, r->winner));
+    }
+}
+
+/* Read-only process serving listings and results from the shared snapshot
+ * published by a writer; never touches data/ or takes locks. */
+static int reader_loop(const char *path) {
+    shm_view_t view;
+    if (shm_view_open(&view, path) != 0) {
+        fprintf(stderr, "No shared snapshot at %s (start the writer with ONLINEVOTE_SHM=%s)\n", path, path);
+        return -1;
+    }
+    for (;;) {
+        printf("\n-- READER (generation %" PRIu64 ") --\n", view.hdr->generation);
+        puts("1) List elections");
+        puts("2) Show results");
+        puts("3) Snapshot info");
+        puts("0) Exit");
+        printf("Choose: ");
+        char line[16]; read_line(line, sizeof(line));
+        int c = atoi(line);
+        if (c == 0) break;
+        /* Pick up the newest generation before serving each request. */
+        int r = shm_view_refresh(&view);
+        if (r == 1) {
+            printf("Switched to generation %" PRIu64 ".\n", view.hdr->generation);
+        } else if (r < 0) {
+            printf("Snapshot refresh failed; still serving generation %" PRIu64 ".\n", view.hdr->generation);
+        }
+        if (c == 1) {
+            puts("Elections:");
+            for (uint32_t i = 0; i < view.hdr->election_count; i++) {
+                const election_rec_t *el = shm_view_election(&view, i);
+                printf("  ID=%" PRIu64 " title=%s phase=%d candidates=%u votes=%" PRIu64 "\n",
+                       el->id, el->title, el->phase, el->candidate_count, shm_view_result(&view, i)->total_votes);
+            }
+        } else if (c == 2) {
+            uint64_t eid;
+            if (prompt_uint64("Election ID", &eid) == 0) reader_show_results(&view, eid);
+            else puts("bad id");
+        } else if (c == 3) {
+            const shm_header_t *h = view.hdr;
+            uint64_t now = plat_wall_us();
+            printf("generation=%" PRIu64 " change_seq=%" PRIu64 " writer_pid=%" PRIu64 " age=%.3fs bytes=%" PRIu64 "\n",
+                   h->generation, h->change_seq, h->writer_pid,
+                   now > h->published_at_us ? (now - h->published_at_us) / 1e6 : 0.0, h->total_size);
+            printf("users=%" PRIu64 " elections=%" PRIu64 " votes=%" PRIu64 "\n",
+                   h->user_count, h->election_count, h->vote_count);
+        } else {
+            puts("Unknown choice.");
+        }
+    }
+    shm_view_close(&view);
+    return 0;
+}
+
+/* Read-only replica of the primary whose data directory is shared; a
+ * background thread keeps applying the primary's WAL. */
+static int follow_loop(const char *dir) {
+    follower_t *f = (follower_t *)mem_alloc(MEM_TAG_MISC, sizeof(follower_t));
+    if (!f || follower_start(f, dir, 100) != 0) {
+        mem_free(f);
+        fprintf(stderr, "Could not start follower on %s\n", dir);
+        return -1;
+    }
+    for (;;) {
+        follower_status_t st;
+        follower_get_status(f, &st);
+        printf("\n-- FOLLOWER (read-only, LSN %" PRIu64 ") --\n", st.applied_lsn);
+        puts("1) List elections");
+        puts("2) Tally election");
+        puts("3) Replication status");
+        puts("0) Exit");
+        printf("Choose: ");
+        char line[16]; read_line(line, sizeof(line));
+        int c = atoi(line);
+        if (c == 0) break;
+        if (c == 1) {
+            plat_mutex_lock(&f->lock);
+            app_list_elections(&f->app);
+            plat_mutex_unlock(&f->lock);
+        } else if (c == 2) {
+            uint64_t eid;
+            if (prompt_uint64("Election ID", &eid) != 0) { puts("bad id"); continue; }
+            plat_mutex_lock(&f->lock);
+            if (app_tally(&f->app, eid) != 0) puts("Tally failed.");
+            plat_mutex_unlock(&f->lock);
+        } else if (c == 3) {
+            follower_get_status(f, &st);
+            uint64_t now = plat_wall_us();
+            printf("applied_lsn=%" PRIu64 " applied_records=%" PRIu64 " state=%s\n", st.applied_lsn,
+                   st.applied_records, follower_state_name(st.state));
+            if (st.state != FOLLOWER_STREAMING) {
+                printf("stalled at LSN %" PRIu64 "; restart the follower to continue\n", st.stalled_lsn);
+            }
+            if (st.last_commit_us) {
+                printf("last record committed %" PRIu64 " ms ago, applied %" PRIu64 " ms after commit\n",
+                       (now - st.last_commit_us) / 1000, st.last_apply_delay_us / 1000);
+            }
+            printf("last poll %" PRIu64 " ms ago\n", (now - st.last_poll_us) / 1000);
+        } else {
+            puts("Unknown choice.");
+        }
+    }
+    follower_stop(f);
+    mem_free(f);
+    return 0;
+}
+
+/* Loads data/ from the binary snapshot, or from the CSV files when none
+ * was ever saved; on failure app is left freed. */
+static int load_data(app_state_t *app) {
+    if (app_init(app) != 0) {
         fprintf(stderr, "init failed\n");
         return -1;
     }
-    app_load_from_disk(&app, "data");
+    int rc = app_load(app, "data");
+    if (rc == 0) return 0;
+    app_free(app);
+    if (rc < 0) {
+        /* The CSVs may be older than the snapshot; loading them would
+         * silently lose whatever it held. */
+        fprintf(stderr, "Refusing to start: data/MANIFEST names a snapshot that cannot be loaded\n");
+        return -1;
+    }
+    if (app_init(app) != 0) return -1;
+    if (app_load_from_disk(app, "data") != 0) {
+        fprintf(stderr, "Refusing to start: data files fail their checksums or cannot be indexed\n");
+        app_free(app);
+        return -1;
+    }
+    return 0;
+}
+
+/* onlinevote merge <out> <segment>...: merges columnar exports, each in vote
+ * id order (one per machine, say), into one segment in a single pass. */
+static int merge_command(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: onlinevote merge <out> <segment>...\n");
+        return 1;
+    }
+    vote_seg_merge_stats_t st;
+    uint64_t start = plat_now_ns();
+    if (export_merge_segments((const char *const *)argv + 3, (size_t)(argc - 3), argv[2], &st) != 0) {
+        fprintf(stderr, "Merge failed\n");
+        return 1;
+    }
+    printf("Merged %d segments: %" PRIu64 " votes in, %" PRIu64 " written, %" PRIu64 " duplicates, %" PRIu64
+           " bytes in %.1f ms\n",
+           argc - 3, st.votes_in, st.votes_out, st.duplicates, st.bytes, (plat_now_ns() - start) / 1e6);
+    return 0;
+}
+
+/* onlinevote compact <dir> [MB/s]: merges every segment in a segment
+ * directory into one, dropping superseded votes, unthrottled unless a
+ * budget is given. */
+static int compact_command(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: onlinevote compact <dir> [MB/s]\n");
+        return 1;
+    }
+    compact_options_t opts;
+    compact_options_init(&opts);
+    if (argc >= 4) opts.budget_bytes_per_sec = strtoull(argv[3], NULL, 10) << 20;
+    compact_stats_t st;
+    memset(&st, 0, sizeof(st));
+    uint64_t start = plat_now_ns();
+    int rc = compact_dir(argv[2], &opts, NULL, &st);
+    compact_print_stats(&st, stdout);
+    printf("Done in %.1f ms\n", (plat_now_ns() - start) / 1e6);
+    if (rc != 0) {
+        fprintf(stderr, "Compaction of %s failed\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
+
+/* onlinevote import voters|ballots <file.csv>: bulk-loads rows into data/
+ * and writes a new snapshot generation and CSV set. Imported rows are not
+ * WAL-logged, so the primary must not be running. */
+static int import_command(int argc, char **argv) {
+    import_kind_t kind;
+    if (argc < 4 || import_kind_from_name(argv[2], &kind) != 0) {
+        fprintf(stderr, "usage: onlinevote import voters|ballots <file.csv>\n"
+                        "  voters:  name,email,password[,groups]\n"
+                        "  ballots: election_id,voter_id,choice\n");
+        return 1;
+    }
+    app_state_t app;
+    if (load_data(&app) != 0) return 1;
+    if (app_wal_replay(&app, "data/wal", NULL) != 0) {
+        fprintf(stderr, "Refusing to import: data/wal cannot be replayed\n");
+        app_free(&app);
+        return 1;
+    }
+    import_stats_t st;
+    int rc = app_import_csv(&app, kind, argv[3], &st);
+    if (rc != 0) {
+        fprintf(stderr, "Import of %s failed; nothing was saved\n", argv[3]);
+        app_free(&app);
+        return 1;
+    }
+    printf("Read %" PRIu64 " rows on %u threads: %" PRIu64 " imported, %" PRIu64 " duplicates, %" PRIu64 " rejected\n",
+           st.rows, st.threads, st.imported, st.duplicates, st.rejected);
+    if (st.first_bad_line) printf("First rejected row is on line %" PRIu64 "\n", st.first_bad_line);
+    printf("Parse %.1f ms, index %.1f ms, fill %.1f ms\n", st.parse_ns / 1e6, st.index_ns / 1e6, st.fill_ns / 1e6);
+    /* A voter roll is read-mostly once loaded. */
+    if (st.imported && kind == IMPORT_VOTERS) {
+        uint64_t start = plat_now_ns();
+        if (app_freeze_users(&app) == 0) printf("Froze user indexes in %.1f ms\n", (plat_now_ns() - start) / 1e6);
+    }
+    if (st.imported) {
+        uint64_t start = plat_now_ns();
+        if (app_save(&app, "data") != 0 || app_save_to_disk(&app, "data") != 0) {
+            fprintf(stderr, "Could not save data\n");
+            rc = 1;
+        } else {
+            printf("Saved in %.1f ms\n", (plat_now_ns() - start) / 1e6);
+        }
+    }
+    app_free(&app);
+    return rc;
+}
+
+/* onlinevote export [csv|jsonl|columnar] [election id] [path | -] [vote ids]:
+ * loads the data directory the way a follower does (snapshot plus WAL, read
+ * only), so it can run beside a live primary. "-" writes to stdout; vote
+ * ids is a range such as 1000-1999. */
+static int export_command(int argc, char **argv) {
+    export_format_t format;
+    export_options_t opts;
+    int ok = export_format_from_name(argc >= 3 ? argv[2] : NULL, &format) == 0;
+    if (ok) {
+        export_options_init(&opts, format);
+        ok = export_parse_id_range(argc >= 6 ? argv[5] : NULL, &opts) == 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "usage: onlinevote export [csv|jsonl|columnar] [election id] [path|-] [first-last vote id]\n");
+        return 1;
+    }
+    opts.data_dir = "data";
+    if (argc >= 4) opts.election_id = strtoull(argv[3], NULL, 10);
+    const char *path = argc >= 5 ? argv[4] : "-";
+    follower_t *f = (follower_t *)mem_alloc(MEM_TAG_MISC, sizeof(follower_t));
+    if (!f || follower_start(f, "data", 100) != 0) {
+        mem_free(f);
+        fprintf(stderr, "Could not load data\n");
+        return 1;
+    }
+    export_stats_t st;
+    plat_mutex_lock(&f->lock);
+    int rc = strcmp(path, "-") == 0 ? app_export_votes(&f->app, &opts, 1, &st)
+                                     : app_export_votes_to_path(&f->app, &opts, path, &st);
+    plat_mutex_unlock(&f->lock);
+    follower_stop(f);
+    mem_free(f);
+    if (rc != 0) {
+        fprintf(stderr, "Export failed\n");
+        return 1;
+    }
+    print_export_stats(stderr, &opts, &st);
+    return 0;
+}
+
+int cli_run(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "reader") == 0) {
+        const char *path = argc >= 3 ? argv[2] : getenv("ONLINEVOTE_SHM");
+        return reader_loop(path && *path ? path : SHM_DEFAULT_PATH);
+    }
+    if (argc >= 2 && strcmp(argv[1], "follow") == 0) {
+        trace_init_from_env();
+        int rc = follow_loop(argc >= 3 ? argv[2] : "data");
+        trace_shutdown();
+        return rc;
+    }
+    if (argc >= 2 && strcmp(argv[1], "import") == 0) {
+        trace_init_from_env();
+        int rc = import_command(argc, argv);
+        trace_shutdown();
+        return rc;
+    }
+    if (argc >= 2 && strcmp(argv[1], "export") == 0) {
+        trace_init_from_env();
+        int rc = export_command(argc, argv);
+        trace_shutdown();
+        return rc;
+    }
+    if (argc >= 2 && strcmp(argv[1], "merge") == 0) {
+        trace_init_from_env();
+        int rc = merge_command(argc, argv);
+        trace_shutdown();
+        return rc;
+    }
+    if (argc >= 2 && strcmp(argv[1], "compact") == 0) {
+        trace_init_from_env();
+        int rc = compact_command(argc, argv);
+        trace_shutdown();
+        return rc;
+    }
+    if (argc >= 2 && strcmp(argv[1], "crash-test") == 0) {
+        unsigned rounds = argc >= 3 ? (unsigned)strtoul(argv[2], NULL, 10) : 20;
+        return app_crash_harness(argc >= 4 ? argv[3] : "data/crash-test", rounds, stdout);
+    }
+    trace_init_from_env();
+    publisher_init();
+    const char *secs = getenv("ONLINEVOTE_SNAPSHOT_SECS");
+    bgsave_init(&bgsave, "data", secs ? (unsigned)strtoul(secs, NULL, 10) : 60);
+    app_state_t app;
+    trace_begin("cli.load");
+    if (load_data(&app) != 0) {
+        trace_end("cli.load");
+        trace_shutdown();
+        return 1;
+    }
+    wal_options_t wal_opts;
+    wal_opts.engine = aio_kind_from_name(getenv("ONLINEVOTE_AIO"));
+    const char *direct = getenv("ONLINEVOTE_WAL_DIRECT");
+    wal_opts.direct = direct && strcmp(direct, "1") == 0;
+    if (app_wal_open(&app, "data/wal", &wal_opts) != 0) {
+        fprintf(stderr, "Refusing to start: data/wal cannot be replayed or opened\n");
+        trace_end("cli.load");
+        app_free(&app);
+        trace_shutdown();
+        return 1;
+    }
     if (!app.admin_exists) {
         app_register_user(&app, "admin", "admin@example.com", "admin", ROLE_ADMIN);
     }
+    trace_end("cli.load");
+    publish_shm(&app, 1);
+    app.on_commit = publish_after_commit;
+    compactor_init_from_env();
+    trace_begin("cli.menu");
     menu_loop(&app);
+    trace_end("cli.menu");
+    if (compactor_running) compactor_stop(&compactor);
+    publish_shm(&app, 1);
+    trace_begin("cli.save");
     app_save_to_disk(&app, "data");
+    bgsave_finish(&bgsave, &app);
+    trace_end("cli.save");
     app_free(&app);
+    trace_shutdown();
     return 0;
 }
 
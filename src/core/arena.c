@@ -0,0 +1,54 @@
+#include "arena.h"
+#include <string.h>
+
+int arena_init(arena_t *a, size_t elem_size, size_t initial_capacity, mem_tag_t tag) {
+    a->data = NULL;
+    a->elem_size = elem_size;
+    a->count = 0;
+    a->capacity = 0;
+    a->tag = tag;
+    return arena_reserve(a, initial_capacity ? initial_capacity : 16);
+}
+
+void arena_free(arena_t *a) {
+    mem_free(a->data);
+    a->data = NULL;
+    a->count = 0;
+    a->capacity = 0;
+}
+
+int arena_reserve(arena_t *a, size_t capacity) {
+    if (capacity <= a->capacity) return 0;
+    if (capacity > UINT32_MAX || capacity > SIZE_MAX / a->elem_size) return -1;
+    uint8_t *data = (uint8_t *)mem_realloc(a->tag, a->data, capacity * a->elem_size);
+    if (!data) return -1;
+    a->data = data;
+    a->capacity = (uint32_t)capacity;
+    return 0;
+}
+
+int arena_reserve_more(arena_t *a, size_t n) {
+    if (n > UINT32_MAX - a->count) return -1;
+    size_t need = (size_t)a->count + n;
+    if (need <= a->capacity) return 0;
+    size_t cap = a->capacity ? (size_t)a->capacity * 2 : 16;
+    while (cap < need) cap *= 2;
+    if (cap > UINT32_MAX) cap = UINT32_MAX;
+    return arena_reserve(a, cap);
+}
+
+int arena_push(arena_t *a, const void *elem, uint32_t *out_index) {
+    if (arena_reserve_more(a, 1) != 0) return -1;
+    memcpy(a->data + (size_t)a->count * a->elem_size, elem, a->elem_size);
+    if (out_index) *out_index = a->count;
+    a->count++;
+    return 0;
+}
+
+void arena_pop(arena_t *a) {
+    if (a->count) a->count--;
+}
+
+void *arena_at(const arena_t *a, uint32_t index) {
+    return index < a->count ? a->data + (size_t)index * a->elem_size : NULL;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "mem.h"
+
+/* Dense, growable array of fixed-size records addressed by 32-bit index.
+ * Records may move when the arena grows, so callers keep indices rather
+ * than pointers; arena_at pointers are valid only until the next push. */
+
+typedef struct {
+    uint8_t *data;
+    size_t elem_size;
+    uint32_t count;
+    uint32_t capacity;
+    mem_tag_t tag;
+} arena_t;
+
+int arena_init(arena_t *a, size_t elem_size, size_t initial_capacity, mem_tag_t tag);
+void arena_free(arena_t *a);
+int arena_reserve(arena_t *a, size_t capacity);
+/* Makes room for n more records, growing geometrically; arena_push cannot
+ * fail for the next n records after it succeeds. */
+int arena_reserve_more(arena_t *a, size_t n);
+int arena_push(arena_t *a, const void *elem, uint32_t *out_index);
+/* Drops the last record, undoing an arena_push. */
+void arena_pop(arena_t *a);
+void *arena_at(const arena_t *a, uint32_t index);
@@ -0,0 +1,65 @@
+#include "bloom.h"
+#include "mem.h"
+#include <string.h>
+
+#define BLOOM_WORDS 8u
+#define BLOOM_ALIGN 64u
+
+/* Odd multipliers, one per word; the top 6 bits of key * salt pick the bit. */
+static const uint32_t bloom_salt[BLOOM_WORDS] = {0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+                                                 0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* The high half picks the block (multiply-shift, so any block count
+ * works); the low half feeds the bit positions. */
+static uint64_t *block_of(const bloom_t *b, uint64_t h) {
+    return b->blocks + ((h >> 32) * b->block_count >> 32) * BLOOM_WORDS;
+}
+
+static void block_mask(uint32_t key, uint64_t mask[BLOOM_WORDS]) {
+    for (unsigned i = 0; i < BLOOM_WORDS; i++) mask[i] = (uint64_t)1 << ((key * bloom_salt[i]) >> 26);
+}
+
+int bloom_init(bloom_t *b, size_t capacity) {
+    memset(b, 0, sizeof(*b));
+    uint64_t blocks = ((uint64_t)capacity * BLOOM_BITS_PER_KEY + 511) / 512;
+    if (blocks == 0) blocks = 1;
+    if (blocks > UINT32_MAX) return -1;
+    uint8_t *raw = (uint8_t *)mem_calloc(MEM_TAG_INDEX, 1, (size_t)blocks * BLOOM_ALIGN + BLOOM_ALIGN);
+    if (!raw) return -1;
+    b->blocks = (uint64_t *)(void *)(raw + (BLOOM_ALIGN - (uintptr_t)raw % BLOOM_ALIGN) % BLOOM_ALIGN);
+    b->block_count = blocks;
+    b->capacity = capacity;
+    b->owned = raw;
+    return 0;
+}
+
+void bloom_free(bloom_t *b) {
+    mem_free(b->owned);
+    memset(b, 0, sizeof(*b));
+}
+
+void bloom_add(bloom_t *b, uint64_t hash) {
+    uint64_t h = mix64(hash), mask[BLOOM_WORDS];
+    uint64_t *block = block_of(b, h);
+    block_mask((uint32_t)h, mask);
+    for (unsigned i = 0; i < BLOOM_WORDS; i++) block[i] |= mask[i];
+    b->count++;
+}
+
+int bloom_may_contain(const bloom_t *b, uint64_t hash) {
+    if (b->block_count == 0) return 0;
+    uint64_t h = mix64(hash), mask[BLOOM_WORDS], missing = 0;
+    const uint64_t *block = block_of(b, h);
+    block_mask((uint32_t)h, mask);
+    for (unsigned i = 0; i < BLOOM_WORDS; i++) missing |= mask[i] & ~block[i];
+    return missing == 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* Blocked Bloom filter over 64-bit hashes, for "definitely absent" answers
+ * in front of a larger index. The bit array is cut into 64-byte blocks of
+ * eight 64-bit words; a key picks one block and sets one bit in each of its
+ * words, so an add or a query touches a single cache line, and the eight
+ * bit positions come from eight independent multiplies that compilers turn
+ * into vector code. At BLOOM_BITS_PER_KEY bits per key about 0.1% of absent
+ * keys pass. Keys cannot be removed. Queries on a zeroed bloom_t miss;
+ * adds need one from bloom_init. */
+
+#define BLOOM_BITS_PER_KEY 16u
+
+typedef struct {
+    uint64_t *blocks; /* block_count * 8 words, 64-byte aligned */
+    uint64_t block_count;
+    uint64_t count;    /* keys added */
+    uint64_t capacity; /* keys it was sized for */
+    void *owned;
+} bloom_t;
+
+int bloom_init(bloom_t *b, size_t capacity);
+void bloom_free(bloom_t *b);
+void bloom_add(bloom_t *b, uint64_t hash);
+/* 0 when hash was never added; 1 when it may have been. */
+int bloom_may_contain(const bloom_t *b, uint64_t hash);
@@ -1,9 +1,9 @@
 #include "bst.h"
-#include <stdlib.h>
+#include "mem.h"
 
 bst_node_t *bst_insert(bst_node_t *root, uint64_t key, uint64_t value) {
     if (!root) {
-        bst_node_t *node = (bst_node_t *)malloc(sizeof(bst_node_t));
+        bst_node_t *node = (bst_node_t *)mem_alloc(MEM_TAG_INDEX, sizeof(bst_node_t));
         if (!node) {
             return NULL;
         }
@@ -54,6 +54,6 @@ void bst_free(bst_node_t *root) {
     }
     bst_free(root->left);
     bst_free(root->right);
-    free(root);
+    mem_free(root);
 }
 
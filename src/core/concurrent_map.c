@@ -0,0 +1,266 @@
+#include "concurrent_map.h"
+#include "mem.h"
+#include "platform.h"
+
+/* Bucket states. A bucket moves forward only:
+ *   EMPTY -> CLAIMED -> FULL -> DELETED
+ *   EMPTY -> SEALED                  (resize: nothing to copy)
+ *   FULL  -> MOVING -> MOVED         (resize: copied to the successor)
+ * key and value are written while CLAIMED and read only after FULL is seen,
+ * and they stay valid through MOVING and MOVED, so readers never wait on a
+ * resize. SEALED ends a probe: the key can only be in the successor. */
+enum { B_EMPTY = 0, B_CLAIMED, B_FULL, B_DELETED, B_SEALED, B_MOVING, B_MOVED };
+
+/* Buckets a helper copies per claim during a resize. */
+#define MIGRATE_CHUNK 1024u
+
+/* Table insert results besides 1 (inserted) and 0 (present). */
+#define RETRY_NEXT 2 /* the table is being replaced; help, then retry */
+#define TABLE_FULL 3
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Power of two keeping count entries under the 0.7 load factor. */
+static uint64_t capacity_for(uint64_t count) {
+    uint64_t need = count + count / 2 + 2, n = 16;
+    while (n < need) {
+        n <<= 1;
+    }
+    return n;
+}
+
+static concurrent_table_t *table_new(uint64_t capacity) {
+    concurrent_table_t *t = (concurrent_table_t *)mem_calloc(MEM_TAG_INDEX, 1, sizeof(*t));
+    if (!t) return NULL;
+    t->buckets = (concurrent_bucket_t *)mem_calloc(MEM_TAG_INDEX, (size_t)capacity, sizeof(concurrent_bucket_t));
+    if (!t->buckets) {
+        mem_free(t);
+        return NULL;
+    }
+    t->capacity = capacity;
+    return t;
+}
+
+static void table_free(concurrent_table_t *t) {
+    mem_free(t->buckets);
+    mem_free(t);
+}
+
+static concurrent_table_t *load_table(concurrent_table_t *const *p) {
+    return (concurrent_table_t *)plat_atomic_load_ptr((void *volatile *)p);
+}
+
+static uint32_t load_state(concurrent_bucket_t *b) {
+    uint32_t s;
+    while ((s = plat_atomic_load_u32(&b->state)) == B_CLAIMED) {
+        plat_yield(); /* the claimer is between two stores */
+    }
+    return s;
+}
+
+static int holds_key(uint32_t s) {
+    return s == B_FULL || s == B_MOVING || s == B_MOVED;
+}
+
+/* 1 inserted (*used is the table's new claim count), 0 present. */
+static int table_insert(concurrent_table_t *t, uint64_t key, uint32_t value, uint32_t *existing, uint64_t *used) {
+    uint64_t mask = t->capacity - 1, idx = mix64(key) & mask;
+    for (uint64_t n = 0; n < t->capacity; n++, idx = (idx + 1) & mask) {
+        concurrent_bucket_t *b = &t->buckets[idx];
+        if (plat_atomic_load_u32(&b->state) == B_EMPTY && plat_atomic_cas_u32(&b->state, B_EMPTY, B_CLAIMED)) {
+            b->key = key;
+            b->value = value;
+            plat_atomic_store_u32(&b->state, B_FULL);
+            uint64_t n_used = plat_atomic_add_u64(&t->used, 1);
+            if (used) *used = n_used;
+            return 1;
+        }
+        uint32_t s = load_state(b);
+        if (s == B_SEALED) return RETRY_NEXT;
+        if (holds_key(s) && b->key == key) {
+            if (existing) *existing = b->value;
+            return 0;
+        }
+    }
+    return TABLE_FULL;
+}
+
+/* The successor never has fewer buckets than t (see start_resize), so a
+ * move always finds an empty bucket, and keys are unique, so it always
+ * inserts. */
+static void migrate_bucket(concurrent_table_t *next, concurrent_bucket_t *b) {
+    for (;;) {
+        uint32_t s = load_state(b);
+        if (s == B_EMPTY) {
+            if (plat_atomic_cas_u32(&b->state, B_EMPTY, B_SEALED)) return;
+        } else if (s == B_FULL) {
+            if (plat_atomic_cas_u32(&b->state, B_FULL, B_MOVING)) {
+                table_insert(next, b->key, b->value, NULL, NULL);
+                plat_atomic_store_u32(&b->state, B_MOVED);
+                return;
+            }
+        } else {
+            return; /* deleted entries are dropped */
+        }
+    }
+}
+
+/* Copies chunks of t into its successor until none are left, waits for
+ * other helpers to finish theirs, then makes the successor current. */
+static void help_migrate(concurrent_map_t *m, concurrent_table_t *t) {
+    concurrent_table_t *next = load_table(&t->next);
+    for (;;) {
+        uint64_t end = plat_atomic_add_u64(&t->migrate_pos, MIGRATE_CHUNK);
+        uint64_t start = end - MIGRATE_CHUNK;
+        if (start >= t->capacity) break;
+        if (end > t->capacity) end = t->capacity;
+        for (uint64_t i = start; i < end; i++) migrate_bucket(next, &t->buckets[i]);
+        plat_atomic_add_u64(&t->migrated, end - start);
+    }
+    while (plat_atomic_load_u64(&t->migrated) < t->capacity) {
+        plat_yield();
+    }
+    plat_atomic_cas_ptr((void *volatile *)&m->table, t, next);
+}
+
+/* Publishes a successor of capacity buckets unless one exists already.
+ * Writers keep filling t until its buckets are sealed, so the successor is
+ * given at least t's capacity: everything t can hold then fits. -1 only
+ * when none exists afterwards (out of memory). */
+static int start_resize(concurrent_table_t *t, uint64_t capacity) {
+    if (load_table(&t->next)) return 0;
+    concurrent_table_t *next = table_new(capacity > t->capacity ? capacity : t->capacity);
+    if (!next) return -1;
+    if (!plat_atomic_cas_ptr((void *volatile *)&t->next, NULL, next)) table_free(next);
+    return 0;
+}
+
+/* Current table with no resize pending, helping any that is. */
+static concurrent_table_t *writable_table(concurrent_map_t *m) {
+    for (;;) {
+        concurrent_table_t *t = load_table(&m->table);
+        if (!load_table(&t->next)) return t;
+        help_migrate(m, t);
+    }
+}
+
+static uint64_t live(concurrent_table_t *t) {
+    return plat_atomic_load_u64(&t->used) - plat_atomic_load_u64(&t->removed);
+}
+
+int concurrent_map_init(concurrent_map_t *m, size_t capacity) {
+    m->table = table_new(capacity_for(capacity));
+    m->first = m->table;
+    return m->table ? 0 : -1;
+}
+
+void concurrent_map_free(concurrent_map_t *m) {
+    concurrent_table_t *t = m->first;
+    while (t) {
+        concurrent_table_t *next = t->next;
+        table_free(t);
+        t = next;
+    }
+    m->table = NULL;
+    m->first = NULL;
+}
+
+int concurrent_map_insert_if_absent(concurrent_map_t *m, uint64_t key, uint32_t value, uint32_t *existing) {
+    for (;;) {
+        concurrent_table_t *t = writable_table(m);
+        uint64_t used;
+        int rc = table_insert(t, key, value, existing, &used);
+        if (rc == 0) return 0;
+        if (rc == 1) {
+            if (used * 10 >= t->capacity * 7 && start_resize(t, capacity_for(live(t))) == 0) help_migrate(m, t);
+            return 1;
+        }
+        if (rc == TABLE_FULL && start_resize(t, capacity_for(live(t))) != 0) return -1;
+    }
+}
+
+int concurrent_map_get(const concurrent_map_t *m, uint64_t key, uint32_t *out_value) {
+    concurrent_table_t *t = load_table(&m->table);
+    for (;;) {
+        uint64_t mask = t->capacity - 1, idx = mix64(key) & mask;
+        concurrent_table_t *next = NULL;
+        for (uint64_t n = 0; n < t->capacity; n++, idx = (idx + 1) & mask) {
+            concurrent_bucket_t *b = &t->buckets[idx];
+            uint32_t s = load_state(b);
+            if (s == B_EMPTY) return -1;
+            if (s == B_SEALED) {
+                /* Until the resize is done nothing is inserted past here. */
+                if (plat_atomic_load_u64(&t->migrated) < t->capacity) return -1;
+                next = load_table(&t->next);
+                break;
+            }
+            if (holds_key(s) && b->key == key) {
+                if (out_value) *out_value = b->value;
+                return 0;
+            }
+        }
+        if (!next) return -1;
+        t = next;
+    }
+}
+
+int concurrent_map_remove(concurrent_map_t *m, uint64_t key) {
+    for (;;) {
+        concurrent_table_t *t = writable_table(m);
+        uint64_t mask = t->capacity - 1, idx = mix64(key) & mask;
+        int retry = 0;
+        for (uint64_t n = 0; n < t->capacity && !retry; n++, idx = (idx + 1) & mask) {
+            concurrent_bucket_t *b = &t->buckets[idx];
+            uint32_t s = load_state(b);
+            if (s == B_EMPTY) return -1;
+            if (s == B_SEALED || ((s == B_MOVING || s == B_MOVED) && b->key == key)) {
+                retry = 1;
+            } else if (s == B_FULL && b->key == key) {
+                if (plat_atomic_cas_u32(&b->state, B_FULL, B_DELETED)) {
+                    plat_atomic_add_u64(&t->removed, 1);
+                    return 0;
+                }
+                retry = 1; /* a resize froze it first */
+            }
+        }
+        if (!retry) return -1;
+    }
+}
+
+int concurrent_map_reserve(concurrent_map_t *m, size_t count) {
+    uint64_t capacity = capacity_for(count);
+    for (;;) {
+        concurrent_table_t *t = writable_table(m);
+        if (t->capacity >= capacity) return 0;
+        if (start_resize(t, capacity) != 0) return -1;
+        help_migrate(m, t);
+    }
+}
+
+void concurrent_map_prefetch(const concurrent_map_t *m, uint64_t key) {
+    concurrent_table_t *t = load_table(&m->table);
+    PLAT_PREFETCH(&t->buckets[mix64(key) & (t->capacity - 1)]);
+}
+
+size_t concurrent_map_size(const concurrent_map_t *m) {
+    return (size_t)live(load_table(&m->table));
+}
+
+size_t concurrent_map_capacity(const concurrent_map_t *m) {
+    return (size_t)load_table(&m->table)->capacity;
+}
+
+void concurrent_map_reclaim(concurrent_map_t *m) {
+    while (m->first != m->table) {
+        concurrent_table_t *next = m->first->next;
+        table_free(m->first);
+        m->first = next;
+    }
+}
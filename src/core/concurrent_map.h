@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hash map from 64-bit keys to 32-bit values that many threads can use at
+ * once without a lock. Open addressing with linear probing, as in
+ * hash_table_t, but every bucket carries a state word changed only by
+ * compare-and-swap:
+ *  - insert_if_absent claims an empty bucket in one CAS, so of several
+ *    threads inserting the same key exactly one sees "inserted";
+ *  - get never writes and never waits on other readers or on a resize;
+ *  - a table past its load factor publishes a larger successor, and every
+ *    writer that notices helps copy buckets over in chunks before carrying
+ *    on in the new table.
+ * Values are fixed at insert. Tables replaced by a resize stay allocated
+ * (readers may still be in them) until concurrent_map_reclaim at a point
+ * where no other thread is using the map, or concurrent_map_free. */
+
+typedef struct {
+    uint64_t key;
+    uint32_t value;
+    uint32_t state;
+} concurrent_bucket_t;
+
+typedef struct concurrent_table {
+    concurrent_bucket_t *buckets;
+    uint64_t capacity;
+    uint64_t used;                     /* buckets ever claimed, removals included */
+    uint64_t removed;                  /* live entries are used - removed */
+    struct concurrent_table *next;     /* successor being filled; NULL if none */
+    uint64_t migrate_pos;              /* next bucket handed out to a helper */
+    uint64_t migrated;                 /* buckets copied (or sealed) so far */
+} concurrent_table_t;
+
+typedef struct {
+    concurrent_table_t *table; /* current; readers start here */
+    concurrent_table_t *first; /* oldest table not yet reclaimed */
+} concurrent_map_t;
+
+/* capacity: entries to hold before the first resize. */
+int concurrent_map_init(concurrent_map_t *m, size_t capacity);
+void concurrent_map_free(concurrent_map_t *m);
+/* 1 when key was added with value, 0 when it was already there (its value
+ * through existing, may be NULL), -1 when out of memory. */
+int concurrent_map_insert_if_absent(concurrent_map_t *m, uint64_t key, uint32_t value, uint32_t *existing);
+int concurrent_map_get(const concurrent_map_t *m, uint64_t key, uint32_t *out_value);
+/* 0 when key was removed, -1 when absent. */
+int concurrent_map_remove(concurrent_map_t *m, uint64_t key);
+/* Grows so count entries fit without further resizing. */
+int concurrent_map_reserve(concurrent_map_t *m, size_t count);
+/* Starts loading key's home bucket; issue it some keys ahead of the calls
+ * that will use them when the map is bigger than cache. */
+void concurrent_map_prefetch(const concurrent_map_t *m, uint64_t key);
+size_t concurrent_map_size(const concurrent_map_t *m);
+size_t concurrent_map_capacity(const concurrent_map_t *m);
+/* Frees tables left behind by resizes. No other thread may be using m. */
+void concurrent_map_reclaim(concurrent_map_t *m);
@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC32C (Castagnoli), the checksum every persisted file and WAL record
+ * carries. Uses the SSE4.2 / ARMv8 crc32c instructions when the CPU has
+ * them and a table otherwise; both give the same values. Chains like
+ * zlib's crc32: start with 0 and pass the previous result to continue. */
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+int crc32c_hardware(void); /* 1 when the instruction path is in use */
@@ -0,0 +1,110 @@
+#include "eytzinger.h"
+#include "mem.h"
+#include "platform.h"
+#include <string.h>
+
+/* Keys per 64-byte line. With keys 64-byte aligned, the descendants of k
+ * three levels down, keys[8k..8k + 7], share one line. */
+#define EYTZ_LINE 8u
+#define EYTZ_ALIGN 64u
+
+static unsigned trailing_zeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* In-order walk of the implicit tree: node k takes the next sorted key
+ * after its left subtree. The depth is log2(count). */
+static uint32_t fill(const uint64_t *sorted, uint32_t i, uint64_t k, uint32_t count, uint64_t *keys, uint32_t *ranks) {
+    if (k > count) return i;
+    i = fill(sorted, i, 2 * k, count, keys, ranks);
+    keys[k] = sorted[i];
+    ranks[k] = i;
+    return fill(sorted, i + 1, 2 * k + 1, count, keys, ranks);
+}
+
+void eytzinger_layout(const uint64_t *sorted, uint32_t count, uint64_t *keys, uint32_t *ranks) {
+    keys[0] = 0;
+    ranks[0] = 0;
+    fill(sorted, 0, 1, count, keys, ranks);
+}
+
+/* Room for both arrays, keys aligned to a cache line. */
+static int alloc_arrays(eytzinger_t *e, uint32_t count, uint64_t **keys, uint32_t **ranks) {
+    size_t key_bytes = ((size_t)count + 1) * sizeof(uint64_t);
+    uint8_t *raw = (uint8_t *)mem_alloc(MEM_TAG_INDEX, EYTZ_ALIGN + key_bytes + ((size_t)count + 1) * sizeof(uint32_t));
+    if (!raw) return -1;
+    uint8_t *base = raw + (EYTZ_ALIGN - (uintptr_t)raw % EYTZ_ALIGN) % EYTZ_ALIGN;
+    *keys = (uint64_t *)(void *)base;
+    *ranks = (uint32_t *)(void *)(base + key_bytes);
+    memset(e, 0, sizeof(*e));
+    e->keys = *keys;
+    e->ranks = *ranks;
+    e->count = count;
+    e->owned = raw;
+    return 0;
+}
+
+int eytzinger_build(eytzinger_t *e, const uint64_t *sorted, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        if (sorted[i] < sorted[i - 1]) return -1;
+    }
+    uint64_t *keys;
+    uint32_t *ranks;
+    if (alloc_arrays(e, count, &keys, &ranks) != 0) return -1;
+    eytzinger_layout(sorted, count, keys, ranks);
+    return 0;
+}
+
+int eytzinger_clone(eytzinger_t *e, const eytzinger_t *src) {
+    uint64_t *keys;
+    uint32_t *ranks;
+    uint32_t count = src->count;
+    if (alloc_arrays(e, count, &keys, &ranks) != 0) return -1;
+    if (count) {
+        memcpy(keys, src->keys, ((size_t)count + 1) * sizeof(uint64_t));
+        memcpy(ranks, src->ranks, ((size_t)count + 1) * sizeof(uint32_t));
+    }
+    return 0;
+}
+
+void eytzinger_free(eytzinger_t *e) {
+    mem_free(e->owned);
+    memset(e, 0, sizeof(*e));
+}
+
+/* The walk ends past a leaf; its path is k's bits, one per level, 1 for
+ * "went right". The answer is the last node where the walk went left,
+ * found by dropping the trailing right turns and that left turn. */
+static uint32_t rank_of(const eytzinger_t *e, uint64_t k) {
+    k >>= trailing_zeros(~k) + 1;
+    return k ? e->ranks[k] : e->count;
+}
+
+uint32_t eytzinger_lower_bound(const eytzinger_t *e, uint64_t key) {
+    const uint64_t *keys = e->keys;
+    uint64_t k = 1, n = e->count;
+    while (k <= n) {
+        if (k * EYTZ_LINE <= n) PLAT_PREFETCH(keys + k * EYTZ_LINE);
+        k = 2 * k + (keys[k] < key);
+    }
+    return rank_of(e, k);
+}
+
+uint32_t eytzinger_upper_bound(const eytzinger_t *e, uint64_t key) {
+    const uint64_t *keys = e->keys;
+    uint64_t k = 1, n = e->count;
+    while (k <= n) {
+        if (k * EYTZ_LINE <= n) PLAT_PREFETCH(keys + k * EYTZ_LINE);
+        k = 2 * k + (keys[k] <= key);
+    }
+    return rank_of(e, k);
+}
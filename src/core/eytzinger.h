@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* Static sorted index of 64-bit keys in Eytzinger (BFS) order: keys[1] is
+ * the median, and the children of keys[k] are keys[2k] and keys[2k + 1].
+ * A search walks down from the root without a data-dependent branch
+ * (k = 2k + (keys[k] < key)), and the first levels share a few cache lines,
+ * so a lookup costs about one miss per three levels instead of one per
+ * level as in a binary search over a sorted array. Each step also prefetches
+ * the line holding k's descendants three levels down.
+ *
+ * ranks[k] is the sorted position of keys[k], so searches answer with a
+ * position in the original order. A zeroed eytzinger_t is an empty index;
+ * the arrays may also point into a mapped file (owned stays NULL). */
+
+typedef struct {
+    const uint64_t *keys;  /* count + 1 entries; keys[0] unused */
+    const uint32_t *ranks; /* count + 1 entries; ranks[0] unused */
+    uint32_t count;
+    void *owned; /* allocation behind keys and ranks; NULL when borrowed */
+} eytzinger_t;
+
+/* Lays sorted[0..count) out into keys and ranks (count + 1 entries each). */
+void eytzinger_layout(const uint64_t *sorted, uint32_t count, uint64_t *keys, uint32_t *ranks);
+/* -1 when sorted is not ascending, or out of memory. */
+int eytzinger_build(eytzinger_t *e, const uint64_t *sorted, uint32_t count);
+/* Owned copy of src, which may be borrowed. */
+int eytzinger_clone(eytzinger_t *e, const eytzinger_t *src);
+void eytzinger_free(eytzinger_t *e);
+/* Sorted position of the first key >= key (lower) or > key (upper);
+ * count when there is none. */
+uint32_t eytzinger_lower_bound(const eytzinger_t *e, uint64_t key);
+uint32_t eytzinger_upper_bound(const eytzinger_t *e, uint64_t key);
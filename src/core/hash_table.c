@@ -1,5 +1,7 @@
 #include "hash_table.h"
-#include <stdlib.h>
+#include "mem.h"
+#include "platform.h"
+#include "trace.h"
 
 static uint64_t mix64(uint64_t x) {
     x ^= x >> 33;
@@ -21,49 +23,68 @@ static size_t clamp_capacity(size_t cap) {
 int hash_table_init(hash_table_t *ht, size_t capacity) {
     ht->capacity = clamp_capacity(capacity ? capacity : 8);
     ht->size = 0;
-    ht->buckets = (hash_bucket_t *)calloc(ht->capacity, sizeof(hash_bucket_t));
+    ht->buckets = (hash_bucket_t *)mem_calloc(MEM_TAG_INDEX, ht->capacity, sizeof(hash_bucket_t));
     return ht->buckets ? 0 : -1;
 }
 
 void hash_table_free(hash_table_t *ht) {
-    free(ht->buckets);
+    mem_free(ht->buckets);
     ht->buckets = NULL;
     ht->capacity = 0;
     ht->size = 0;
 }
 
+/* Buckets per region in hash_table_build_from_pairs: 256 KB, about an L2. */
+#define BUILD_REGION 16384u
+/* Keys between a prefetch and its probe in the *_many calls; enough misses
+ * in flight to cover memory latency without evicting the early ones. */
+#define PREFETCH_DIST 16u
+
 static int maybe_grow(hash_table_t *ht);
 
-int hash_table_put(hash_table_t *ht, uint64_t key, uint64_t value) {
-    if (maybe_grow(ht) != 0) {
-        return -1;
-    }
+/* Finds key's bucket from a precomputed home, claiming one (the first
+ * tombstone passed, else the empty bucket reached) with value 0 when key is
+ * absent. No load check; callers make room first. */
+static hash_bucket_t *slot_from(hash_table_t *ht, size_t idx, uint64_t key, int *inserted) {
     size_t mask = ht->capacity - 1;
-    size_t idx = mix64(key) & mask;
     size_t first_tomb = (size_t)-1;
     for (;;) {
         hash_bucket_t *b = &ht->buckets[idx];
         if (b->state == 0) {
             hash_bucket_t *dest = (first_tomb != (size_t)-1) ? &ht->buckets[first_tomb] : b;
             dest->key = key;
-            dest->value = value;
+            dest->value = 0;
             dest->state = 1;
             ht->size++;
-            return 0;
+            *inserted = 1;
+            return dest;
         }
         if (b->state == 2 && first_tomb == (size_t)-1) {
             first_tomb = idx;
         } else if (b->state == 1 && b->key == key) {
-            b->value = value;
-            return 0;
+            *inserted = 0;
+            return b;
         }
         idx = (idx + 1) & mask;
     }
 }
 
-int hash_table_get(const hash_table_t *ht, uint64_t key, uint64_t *out_value) {
+static void insert(hash_table_t *ht, uint64_t key, uint32_t value) {
+    int inserted;
+    slot_from(ht, mix64(key) & (ht->capacity - 1), key, &inserted)->value = value;
+}
+
+int hash_table_put(hash_table_t *ht, uint64_t key, uint32_t value) {
+    if (maybe_grow(ht) != 0) {
+        return -1;
+    }
+    insert(ht, key, value);
+    return 0;
+}
+
+/* Probes from a precomputed home bucket. */
+static int lookup_from(const hash_table_t *ht, size_t idx, uint64_t key, uint32_t *out_value) {
     size_t mask = ht->capacity - 1;
-    size_t idx = mix64(key) & mask;
     for (;;) {
         const hash_bucket_t *b = &ht->buckets[idx];
         if (b->state == 0) {
@@ -79,6 +100,55 @@ int hash_table_get(const hash_table_t *ht, uint64_t key, uint64_t *out_value) {
     }
 }
 
+int hash_table_get(const hash_table_t *ht, uint64_t key, uint32_t *out_value) {
+    return lookup_from(ht, mix64(key) & (ht->capacity - 1), key, out_value);
+}
+
+/* Iteration i prefetches key i's home and probes key i - PREFETCH_DIST,
+ * whose home sits in the same ring slot. */
+size_t hash_table_get_many(const hash_table_t *ht, const uint64_t *keys, size_t n, uint32_t *out_values,
+                           uint8_t *found) {
+    size_t mask = ht->capacity - 1, hits = 0;
+    size_t home[PREFETCH_DIST];
+    for (size_t i = 0; i < n + PREFETCH_DIST; i++) {
+        size_t slot = i % PREFETCH_DIST;
+        if (i >= PREFETCH_DIST) {
+            size_t j = i - PREFETCH_DIST;
+            uint32_t v;
+            found[j] = lookup_from(ht, home[slot], keys[j], &v) == 0;
+            if (found[j]) {
+                hits++;
+                if (out_values) out_values[j] = v;
+            }
+        }
+        if (i < n) {
+            home[slot] = mix64(keys[i]) & mask;
+            PLAT_PREFETCH(&ht->buckets[home[slot]]);
+        }
+    }
+    return hits;
+}
+
+/* The same prefetch ring as get_many, after one reserve for the batch. */
+int hash_table_put_many(hash_table_t *ht, const uint64_t *keys, const uint32_t *values, size_t n) {
+    if (hash_table_reserve(ht, ht->size + n) != 0) return -1;
+    size_t mask = ht->capacity - 1;
+    size_t home[PREFETCH_DIST];
+    for (size_t i = 0; i < n + PREFETCH_DIST; i++) {
+        size_t slot = i % PREFETCH_DIST;
+        if (i >= PREFETCH_DIST) {
+            size_t j = i - PREFETCH_DIST;
+            int inserted;
+            slot_from(ht, home[slot], keys[j], &inserted)->value = values[j];
+        }
+        if (i < n) {
+            home[slot] = mix64(keys[i]) & mask;
+            PLAT_PREFETCH(&ht->buckets[home[slot]]);
+        }
+    }
+    return 0;
+}
+
 int hash_table_delete(hash_table_t *ht, uint64_t key) {
     size_t mask = ht->capacity - 1;
     size_t idx = mix64(key) & mask;
@@ -100,20 +170,23 @@ static int rehash(hash_table_t *ht, size_t new_cap) {
     hash_bucket_t *old = ht->buckets;
     size_t old_cap = ht->capacity;
 
+    trace_begin_u64("hash_table.rehash", "new_capacity", new_cap);
     ht->capacity = new_cap;
     ht->size = 0;
-    ht->buckets = (hash_bucket_t *)calloc(ht->capacity, sizeof(hash_bucket_t));
+    ht->buckets = (hash_bucket_t *)mem_calloc(MEM_TAG_INDEX, ht->capacity, sizeof(hash_bucket_t));
     if (!ht->buckets) {
         ht->buckets = old;
         ht->capacity = old_cap;
+        trace_end("hash_table.rehash");
         return -1;
     }
     for (size_t i = 0; i < old_cap; i++) {
         if (old[i].state == 1) {
-            hash_table_put(ht, old[i].key, old[i].value);
+            insert(ht, old[i].key, old[i].value);
         }
     }
-    free(old);
+    mem_free(old);
+    trace_end("hash_table.rehash");
     return 0;
 }
 
@@ -127,3 +200,137 @@ static int maybe_grow(hash_table_t *ht) {
     return 0;
 }
 
+
+int hash_table_reserve(hash_table_t *ht, size_t count) {
+    size_t cap = clamp_capacity(count + count / 2 + 2); /* stays under the 0.7 load factor */
+    return cap > ht->capacity ? rehash(ht, cap) : 0;
+}
+
+/* A stable counting sort on the region of each pair's home bucket, then
+ * inserts region by region; stability keeps duplicate keys in input order. */
+int hash_table_build_from_pairs(hash_table_t *ht, const hash_pair_t *pairs, size_t count) {
+    if (count == 0) return 0;
+    if (hash_table_reserve(ht, ht->size + count) != 0) return -1;
+    size_t regions = ht->capacity / BUILD_REGION;
+    hash_pair_t *sorted = NULL;
+    size_t *offsets = NULL;
+    if (regions > 1) {
+        sorted = (hash_pair_t *)mem_alloc(MEM_TAG_INDEX, count * sizeof(hash_pair_t));
+        offsets = (size_t *)mem_calloc(MEM_TAG_INDEX, regions + 1, sizeof(size_t));
+    }
+    if (!sorted || !offsets) {
+        /* Small enough to stay in cache (or no scratch memory): insert in order. */
+        mem_free(sorted);
+        mem_free(offsets);
+        for (size_t i = 0; i < count; i++) insert(ht, pairs[i].key, pairs[i].value);
+        return 0;
+    }
+    trace_begin_u64("hash_table.build", "count", count);
+    size_t mask = ht->capacity - 1;
+    for (size_t i = 0; i < count; i++) offsets[((mix64(pairs[i].key) & mask) / BUILD_REGION) + 1]++;
+    for (size_t r = 1; r <= regions; r++) offsets[r] += offsets[r - 1];
+    for (size_t i = 0; i < count; i++) sorted[offsets[(mix64(pairs[i].key) & mask) / BUILD_REGION]++] = pairs[i];
+    for (size_t i = 0; i < count; i++) insert(ht, sorted[i].key, sorted[i].value);
+    mem_free(offsets);
+    mem_free(sorted);
+    trace_end("hash_table.build");
+    return 0;
+}
+
+uint32_t *hash_table_upsert(hash_table_t *ht, uint64_t key, int *inserted) {
+    int ins;
+    if (maybe_grow(ht) != 0) return NULL;
+    hash_bucket_t *b = slot_from(ht, mix64(key) & (ht->capacity - 1), key, &ins);
+    if (inserted) *inserted = ins;
+    return &b->value;
+}
+
+int hash_table_add(hash_table_t *ht, uint64_t key, uint32_t delta, uint32_t *out_value) {
+    uint32_t *v = hash_table_upsert(ht, key, NULL);
+    if (!v) return -1;
+    *v += delta;
+    if (out_value) *out_value = *v;
+    return *v < delta; /* wrapped past 2^32 */
+}
+
+static void size_inc_atomic(size_t *size) {
+#if SIZE_MAX == UINT64_MAX
+    plat_atomic_add_u64((volatile uint64_t *)size, 1);
+#else
+    plat_atomic_add_u32((volatile uint32_t *)size, 1);
+#endif
+}
+
+static size_t size_load_atomic(size_t *size) {
+#if SIZE_MAX == UINT64_MAX
+    return (size_t)plat_atomic_load_u64((volatile uint64_t *)size);
+#else
+    return (size_t)plat_atomic_load_u32((volatile uint32_t *)size);
+#endif
+}
+
+/* A claimer moves a bucket from empty to 3, writes key and value, then
+ * publishes state 1; threads reaching a bucket in state 3 wait for the key
+ * before comparing. Buckets never return to empty, so two threads adding
+ * one new key meet at the same bucket. */
+int hash_table_add_atomic(hash_table_t *ht, uint64_t key, uint32_t delta) {
+    size_t mask = ht->capacity - 1;
+    size_t idx = mix64(key) & mask;
+    for (;;) {
+        hash_bucket_t *b = &ht->buckets[idx];
+        volatile uint32_t *state = (volatile uint32_t *)&b->state;
+        uint32_t s = plat_atomic_load_u32(state);
+        if (s == 0) {
+            if ((size_load_atomic(&ht->size) + 1) * 10 >= ht->capacity * 7) return -1;
+            if (plat_atomic_cas_u32(state, 0, 3)) {
+                b->key = key;
+                b->value = delta;
+                size_inc_atomic(&ht->size);
+                plat_atomic_store_u32(state, 1);
+                return 0;
+            }
+            s = plat_atomic_load_u32(state);
+        }
+        while (s == 3) s = plat_atomic_load_u32(state);
+        if (s == 1 && b->key == key) {
+            return plat_atomic_add_u32((volatile uint32_t *)&b->value, delta) < delta;
+        }
+        idx = (idx + 1) & mask;
+    }
+}
+
+void hash_iter_init(hash_iter_t *it, const hash_table_t *ht) {
+    it->ht = ht;
+    it->pos = 0;
+    it->end = ht->capacity;
+}
+
+void hash_iter_init_range(hash_iter_t *it, const hash_table_t *ht, unsigned part, unsigned parts) {
+    size_t step = parts ? ht->capacity / parts : ht->capacity;
+    it->ht = ht;
+    it->pos = part < parts ? step * part : ht->capacity;
+    it->end = part + 1 < parts ? it->pos + step : ht->capacity;
+}
+
+int hash_iter_next(hash_iter_t *it, uint64_t *key, uint32_t *value) {
+    const hash_bucket_t *buckets = it->ht->buckets;
+    while (it->pos < it->end) {
+        const hash_bucket_t *b = &buckets[it->pos++];
+        if (b->state == 1) {
+            if (key) *key = b->key;
+            if (value) *value = b->value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void hash_iter_save(const hash_iter_t *it, hash_cursor_t *out) {
+    out->pos = it->pos;
+    out->capacity = it->ht->capacity;
+}
+
+void hash_iter_resume(hash_iter_t *it, const hash_table_t *ht, const hash_cursor_t *cursor) {
+    hash_iter_init(it, ht);
+    if (cursor->capacity == ht->capacity && cursor->pos <= ht->capacity) it->pos = cursor->pos;
+}
@@ -2,12 +2,19 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/* Values are 32-bit: indexes store dense record indices, not pointers, which
+ * keeps a bucket at 16 bytes (four per cache line). */
 typedef struct {
     uint64_t key;
-    uint64_t value;
-    uint8_t state; /* 0 empty, 1 used, 2 tombstone */
+    uint32_t value;
+    uint32_t state; /* 0 empty, 1 used, 2 tombstone, 3 being claimed by add_atomic */
 } hash_bucket_t;
 
+typedef struct {
+    uint64_t key;
+    uint32_t value;
+} hash_pair_t;
+
 typedef struct {
     hash_bucket_t *buckets;
     size_t capacity;
@@ -16,7 +23,64 @@ typedef struct {
 
 int hash_table_init(hash_table_t *ht, size_t capacity);
 void hash_table_free(hash_table_t *ht);
-int hash_table_put(hash_table_t *ht, uint64_t key, uint64_t value);
-int hash_table_get(const hash_table_t *ht, uint64_t key, uint64_t *out_value);
+int hash_table_put(hash_table_t *ht, uint64_t key, uint32_t value);
+int hash_table_get(const hash_table_t *ht, uint64_t key, uint32_t *out_value);
 int hash_table_delete(hash_table_t *ht, uint64_t key);
+/* Grows once so count entries fit without further rehashing. */
+int hash_table_reserve(hash_table_t *ht, size_t count);
+/* Inserts count pairs (into an empty or populated table) after one reserve,
+ * grouped by home-bucket region so the writes sweep the table instead of
+ * missing cache on each insert. A later pair overwrites an earlier one with
+ * the same key, as with put. */
+int hash_table_build_from_pairs(hash_table_t *ht, const hash_pair_t *pairs, size_t count);
+/* Batched lookups and inserts for tables bigger than cache: every key's
+ * home bucket is prefetched a fixed distance ahead of its probe, so the
+ * misses overlap instead of stalling one at a time. get_many sets found[i]
+ * and, when found, out_values[i] (may be NULL); it returns the hit count.
+ * put_many matches n calls to put in order. */
+size_t hash_table_get_many(const hash_table_t *ht, const uint64_t *keys, size_t n, uint32_t *out_values,
+                           uint8_t *found);
+int hash_table_put_many(hash_table_t *ht, const uint64_t *keys, const uint32_t *values, size_t n);
+
+/* Counters in one probe. upsert returns key's value slot, inserting it
+ * with value 0 when absent (*inserted, may be NULL, says which); the
+ * pointer is valid until the next insert. add adds delta (inserting at
+ * delta) and returns the new value through out_value (may be NULL). Both
+ * adds return 1 when the 32-bit value wrapped past 2^32, so counters that
+ * can get that large carry into a wider count of their own. */
+uint32_t *hash_table_upsert(hash_table_t *ht, uint64_t key, int *inserted);
+int hash_table_add(hash_table_t *ht, uint64_t key, uint32_t delta, uint32_t *out_value);
+/* add for several threads at once on a table reserved for every key they
+ * insert: new keys claim empty buckets by compare-and-swap and counts use
+ * atomic fetch-add, so the table never grows and tombstones are not
+ * reused. Returns -1 once the table passes its load factor. Nothing else
+ * may use the table until every adding thread is done. */
+int hash_table_add_atomic(hash_table_t *ht, uint64_t key, uint32_t delta);
+
+/* Iteration over entries in bucket order; callers never see buckets, so
+ * the layout can change under them. hash_iter_init_range covers part of
+ * parts contiguous bucket ranges that together cover the table exactly once,
+ * for scans split across threads. The table must not change during a pass. */
+typedef struct {
+    const hash_table_t *ht;
+    size_t pos; /* next bucket to look at */
+    size_t end; /* one past the range */
+} hash_iter_t;
+
+void hash_iter_init(hash_iter_t *it, const hash_table_t *ht);
+void hash_iter_init_range(hash_iter_t *it, const hash_table_t *ht, unsigned part, unsigned parts);
+/* 1 and the next entry, or 0 once the range is done. */
+int hash_iter_next(hash_iter_t *it, uint64_t *key, uint32_t *value);
+
+/* Resumable scans: save where a whole-table iterator stopped, change the
+ * table, resume later. Entries present throughout are seen once unless the
+ * table was rehashed in between, in which case the scan restarts (entries
+ * may repeat); entries added or deleted meanwhile may or may not appear. */
+typedef struct {
+    size_t pos;
+    size_t capacity;
+} hash_cursor_t;
+
+void hash_iter_save(const hash_iter_t *it, hash_cursor_t *out);
+void hash_iter_resume(hash_iter_t *it, const hash_table_t *ht, const hash_cursor_t *cursor);
 
@@ -1,5 +1,5 @@
 #include "linked_list.h"
-#include <stdlib.h>
+#include "mem.h"
 
 void list_init(linked_list_t *list) {
     list->head = NULL;
@@ -8,7 +8,7 @@ void list_init(linked_list_t *list) {
 }
 
 int list_push_back(linked_list_t *list, void *data) {
-    list_node_t *node = (list_node_t *)malloc(sizeof(list_node_t));
+    list_node_t *node = (list_node_t *)mem_alloc(MEM_TAG_LISTS, sizeof(list_node_t));
     if (!node) {
         return -1;
     }
@@ -25,7 +25,7 @@ int list_push_back(linked_list_t *list, void *data) {
 }
 
 int list_push_front(linked_list_t *list, void *data) {
-    list_node_t *node = (list_node_t *)malloc(sizeof(list_node_t));
+    list_node_t *node = (list_node_t *)mem_alloc(MEM_TAG_LISTS, sizeof(list_node_t));
     if (!node) {
         return -1;
     }
@@ -49,7 +49,7 @@ void *list_pop_front(linked_list_t *list) {
     if (list->head == NULL) {
         list->tail = NULL;
     }
-    free(node);
+    mem_free(node);
     list->length--;
     return data;
 }
@@ -61,7 +61,7 @@ void list_clear(linked_list_t *list, void (*free_fn)(void *)) {
         if (free_fn) {
             free_fn(cur->data);
         }
-        free(cur);
+        mem_free(cur);
         cur = next;
     }
     list_init(list);
@@ -0,0 +1,128 @@
+#include "mem.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+typedef union {
+    struct {
+        uint64_t size;
+        uint32_t tag;
+    } h;
+    max_align_t align;
+} mem_header_t;
+
+typedef struct {
+    volatile uint64_t live_bytes;
+    volatile uint64_t peak_bytes;
+    volatile uint64_t allocs;
+    volatile uint64_t frees;
+} mem_counter_t;
+
+/* One slot per tag plus a final slot for the process-wide total, so the
+ * reported total peak is a real high-water mark, not a sum of per-tag peaks. */
+static mem_counter_t counters[MEM_TAG_COUNT + 1];
+
+static const char *tag_names[MEM_TAG_COUNT] = {
+    "misc", "users", "elections", "votes", "indexes", "lists", "audit", "wal"
+};
+
+static void counter_alloc(mem_counter_t *c, uint64_t size) {
+    plat_atomic_add_u64(&c->allocs, 1);
+    uint64_t live = plat_atomic_add_u64(&c->live_bytes, size);
+    uint64_t peak = plat_atomic_load_u64(&c->peak_bytes);
+    while (live > peak && !plat_atomic_cas_u64(&c->peak_bytes, peak, live)) {
+        peak = plat_atomic_load_u64(&c->peak_bytes);
+    }
+}
+
+static void counter_free(mem_counter_t *c, uint64_t size) {
+    plat_atomic_add_u64(&c->frees, 1);
+    plat_atomic_add_u64(&c->live_bytes, (uint64_t)0 - size);
+}
+
+static void account_alloc(mem_tag_t tag, uint64_t size) {
+    counter_alloc(&counters[tag], size);
+    counter_alloc(&counters[MEM_TAG_COUNT], size);
+}
+
+static void account_free(mem_tag_t tag, uint64_t size) {
+    counter_free(&counters[tag], size);
+    counter_free(&counters[MEM_TAG_COUNT], size);
+}
+
+static void *finish(mem_header_t *h, mem_tag_t tag, size_t size) {
+    if (!h) return NULL;
+    h->h.size = size;
+    h->h.tag = (uint32_t)tag;
+    account_alloc(tag, size);
+    return h + 1;
+}
+
+void *mem_alloc(mem_tag_t tag, size_t size) {
+    if (size > SIZE_MAX - sizeof(mem_header_t)) return NULL;
+    return finish((mem_header_t *)malloc(sizeof(mem_header_t) + size), tag, size);
+}
+
+void *mem_calloc(mem_tag_t tag, size_t count, size_t size) {
+    if (size && count > (SIZE_MAX - sizeof(mem_header_t)) / size) return NULL;
+    size_t total = count * size;
+    return finish((mem_header_t *)calloc(1, sizeof(mem_header_t) + total), tag, total);
+}
+
+void *mem_realloc(mem_tag_t tag, void *ptr, size_t size) {
+    if (!ptr) return mem_alloc(tag, size);
+    if (size > SIZE_MAX - sizeof(mem_header_t)) return NULL;
+    mem_header_t *old = (mem_header_t *)ptr - 1;
+    mem_tag_t old_tag = (mem_tag_t)old->h.tag;
+    uint64_t old_size = old->h.size;
+    mem_header_t *h = (mem_header_t *)realloc(old, sizeof(mem_header_t) + size);
+    if (!h) return NULL;
+    account_free(old_tag, old_size);
+    return finish(h, tag, size);
+}
+
+char *mem_strdup(mem_tag_t tag, const char *s) {
+    size_t n = strlen(s) + 1;
+    char *dup = (char *)mem_alloc(tag, n);
+    if (dup) memcpy(dup, s, n);
+    return dup;
+}
+
+void mem_free(void *ptr) {
+    if (!ptr) return;
+    mem_header_t *h = (mem_header_t *)ptr - 1;
+    account_free((mem_tag_t)h->h.tag, h->h.size);
+    free(h);
+}
+
+const char *mem_tag_name(mem_tag_t tag) {
+    return (unsigned)tag < MEM_TAG_COUNT ? tag_names[tag] : "?";
+}
+
+static void read_counter(mem_counter_t *c, mem_stats_t *out) {
+    out->live_bytes = plat_atomic_load_u64(&c->live_bytes);
+    out->peak_bytes = plat_atomic_load_u64(&c->peak_bytes);
+    out->allocs = plat_atomic_load_u64(&c->allocs);
+    out->frees = plat_atomic_load_u64(&c->frees);
+}
+
+void mem_get_stats(mem_tag_t tag, mem_stats_t *out) {
+    read_counter(&counters[(unsigned)tag < MEM_TAG_COUNT ? tag : MEM_TAG_COUNT], out);
+}
+
+static void report_row(FILE *out, const char *name, const mem_stats_t *s) {
+    fprintf(out, "  %-10s %14" PRIu64 " %14" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+            name, s->live_bytes, s->peak_bytes, s->allocs, s->frees);
+}
+
+void mem_report(FILE *out) {
+    mem_stats_t s;
+    fprintf(out, "  %-10s %14s %14s %12s %12s\n", "tag", "live bytes", "peak bytes", "allocs", "frees");
+    for (int t = 0; t < MEM_TAG_COUNT; t++) {
+        read_counter(&counters[t], &s);
+        report_row(out, tag_names[t], &s);
+    }
+    read_counter(&counters[MEM_TAG_COUNT], &s);
+    report_row(out, "total", &s);
+}
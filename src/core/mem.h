@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Tagged allocation layer. Every block carries a small header recording its
+ * tag and size, so mem_free needs only the pointer. Per-tag counters are
+ * updated atomically and are safe to read from any thread. */
+
+typedef enum {
+    MEM_TAG_MISC,
+    MEM_TAG_USERS,
+    MEM_TAG_ELECTIONS,
+    MEM_TAG_VOTES,
+    MEM_TAG_INDEX,
+    MEM_TAG_LISTS,
+    MEM_TAG_AUDIT,
+    MEM_TAG_WAL,
+    MEM_TAG_COUNT
+} mem_tag_t;
+
+typedef struct {
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+    uint64_t allocs;
+    uint64_t frees;
+} mem_stats_t;
+
+void *mem_alloc(mem_tag_t tag, size_t size);
+void *mem_calloc(mem_tag_t tag, size_t count, size_t size);
+void *mem_realloc(mem_tag_t tag, void *ptr, size_t size);
+char *mem_strdup(mem_tag_t tag, const char *s);
+void mem_free(void *ptr);
+
+const char *mem_tag_name(mem_tag_t tag);
+void mem_get_stats(mem_tag_t tag, mem_stats_t *out); /* MEM_TAG_COUNT gives the process total */
+void mem_report(FILE *out);
@@ -0,0 +1,268 @@
+#include "perfect_hash.h"
+#include "mem.h"
+#include "trace.h"
+#include <string.h>
+
+/* Blob: header, pilots (u16 per bucket), remap (u32 per slot past count),
+ * entries (12 bytes per key); each section starts 8-byte aligned. */
+#define PH_MAGIC "OVPHF1"
+#define PH_BUCKET_KEYS 3u  /* average keys per bucket */
+#define PH_PILOTS 65536u   /* a pilot fits in 16 bits */
+#define PH_SEEDS 8u        /* builds retried with a new seed */
+#define PH_ENTRY 12u
+
+typedef struct {
+    char magic[8];
+    uint64_t count;
+    uint64_t slots;
+    uint64_t buckets;
+    uint64_t seed;
+    uint64_t size; /* whole blob */
+} ph_header_t;
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t pad8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+/* Both map a hash's high half onto their range by multiply-shift instead of
+ * a division. The bucket uses the key's hash; the slot remixes it with the
+ * pilot, since XORing in the pilot alone would move keys that share their
+ * high bits together under every pilot. */
+static uint64_t bucket_of(uint64_t h, uint64_t buckets) {
+    return ((h >> 32) * buckets) >> 32;
+}
+
+static uint64_t slot_of(uint64_t h, uint32_t pilot, uint64_t slots) {
+    return (mix64(h ^ (pilot * 0x9e3779b97f4a7c15ULL)) >> 32) * slots >> 32;
+}
+
+static uint64_t blob_size(uint64_t count, uint64_t slots, uint64_t buckets, uint64_t *remap_at, uint64_t *entries_at) {
+    *remap_at = sizeof(ph_header_t) + pad8(buckets * sizeof(uint16_t));
+    *entries_at = *remap_at + pad8((slots - count) * sizeof(uint32_t));
+    return *entries_at + pad8(count * PH_ENTRY);
+}
+
+static void bind(perfect_hash_t *ph, const uint8_t *data) {
+    const ph_header_t *hdr = (const ph_header_t *)data;
+    uint64_t remap_at, entries_at;
+    ph->data = data;
+    ph->size = (size_t)hdr->size;
+    ph->count = hdr->count;
+    ph->slots = hdr->slots;
+    ph->buckets = hdr->buckets;
+    ph->seed = hdr->seed;
+    blob_size(hdr->count, hdr->slots, hdr->buckets, &remap_at, &entries_at);
+    ph->pilots = (const uint16_t *)(data + sizeof(ph_header_t));
+    ph->remap = (const uint32_t *)(data + remap_at);
+    ph->entries = data + entries_at;
+}
+
+typedef struct {
+    const hash_pair_t *pairs;
+    uint64_t count, slots, buckets;
+    uint64_t *hashes;  /* per key */
+    uint32_t *slot;    /* per key, in [0, slots) */
+    uint32_t *members; /* key indices grouped by bucket */
+    uint32_t *start;   /* buckets + 1 offsets into members */
+    uint32_t *order;   /* buckets, largest first */
+    uint16_t *pilots;
+    uint64_t *taken;   /* slot bitmap */
+} ph_build_t;
+
+static int is_taken(const uint64_t *bits, uint64_t s) {
+    return (bits[s >> 6] >> (s & 63)) & 1;
+}
+
+/* Finds a pilot for every bucket under seed: 0 on success, -1 when some
+ * bucket has none (try another seed), -2 on a repeated key. */
+static int place_all(ph_build_t *b, uint64_t seed) {
+    uint64_t n = b->count, nb = b->buckets;
+    memset(b->start, 0, (size_t)(nb + 1) * sizeof(uint32_t));
+    for (uint64_t i = 0; i < n; i++) {
+        b->hashes[i] = mix64(b->pairs[i].key ^ seed);
+        b->start[bucket_of(b->hashes[i], nb) + 1]++;
+    }
+    uint32_t max_size = 0;
+    for (uint64_t k = 0; k < nb; k++) {
+        if (b->start[k + 1] > max_size) max_size = b->start[k + 1];
+        b->start[k + 1] += b->start[k];
+    }
+    /* order doubles as the fill cursor per bucket, then is rebuilt below. */
+    memcpy(b->order, b->start, (size_t)nb * sizeof(uint32_t));
+    for (uint64_t i = 0; i < n; i++) b->members[b->order[bucket_of(b->hashes[i], nb)]++] = (uint32_t)i;
+    uint32_t *by_size = (uint32_t *)mem_calloc(MEM_TAG_INDEX, (size_t)max_size + 2, sizeof(uint32_t));
+    uint64_t *pos = (uint64_t *)mem_alloc(MEM_TAG_INDEX, ((size_t)max_size + 1) * sizeof(uint64_t));
+    if (!by_size || !pos) {
+        mem_free(by_size);
+        mem_free(pos);
+        return -2;
+    }
+    for (uint64_t k = 0; k < nb; k++) by_size[max_size - (b->start[k + 1] - b->start[k]) + 1]++;
+    for (uint32_t s = 1; s <= max_size + 1; s++) by_size[s] += by_size[s - 1];
+    for (uint64_t k = 0; k < nb; k++) b->order[by_size[max_size - (b->start[k + 1] - b->start[k])]++] = (uint32_t)k;
+    memset(b->taken, 0, (size_t)((b->slots + 63) / 64) * sizeof(uint64_t));
+    memset(b->pilots, 0, (size_t)nb * sizeof(uint16_t));
+    int rc = 0;
+    for (uint64_t o = 0; o < nb && rc == 0; o++) {
+        uint32_t k = b->order[o];
+        const uint32_t *keys = b->members + b->start[k];
+        uint32_t size = b->start[k + 1] - b->start[k];
+        if (size == 0) break; /* the rest are empty too */
+        for (uint32_t i = 1; i < size && rc == 0; i++) {
+            for (uint32_t j = 0; j < i; j++) {
+                if (b->hashes[keys[i]] == b->hashes[keys[j]]) rc = -2; /* mix64 is a bijection */
+            }
+        }
+        uint32_t pilot = 0;
+        for (; pilot < PH_PILOTS && rc == 0; pilot++) {
+            uint32_t i = 0;
+            for (; i < size; i++) {
+                pos[i] = slot_of(b->hashes[keys[i]], pilot, b->slots);
+                if (is_taken(b->taken, pos[i])) break;
+                uint32_t j = 0;
+                while (j < i && pos[j] != pos[i]) j++;
+                if (j < i) break;
+            }
+            if (i == size) break;
+        }
+        if (rc != 0) break;
+        if (pilot == PH_PILOTS) {
+            rc = -1;
+            break;
+        }
+        b->pilots[k] = (uint16_t)pilot;
+        for (uint32_t i = 0; i < size; i++) {
+            b->taken[pos[i] >> 6] |= (uint64_t)1 << (pos[i] & 63);
+            b->slot[keys[i]] = (uint32_t)pos[i];
+        }
+    }
+    mem_free(by_size);
+    mem_free(pos);
+    return rc;
+}
+
+/* Writes the blob once every key has a slot. */
+static uint8_t *assemble(const ph_build_t *b, uint64_t seed, uint64_t *out_size) {
+    uint64_t remap_at, entries_at;
+    uint64_t size = blob_size(b->count, b->slots, b->buckets, &remap_at, &entries_at);
+    uint8_t *data = (uint8_t *)mem_calloc(MEM_TAG_INDEX, 1, (size_t)size);
+    if (!data) return NULL;
+    ph_header_t *hdr = (ph_header_t *)data;
+    memcpy(hdr->magic, PH_MAGIC, sizeof(PH_MAGIC));
+    hdr->count = b->count;
+    hdr->slots = b->slots;
+    hdr->buckets = b->buckets;
+    hdr->seed = seed;
+    hdr->size = size;
+    memcpy(data + sizeof(*hdr), b->pilots, (size_t)b->buckets * sizeof(uint16_t));
+    /* Taken slots past count are paired with free slots below it. */
+    uint32_t *remap = (uint32_t *)(data + remap_at);
+    uint64_t hole = 0;
+    for (uint64_t s = b->count; s < b->slots; s++) {
+        if (!is_taken(b->taken, s)) continue;
+        while (is_taken(b->taken, hole)) hole++;
+        remap[s - b->count] = (uint32_t)hole++;
+    }
+    uint8_t *entries = data + entries_at;
+    for (uint64_t i = 0; i < b->count; i++) {
+        uint64_t s = b->slot[i];
+        if (s >= b->count) s = remap[s - b->count];
+        memcpy(entries + s * PH_ENTRY, &b->pairs[i].key, sizeof(uint64_t));
+        memcpy(entries + s * PH_ENTRY + sizeof(uint64_t), &b->pairs[i].value, sizeof(uint32_t));
+    }
+    *out_size = size;
+    return data;
+}
+
+int perfect_hash_build(perfect_hash_t *ph, const hash_pair_t *pairs, size_t count) {
+    memset(ph, 0, sizeof(*ph));
+    if ((uint64_t)count > UINT32_MAX / 2) return -1;
+    ph_build_t b;
+    memset(&b, 0, sizeof(b));
+    b.pairs = pairs;
+    b.count = count;
+    b.slots = count ? count + count / 64 + 1 : 0;
+    b.buckets = count ? count / PH_BUCKET_KEYS + 1 : 0;
+    trace_begin_u64("perfect_hash.build", "keys", b.count);
+    b.hashes = (uint64_t *)mem_alloc(MEM_TAG_INDEX, (count ? count : 1) * sizeof(uint64_t));
+    b.slot = (uint32_t *)mem_alloc(MEM_TAG_INDEX, (count ? count : 1) * sizeof(uint32_t));
+    b.members = (uint32_t *)mem_alloc(MEM_TAG_INDEX, (count ? count : 1) * sizeof(uint32_t));
+    b.start = (uint32_t *)mem_alloc(MEM_TAG_INDEX, ((size_t)b.buckets + 1) * sizeof(uint32_t));
+    b.order = (uint32_t *)mem_alloc(MEM_TAG_INDEX, ((size_t)b.buckets + 1) * sizeof(uint32_t));
+    b.pilots = (uint16_t *)mem_alloc(MEM_TAG_INDEX, ((size_t)b.buckets + 1) * sizeof(uint16_t));
+    b.taken = (uint64_t *)mem_alloc(MEM_TAG_INDEX, (size_t)((b.slots + 63) / 64 + 1) * sizeof(uint64_t));
+    /* -1 until a seed places every key; -2 gives up. */
+    int rc = b.hashes && b.slot && b.members && b.start && b.order && b.pilots && b.taken ? -1 : -2;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (uint32_t attempt = 0; rc == -1 && attempt < PH_SEEDS; attempt++) {
+        seed = mix64(seed + attempt);
+        rc = place_all(&b, seed);
+    }
+    uint64_t size = 0;
+    uint8_t *data = rc == 0 ? assemble(&b, seed, &size) : NULL;
+    mem_free(b.hashes);
+    mem_free(b.slot);
+    mem_free(b.members);
+    mem_free(b.start);
+    mem_free(b.order);
+    mem_free(b.pilots);
+    mem_free(b.taken);
+    trace_end("perfect_hash.build");
+    if (!data) return -1;
+    ph->owned = data;
+    bind(ph, data);
+    return 0;
+}
+
+int perfect_hash_open(perfect_hash_t *ph, const void *data, size_t avail) {
+    memset(ph, 0, sizeof(*ph));
+    const ph_header_t *hdr = (const ph_header_t *)data;
+    uint64_t remap_at, entries_at;
+    if (((uintptr_t)data & 7) != 0 || avail < sizeof(*hdr) || memcmp(hdr->magic, PH_MAGIC, sizeof(PH_MAGIC)) != 0 ||
+        hdr->count > UINT32_MAX / 2 || hdr->slots < hdr->count || hdr->slots - hdr->count > hdr->count / 32 + 1 ||
+        hdr->buckets > hdr->count + 1 || (hdr->count && (!hdr->slots || !hdr->buckets)) || hdr->size > avail ||
+        blob_size(hdr->count, hdr->slots, hdr->buckets, &remap_at, &entries_at) != hdr->size) {
+        return -1;
+    }
+    bind(ph, (const uint8_t *)data);
+    for (uint64_t i = 0; i < hdr->slots - hdr->count; i++) {
+        if (ph->remap[i] >= hdr->count) {
+            memset(ph, 0, sizeof(*ph));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void perfect_hash_free(perfect_hash_t *ph) {
+    mem_free(ph->owned);
+    memset(ph, 0, sizeof(*ph));
+}
+
+int perfect_hash_get(const perfect_hash_t *ph, uint64_t key, uint32_t *out_value) {
+    if (ph->count == 0) return -1;
+    uint64_t h = mix64(key ^ ph->seed);
+    uint64_t s = slot_of(h, ph->pilots[bucket_of(h, ph->buckets)], ph->slots);
+    if (s >= ph->count) s = ph->remap[s - ph->count];
+    const uint8_t *e = ph->entries + s * PH_ENTRY;
+    uint64_t k;
+    memcpy(&k, e, sizeof(k));
+    if (k != key) return -1;
+    if (out_value) memcpy(out_value, e + sizeof(k), sizeof(*out_value));
+    return 0;
+}
+
+uint64_t perfect_hash_key_at(const perfect_hash_t *ph, uint64_t i) {
+    uint64_t k;
+    memcpy(&k, ph->entries + i * PH_ENTRY, sizeof(k));
+    return k;
+}
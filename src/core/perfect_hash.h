@@ -0,0 +1,41 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "hash_table.h"
+
+/* Frozen index over a fixed key set: a minimal perfect hash in the PTHash
+ * style. Keys are spread over buckets of about three, and each bucket keeps
+ * a 16-bit pilot, chosen at build time, that sends all its keys to slots no
+ * other key took. Every key thus owns one of count slots holding its
+ * (key, value) entry. A lookup reads the pilot, then the entry, and
+ * compares the key so absent keys miss. The pilots aim at slightly more
+ * slots than keys (keeps the search short); the few keys that land past
+ * count are redirected through a small remap table into the holes below.
+ *
+ * The index lives in one position-independent blob, so it can be written
+ * out as is and used straight from a file mapping. It never changes after
+ * the build. A zeroed perfect_hash_t is an empty index. */
+
+typedef struct {
+    const uint8_t *data; /* the blob */
+    size_t size;
+    uint64_t count;   /* keys */
+    uint64_t slots;   /* pilot target range, >= count */
+    uint64_t buckets;
+    uint64_t seed;
+    const uint16_t *pilots;
+    const uint32_t *remap;  /* slots - count entries */
+    const uint8_t *entries; /* count packed (u64 key, u32 value) pairs */
+    void *owned;            /* blob allocated by build; NULL when borrowed */
+} perfect_hash_t;
+
+/* Keys must be distinct; -1 when they are not, or out of memory. */
+int perfect_hash_build(perfect_hash_t *ph, const hash_pair_t *pairs, size_t count);
+/* Uses a blob written from ph->data without copying it. data must be
+ * 8-byte aligned and outlive ph; avail may run past the blob, whose length
+ * ends up in ph->size. */
+int perfect_hash_open(perfect_hash_t *ph, const void *data, size_t avail);
+void perfect_hash_free(perfect_hash_t *ph);
+int perfect_hash_get(const perfect_hash_t *ph, uint64_t key, uint32_t *out_value);
+/* Key of entry i (< count), for walking every key. */
+uint64_t perfect_hash_key_at(const perfect_hash_t *ph, uint64_t i);
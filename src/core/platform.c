@@ -0,0 +1,678 @@
+#define _GNU_SOURCE
+#include "platform.h"
+#include <stdlib.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifdef _WIN32
+
+typedef struct {
+    plat_thread_fn fn;
+    void *arg;
+} thread_start_t;
+
+static unsigned __stdcall thread_trampoline(void *p) {
+    thread_start_t start = *(thread_start_t *)p;
+    free(p);
+    start.fn(start.arg);
+    return 0;
+}
+
+int plat_thread_create(plat_thread_t *t, plat_thread_fn fn, void *arg) {
+    thread_start_t *start = (thread_start_t *)malloc(sizeof(*start));
+    if (!start) return -1;
+    start->fn = fn;
+    start->arg = arg;
+    uintptr_t h = _beginthreadex(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (!h) {
+        free(start);
+        return -1;
+    }
+    t->handle = (void *)h;
+    return 0;
+}
+
+int plat_thread_join(plat_thread_t *t) {
+    WaitForSingleObject((HANDLE)t->handle, INFINITE);
+    CloseHandle((HANDLE)t->handle);
+    t->handle = NULL;
+    return 0;
+}
+
+uint64_t plat_thread_id(void) {
+    return (uint64_t)GetCurrentThreadId();
+}
+
+unsigned plat_cpu_count(void) {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors ? (unsigned)si.dwNumberOfProcessors : 1u;
+}
+
+int plat_mutex_init(plat_mutex_t *m) {
+    InitializeCriticalSection((CRITICAL_SECTION *)m->opaque);
+    return 0;
+}
+
+void plat_mutex_lock(plat_mutex_t *m) {
+    EnterCriticalSection((CRITICAL_SECTION *)m->opaque);
+}
+
+void plat_mutex_unlock(plat_mutex_t *m) {
+    LeaveCriticalSection((CRITICAL_SECTION *)m->opaque);
+}
+
+void plat_mutex_destroy(plat_mutex_t *m) {
+    DeleteCriticalSection((CRITICAL_SECTION *)m->opaque);
+}
+
+int plat_cond_init(plat_cond_t *c) {
+    InitializeConditionVariable((CONDITION_VARIABLE *)c->opaque);
+    return 0;
+}
+
+void plat_cond_wait(plat_cond_t *c, plat_mutex_t *m) {
+    SleepConditionVariableCS((CONDITION_VARIABLE *)c->opaque, (CRITICAL_SECTION *)m->opaque, INFINITE);
+}
+
+void plat_cond_signal(plat_cond_t *c) {
+    WakeConditionVariable((CONDITION_VARIABLE *)c->opaque);
+}
+
+void plat_cond_broadcast(plat_cond_t *c) {
+    WakeAllConditionVariable((CONDITION_VARIABLE *)c->opaque);
+}
+
+void plat_cond_destroy(plat_cond_t *c) {
+    (void)c; /* condition variables hold no resources */
+}
+
+uint64_t plat_atomic_add_u64(volatile uint64_t *p, uint64_t delta) {
+    return (uint64_t)InterlockedAdd64((volatile LONG64 *)p, (LONG64)delta);
+}
+
+uint64_t plat_atomic_load_u64(volatile uint64_t *p) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p, 0, 0);
+}
+
+int plat_atomic_cas_u64(volatile uint64_t *p, uint64_t expected, uint64_t desired) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p, (LONG64)desired, (LONG64)expected) == expected;
+}
+
+uint32_t plat_atomic_add_u32(volatile uint32_t *p, uint32_t delta) {
+    return (uint32_t)InterlockedAdd((volatile LONG *)p, (LONG)delta);
+}
+
+uint32_t plat_atomic_load_u32(volatile uint32_t *p) {
+    return (uint32_t)InterlockedCompareExchange((volatile LONG *)p, 0, 0);
+}
+
+void plat_atomic_store_u32(volatile uint32_t *p, uint32_t value) {
+    InterlockedExchange((volatile LONG *)p, (LONG)value);
+}
+
+int plat_atomic_cas_u32(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+    return (uint32_t)InterlockedCompareExchange((volatile LONG *)p, (LONG)desired, (LONG)expected) == expected;
+}
+
+void *plat_atomic_load_ptr(void *volatile *p) {
+    return InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+
+int plat_atomic_cas_ptr(void *volatile *p, void *expected, void *desired) {
+    return InterlockedCompareExchangePointer(p, desired, expected) == expected;
+}
+
+void plat_yield(void) {
+    SwitchToThread();
+}
+
+uint64_t plat_now_ns(void) {
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+
+uint64_t plat_wall_us(void) {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime; /* 100ns since 1601 */
+    return t / 10 - 11644473600000000ULL;
+}
+
+void plat_sleep_ms(unsigned ms) {
+    Sleep(ms);
+}
+
+uint64_t plat_process_id(void) {
+    return (uint64_t)GetCurrentProcessId();
+}
+
+int plat_make_dir(const char *path) {
+    if (CreateDirectoryA(path, NULL)) return 0;
+    return GetLastError() == ERROR_ALREADY_EXISTS ? 0 : -1;
+}
+
+int plat_list_dir(const char *dir, plat_dir_fn fn, void *ctx) {
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA(pattern, &fd);
+    if (h == INVALID_HANDLE_VALUE) return -1;
+    int rc = 0;
+    do {
+        if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+        rc = fn(fd.cFileName, ctx);
+    } while (rc == 0 && FindNextFileA(h, &fd));
+    FindClose(h);
+    return rc;
+}
+
+int plat_map_file(plat_map_t *m, const char *path) {
+    m->data = NULL;
+    m->size = 0;
+    m->handle = NULL;
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) return -1;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size) || size.QuadPart <= 0) {
+        CloseHandle(f);
+        return -1;
+    }
+    HANDLE mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(f);
+    if (!mapping) return -1;
+    const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        return -1;
+    }
+    m->data = data;
+    m->size = (size_t)size.QuadPart;
+    m->handle = mapping;
+    return 0;
+}
+
+void plat_unmap_file(plat_map_t *m) {
+    if (m->data) UnmapViewOfFile(m->data);
+    if (m->handle) CloseHandle((HANDLE)m->handle);
+    m->data = NULL;
+    m->size = 0;
+    m->handle = NULL;
+}
+
+int plat_file_id(const char *path, uint64_t *out_id) {
+    HANDLE f = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) return -1;
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(f, &info);
+    CloseHandle(f);
+    if (!ok) return -1;
+    *out_id = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    return 0;
+}
+
+int plat_replace_file(const char *from, const char *to) {
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1;
+}
+
+int plat_fsync_file(FILE *f) {
+    if (fflush(f) != 0) return -1;
+    return _commit(_fileno(f)) == 0 ? 0 : -1;
+}
+
+int plat_fsync_dir(const char *dir) {
+    (void)dir; /* MOVEFILE_WRITE_THROUGH covers the rename */
+    return 0;
+}
+
+int plat_open_write(const char *path, int flags) {
+    if (flags & PLAT_OPEN_DIRECT) return -1; /* needs CreateFile + FILE_FLAG_NO_BUFFERING */
+    int oflags = _O_WRONLY | _O_CREAT | _O_BINARY | ((flags & PLAT_OPEN_TRUNC) ? _O_TRUNC : 0);
+    return _open(path, oflags, _S_IREAD | _S_IWRITE);
+}
+
+int plat_preallocate(int fd, uint64_t size) {
+    if ((uint64_t)_filelengthi64(fd) >= size) return 0;
+    return _chsize_s(fd, (__int64)size) == 0 ? 0 : -1;
+}
+
+int plat_pwrite(int fd, const void *buf, size_t len, uint64_t off) {
+    /* No positional write in the CRT; callers serialize writes per file. */
+    if (_lseeki64(fd, (__int64)off, SEEK_SET) < 0) return -1;
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        int n = _write(fd, p, len > 0x40000000u ? 0x40000000u : (unsigned)len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int plat_fdatasync(int fd) {
+    return _commit(fd) == 0 ? 0 : -1;
+}
+
+void plat_close_fd(int fd) {
+    _close(fd);
+}
+
+int plat_open_read(const char *path) {
+    return _open(path, _O_RDONLY | _O_BINARY);
+}
+
+int plat_write(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        int n = _write(fd, p, len > 0x40000000u ? 0x40000000u : (unsigned)len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int plat_sendfile(int out_fd, int in_fd, uint64_t off, uint64_t len) {
+    if (_lseeki64(in_fd, (__int64)off, SEEK_SET) < 0) return -1;
+    char buf[1 << 16];
+    while (len > 0) {
+        int n = _read(in_fd, buf, len < sizeof(buf) ? (unsigned)len : (unsigned)sizeof(buf));
+        if (n <= 0 || plat_write(out_fd, buf, (size_t)n) != 0) return -1;
+        len -= (uint64_t)n;
+    }
+    return 0;
+}
+
+int plat_fork_child(plat_child_t *child, plat_child_fn fn, void *arg) {
+    (void)fn;
+    (void)arg;
+    child->pid = -1;
+    return -1;
+}
+
+int plat_atfork(void (*prepare)(void), void (*parent)(void), void (*child)(void)) {
+    (void)prepare;
+    (void)parent;
+    (void)child;
+    return 0;
+}
+
+int plat_child_poll(plat_child_t *child, int wait, int *out_status) {
+    (void)child;
+    (void)wait;
+    (void)out_status;
+    return -1;
+}
+
+int plat_child_kill(plat_child_t *child) {
+    (void)child;
+    return -1;
+}
+
+#else
+
+int plat_thread_create(plat_thread_t *t, plat_thread_fn fn, void *arg) {
+    return pthread_create(&t->handle, NULL, fn, arg) == 0 ? 0 : -1;
+}
+
+int plat_thread_join(plat_thread_t *t) {
+    return pthread_join(t->handle, NULL) == 0 ? 0 : -1;
+}
+
+uint64_t plat_thread_id(void) {
+#if defined(__linux__) && defined(SYS_gettid)
+    return (uint64_t)syscall(SYS_gettid);
+#else
+    return (uint64_t)(uintptr_t)pthread_self();
+#endif
+}
+
+unsigned plat_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1u;
+}
+
+int plat_mutex_init(plat_mutex_t *m) {
+    return pthread_mutex_init(&m->m, NULL) == 0 ? 0 : -1;
+}
+
+void plat_mutex_lock(plat_mutex_t *m) {
+    pthread_mutex_lock(&m->m);
+}
+
+void plat_mutex_unlock(plat_mutex_t *m) {
+    pthread_mutex_unlock(&m->m);
+}
+
+void plat_mutex_destroy(plat_mutex_t *m) {
+    pthread_mutex_destroy(&m->m);
+}
+
+int plat_cond_init(plat_cond_t *c) {
+    return pthread_cond_init(&c->c, NULL) == 0 ? 0 : -1;
+}
+
+void plat_cond_wait(plat_cond_t *c, plat_mutex_t *m) {
+    pthread_cond_wait(&c->c, &m->m);
+}
+
+void plat_cond_signal(plat_cond_t *c) {
+    pthread_cond_signal(&c->c);
+}
+
+void plat_cond_broadcast(plat_cond_t *c) {
+    pthread_cond_broadcast(&c->c);
+}
+
+void plat_cond_destroy(plat_cond_t *c) {
+    pthread_cond_destroy(&c->c);
+}
+
+uint64_t plat_atomic_add_u64(volatile uint64_t *p, uint64_t delta) {
+    return __atomic_add_fetch(p, delta, __ATOMIC_SEQ_CST);
+}
+
+uint64_t plat_atomic_load_u64(volatile uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+int plat_atomic_cas_u64(volatile uint64_t *p, uint64_t expected, uint64_t desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+uint32_t plat_atomic_add_u32(volatile uint32_t *p, uint32_t delta) {
+    return __atomic_add_fetch(p, delta, __ATOMIC_SEQ_CST);
+}
+
+uint32_t plat_atomic_load_u32(volatile uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+void plat_atomic_store_u32(volatile uint32_t *p, uint32_t value) {
+    __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+int plat_atomic_cas_u32(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void *plat_atomic_load_ptr(void *volatile *p) {
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+int plat_atomic_cas_ptr(void *volatile *p, void *expected, void *desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void plat_yield(void) {
+    sched_yield();
+}
+
+uint64_t plat_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t plat_wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+void plat_sleep_ms(unsigned ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+uint64_t plat_process_id(void) {
+    return (uint64_t)getpid();
+}
+
+int plat_make_dir(const char *path) {
+    if (mkdir(path, 0700) == 0 || errno == EEXIST) return 0;
+    return -1;
+}
+
+int plat_list_dir(const char *dir, plat_dir_fn fn, void *ctx) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    int rc = 0;
+    struct dirent *e;
+    while (rc == 0 && (e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        rc = fn(e->d_name, ctx);
+    }
+    closedir(d);
+    return rc;
+}
+
+int plat_map_file(plat_map_t *m, const char *path) {
+    m->data = NULL;
+    m->size = 0;
+    m->handle = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+    m->data = data;
+    m->size = (size_t)st.st_size;
+    return 0;
+}
+
+void plat_unmap_file(plat_map_t *m) {
+    if (m->data) munmap((void *)m->data, m->size);
+    m->data = NULL;
+    m->size = 0;
+}
+
+int plat_file_id(const char *path, uint64_t *out_id) {
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    *out_id = ((uint64_t)st.st_dev << 48) ^ (uint64_t)st.st_ino;
+    return 0;
+}
+
+int plat_replace_file(const char *from, const char *to) {
+    return rename(from, to) == 0 ? 0 : -1;
+}
+
+int plat_fsync_file(FILE *f) {
+    if (fflush(f) != 0) return -1;
+    return fsync(fileno(f)) == 0 ? 0 : -1;
+}
+
+int plat_fsync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) return -1;
+    int rc = fsync(fd) == 0 ? 0 : -1;
+    close(fd);
+    return rc;
+}
+
+int plat_open_write(const char *path, int flags) {
+    int oflags = O_WRONLY | O_CREAT | ((flags & PLAT_OPEN_TRUNC) ? O_TRUNC : 0);
+    if (flags & PLAT_OPEN_DIRECT) {
+#ifdef O_DIRECT
+        oflags |= O_DIRECT;
+#else
+        return -1;
+#endif
+    }
+    int fd;
+    do {
+        fd = open(path, oflags, 0600);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+int plat_preallocate(int fd, uint64_t size) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= size) return 0;
+    /* posix_fallocate returns the error instead of setting errno. */
+    int rc;
+    do {
+        rc = posix_fallocate(fd, 0, (off_t)size);
+    } while (rc == EINTR);
+    if (rc == 0) return 0;
+    /* Filesystems without fallocate still get the final size up front. */
+    return ftruncate(fd, (off_t)size) == 0 ? 0 : -1;
+}
+
+int plat_pwrite(int fd, const void *buf, size_t len, uint64_t off) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        off += (uint64_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int plat_fdatasync(int fd) {
+    int rc;
+    do {
+        rc = fdatasync(fd);
+    } while (rc != 0 && errno == EINTR);
+    return rc == 0 ? 0 : -1;
+}
+
+void plat_close_fd(int fd) {
+    close(fd);
+}
+
+int plat_open_read(const char *path) {
+    int fd;
+    do {
+        fd = open(path, O_RDONLY);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+int plat_write(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int plat_sendfile(int out_fd, int in_fd, uint64_t off, uint64_t len) {
+#if defined(__linux__)
+    off_t pos = (off_t)off;
+    while (len > 0) {
+        ssize_t n = sendfile(out_fd, in_fd, &pos, len > 0x40000000u ? 0x40000000u : (size_t)len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; /* e.g. EINVAL for an fd sendfile cannot target: copy the rest */
+        len -= (uint64_t)n;
+    }
+    if (len == 0) return 1;
+    off = (uint64_t)pos;
+#endif
+    char buf[1 << 16];
+    while (len > 0) {
+        ssize_t n = pread(in_fd, buf, len < sizeof(buf) ? (size_t)len : sizeof(buf), (off_t)off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || plat_write(out_fd, buf, (size_t)n) != 0) return -1;
+        off += (uint64_t)n;
+        len -= (uint64_t)n;
+    }
+    return 0;
+}
+
+int plat_fork_child(plat_child_t *child, plat_child_fn fn, void *arg) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        uint64_t start = plat_now_ns();
+        int rc = fn(arg);
+        uint64_t run_ns = plat_now_ns() - start;
+        ssize_t w = write(fds[1], &run_ns, sizeof(run_ns));
+        (void)w;
+        /* _exit: the parent's stdio buffers must not be flushed twice. */
+        _exit(rc & 0xff);
+    }
+    close(fds[1]);
+    child->pid = (long)pid;
+    child->fd = fds[0];
+    child->run_ns = 0;
+    return 0;
+}
+
+int plat_atfork(void (*prepare)(void), void (*parent)(void), void (*child)(void)) {
+    return pthread_atfork(prepare, parent, child) == 0 ? 0 : -1;
+}
+
+int plat_child_poll(plat_child_t *child, int wait, int *out_status) {
+    int status = 0;
+    pid_t r;
+    do {
+        r = waitpid((pid_t)child->pid, &status, wait ? 0 : WNOHANG);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0) return 0;
+    if (r < 0) return -1;
+    uint64_t run_ns = 0;
+    if (read(child->fd, &run_ns, sizeof(run_ns)) == (ssize_t)sizeof(run_ns)) child->run_ns = run_ns;
+    close(child->fd);
+    child->fd = -1;
+    child->pid = -1;
+    *out_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return 1;
+}
+
+int plat_child_kill(plat_child_t *child) {
+    return kill((pid_t)child->pid, SIGKILL) == 0 ? 0 : -1;
+}
+
+#endif
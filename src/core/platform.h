@@ -0,0 +1,139 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Thin portability layer: threads, locks, monotonic clock, read-only file
+ * mapping. POSIX builds use pthreads and mmap; Windows builds map onto the
+ * Win32 primitives. */
+
+#ifdef _WIN32
+typedef struct { void *handle; } plat_thread_t;
+typedef struct { void *opaque[6]; } plat_mutex_t; /* CRITICAL_SECTION storage */
+typedef struct { void *opaque[1]; } plat_cond_t;  /* CONDITION_VARIABLE storage */
+#else
+#include <pthread.h>
+typedef struct { pthread_t handle; } plat_thread_t;
+typedef struct { pthread_mutex_t m; } plat_mutex_t;
+typedef struct { pthread_cond_t c; } plat_cond_t;
+#endif
+
+/* MSVC's C11 mode has no _Thread_local. */
+#ifdef _MSC_VER
+#define PLAT_THREAD_LOCAL __declspec(thread)
+#else
+#define PLAT_THREAD_LOCAL _Thread_local
+#endif
+
+typedef void *(*plat_thread_fn)(void *arg);
+
+int plat_thread_create(plat_thread_t *t, plat_thread_fn fn, void *arg);
+int plat_thread_join(plat_thread_t *t);
+uint64_t plat_thread_id(void);
+unsigned plat_cpu_count(void);
+
+int plat_mutex_init(plat_mutex_t *m);
+void plat_mutex_lock(plat_mutex_t *m);
+void plat_mutex_unlock(plat_mutex_t *m);
+void plat_mutex_destroy(plat_mutex_t *m);
+
+int plat_cond_init(plat_cond_t *c);
+void plat_cond_wait(plat_cond_t *c, plat_mutex_t *m);
+void plat_cond_signal(plat_cond_t *c);
+void plat_cond_broadcast(plat_cond_t *c);
+void plat_cond_destroy(plat_cond_t *c);
+
+/* Sequentially consistent 64-bit atomics on plain aligned words. */
+uint64_t plat_atomic_add_u64(volatile uint64_t *p, uint64_t delta); /* returns the new value */
+uint64_t plat_atomic_load_u64(volatile uint64_t *p);
+int plat_atomic_cas_u64(volatile uint64_t *p, uint64_t expected, uint64_t desired);
+uint32_t plat_atomic_add_u32(volatile uint32_t *p, uint32_t delta); /* returns the new value */
+uint32_t plat_atomic_load_u32(volatile uint32_t *p);
+void plat_atomic_store_u32(volatile uint32_t *p, uint32_t value);
+int plat_atomic_cas_u32(volatile uint32_t *p, uint32_t expected, uint32_t desired);
+void *plat_atomic_load_ptr(void *volatile *p);
+int plat_atomic_cas_ptr(void *volatile *p, void *expected, void *desired);
+void plat_yield(void); /* gives up the rest of the time slice, for spin-waits */
+
+/* Hint to pull the cache line at p in for reading. */
+#if defined(__GNUC__) || defined(__clang__)
+#define PLAT_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define PLAT_PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define PLAT_PREFETCH(p) ((void)(p))
+#endif
+
+uint64_t plat_now_ns(void);
+uint64_t plat_wall_us(void); /* microseconds since the Unix epoch */
+void plat_sleep_ms(unsigned ms);
+uint64_t plat_process_id(void);
+
+/* Read-only view of a whole file. The mapping stays valid after the file is
+ * renamed over or unlinked, which is what lets readers keep serving an old
+ * generation while a new one is installed. */
+typedef struct {
+    const void *data;
+    size_t size;
+    void *handle;
+} plat_map_t;
+
+int plat_map_file(plat_map_t *m, const char *path);
+void plat_unmap_file(plat_map_t *m);
+/* Identity of the file currently at path; changes whenever it is replaced. */
+int plat_file_id(const char *path, uint64_t *out_id);
+/* Atomically replaces to with from (rename over an existing file). */
+int plat_replace_file(const char *from, const char *to);
+/* Flushes stdio buffers and forces the file's data to stable storage. */
+int plat_fsync_file(FILE *f);
+/* Makes renames and creations in dir durable; a no-op where unsupported. */
+int plat_fsync_dir(const char *dir);
+
+/* Raw descriptors for callers that manage their own buffering and offsets.
+ * PLAT_OPEN_DIRECT bypasses the page cache (buffers, offsets and lengths
+ * must then be PLAT_DIRECT_ALIGN-aligned) and fails where unsupported. */
+enum { PLAT_OPEN_TRUNC = 1, PLAT_OPEN_DIRECT = 2 };
+#define PLAT_DIRECT_ALIGN 4096u
+int plat_open_write(const char *path, int flags); /* creates if missing; -1 on error */
+/* Reserves blocks up to size so later writes neither allocate nor grow the
+ * file. */
+int plat_preallocate(int fd, uint64_t size);
+int plat_pwrite(int fd, const void *buf, size_t len, uint64_t off); /* 0 once all len bytes are written */
+int plat_fdatasync(int fd);
+void plat_close_fd(int fd);
+int plat_open_read(const char *path); /* -1 on error */
+/* Sequential write at the current position (pipes and sockets too). */
+int plat_write(int fd, const void *buf, size_t len); /* 0 once all len bytes are written */
+/* Copies len bytes of in_fd starting at off to out_fd's current position.
+ * Returns 1 when the kernel moved the data (sendfile), 0 when it went
+ * through a user buffer, -1 on error. */
+int plat_sendfile(int out_fd, int in_fd, uint64_t off, uint64_t len);
+
+int plat_make_dir(const char *path); /* succeeds if it already exists */
+/* Calls fn for every entry name in dir except "." and ".."; stops early and
+ * returns fn's value if it is non-zero. */
+typedef int (*plat_dir_fn)(const char *name, void *ctx);
+int plat_list_dir(const char *dir, plat_dir_fn fn, void *ctx);
+
+/* Runs fn(arg) in a forked copy-on-write child that exits with fn's return
+ * value. Returns -1 where fork is unavailable (Windows); callers fall back
+ * to doing the work inline. */
+typedef int (*plat_child_fn)(void *arg);
+typedef struct {
+    long pid;
+    int fd;          /* pipe carrying the child's run time */
+    uint64_t run_ns; /* set by plat_child_poll once the child is reaped */
+} plat_child_t;
+
+int plat_fork_child(plat_child_t *child, plat_child_fn fn, void *arg);
+/* Handlers run around every fork (pthread_atfork): prepare in the parent
+ * before it, parent and child in each process after it. A lock another
+ * thread may hold at fork time is taken in prepare and released in both,
+ * or a child that needs it deadlocks. A no-op where fork is unavailable. */
+int plat_atfork(void (*prepare)(void), void (*parent)(void), void (*child)(void));
+/* Returns 1 once the child has exited (exit code in *out_status), 0 while
+ * it runs (only when wait is 0), -1 on error. */
+int plat_child_poll(plat_child_t *child, int wait, int *out_status);
+/* Kills the child outright (SIGKILL) without reaping it. */
+int plat_child_kill(plat_child_t *child);
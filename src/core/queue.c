@@ -1,5 +1,5 @@
 #include "queue.h"
-#include <stdlib.h>
+#include "mem.h"
 
 void queue_init(queue_t *q) {
     q->head = NULL;
@@ -8,7 +8,7 @@ void queue_init(queue_t *q) {
 }
 
 int queue_enqueue(queue_t *q, void *data) {
-    queue_node_t *node = (queue_node_t *)malloc(sizeof(queue_node_t));
+    queue_node_t *node = (queue_node_t *)mem_alloc(MEM_TAG_LISTS, sizeof(queue_node_t));
     if (!node) {
         return -1;
     }
@@ -34,7 +34,7 @@ void *queue_dequeue(queue_t *q) {
     if (q->head == NULL) {
         q->tail = NULL;
     }
-    free(node);
+    mem_free(node);
     q->length--;
     return data;
 }
@@ -50,7 +50,7 @@ void queue_clear(queue_t *q, void (*free_fn)(void *)) {
         if (free_fn) {
             free_fn(cur->data);
         }
-        free(cur);
+        mem_free(cur);
         cur = next;
     }
     queue_init(q);
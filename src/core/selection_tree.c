@@ -1,5 +1,5 @@
 #include "selection_tree.h"
-#include <stdlib.h>
+#include "mem.h"
 
 static size_t next_pow2(size_t n) {
     size_t p = 1;
@@ -13,7 +13,7 @@ int selection_tree_build(selection_tree_t *t, const uint64_t *leaves, size_t n)
     t->leaf_count = n;
     size_t base = next_pow2(n);
     t->tree_size = base * 2;
-    t->tree = (uint64_t *)calloc(t->tree_size, sizeof(uint64_t));
+    t->tree = (uint64_t *)mem_calloc(MEM_TAG_MISC, t->tree_size, sizeof(uint64_t));
     if (!t->tree) {
         return -1;
     }
@@ -29,7 +29,7 @@ int selection_tree_build(selection_tree_t *t, const uint64_t *leaves, size_t n)
 }
 
 void selection_tree_free(selection_tree_t *t) {
-    free(t->tree);
+    mem_free(t->tree);
     t->tree = NULL;
     t->leaf_count = 0;
     t->tree_size = 0;
@@ -65,3 +65,78 @@ size_t selection_tree_winner(const selection_tree_t *t) {
     return winner;
 }
 
+/* Does input a win its match against b? */
+static int beats(const loser_tree_t *t, size_t a, size_t b) {
+    if (t->done[a] != t->done[b]) return t->done[b];
+    if (!t->done[a] && t->keys[a] != t->keys[b]) return t->keys[a] < t->keys[b];
+    return a < b;
+}
+
+/* Leaves sit at k..2k-1 and internal nodes at 1..k-1, so any k works. */
+int loser_tree_init(loser_tree_t *t, const uint64_t *keys, const uint8_t *done, size_t k) {
+    t->k = k;
+    t->nodes = (size_t *)mem_calloc(MEM_TAG_MISC, k ? k : 1, sizeof(size_t));
+    t->keys = (uint64_t *)mem_calloc(MEM_TAG_MISC, k ? k : 1, sizeof(uint64_t));
+    t->done = (uint8_t *)mem_calloc(MEM_TAG_MISC, k ? k : 1, 1);
+    size_t *winners = (size_t *)mem_calloc(MEM_TAG_MISC, 2 * k + 1, sizeof(size_t));
+    if (!t->nodes || !t->keys || !t->done || !winners) {
+        mem_free(winners);
+        loser_tree_free(t);
+        return -1;
+    }
+    t->done[0] = 1; /* no inputs: empty from the start */
+    for (size_t i = 0; i < k; i++) {
+        t->keys[i] = keys[i];
+        t->done[i] = done && done[i];
+        winners[k + i] = i;
+    }
+    for (size_t n = k ? k - 1 : 0; n >= 1; n--) {
+        size_t a = winners[2 * n], b = winners[2 * n + 1];
+        int a_wins = beats(t, a, b);
+        winners[n] = a_wins ? a : b;
+        t->nodes[n] = a_wins ? b : a;
+    }
+    t->nodes[0] = k > 1 ? winners[1] : 0;
+    mem_free(winners);
+    return 0;
+}
+
+void loser_tree_free(loser_tree_t *t) {
+    mem_free(t->nodes);
+    mem_free(t->keys);
+    mem_free(t->done);
+    t->nodes = NULL;
+    t->keys = NULL;
+    t->done = NULL;
+    t->k = 0;
+}
+
+size_t loser_tree_winner(const loser_tree_t *t) {
+    return t->nodes[0];
+}
+
+int loser_tree_empty(const loser_tree_t *t) {
+    return t->done[t->nodes[0]];
+}
+
+static void replay(loser_tree_t *t) {
+    size_t s = t->nodes[0];
+    for (size_t n = (s + t->k) / 2; n >= 1; n /= 2) {
+        if (beats(t, t->nodes[n], s)) {
+            size_t w = t->nodes[n];
+            t->nodes[n] = s;
+            s = w;
+        }
+    }
+    t->nodes[0] = s;
+}
+
+void loser_tree_replace(loser_tree_t *t, uint64_t key) {
+    t->keys[t->nodes[0]] = key;
+    replay(t);
+}
+
+void loser_tree_finish(loser_tree_t *t) {
+    t->done[t->nodes[0]] = 1;
+    replay(t);
+}
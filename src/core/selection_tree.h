@@ -13,3 +13,26 @@ void selection_tree_free(selection_tree_t *t);
 int selection_tree_update(selection_tree_t *t, size_t index, uint64_t value);
 size_t selection_tree_winner(const selection_tree_t *t);
 
+/* Loser tree for k-way merges. Leaf i holds the current key of input i;
+ * each internal node keeps the input that lost the match played there, and
+ * the overall winner (smallest key, lower index on ties) is kept apart. When
+ * the winner's input advances, only the matches on its leaf-to-root path
+ * are replayed: log2(k) comparisons, against losers already in place, with
+ * no sibling lookups. Inputs that run out sort after every key. */
+typedef struct {
+    size_t k;
+    size_t *nodes;   /* nodes[0] = winner, nodes[1..k) = losers */
+    uint64_t *keys;  /* per input */
+    uint8_t *done;   /* per input: exhausted */
+} loser_tree_t;
+
+/* keys[i] is input i's first key; done (may be NULL) marks empty inputs. */
+int loser_tree_init(loser_tree_t *t, const uint64_t *keys, const uint8_t *done, size_t k);
+void loser_tree_free(loser_tree_t *t);
+/* Input holding the smallest key; every input is exhausted once
+ * loser_tree_empty is true. */
+size_t loser_tree_winner(const loser_tree_t *t);
+int loser_tree_empty(const loser_tree_t *t);
+/* The winner's input moved on to key, or ran out. */
+void loser_tree_replace(loser_tree_t *t, uint64_t key);
+void loser_tree_finish(loser_tree_t *t);
@@ -1,15 +1,15 @@
 #include "stack.h"
-#include <stdlib.h>
+#include "mem.h"
 
 int stack_init(ds_stack_t *st, size_t initial_capacity) {
     st->size = 0;
     st->capacity = initial_capacity ? initial_capacity : 4;
-    st->data = (void **)malloc(st->capacity * sizeof(void *));
+    st->data = (void **)mem_alloc(MEM_TAG_MISC, st->capacity * sizeof(void *));
     return st->data ? 0 : -1;
 }
 
 void stack_free(ds_stack_t *st) {
-    free(st->data);
+    mem_free(st->data);
     st->data = NULL;
     st->size = 0;
     st->capacity = 0;
@@ -17,7 +17,7 @@ void stack_free(ds_stack_t *st) {
 
 static int stack_grow(ds_stack_t *st) {
     size_t new_cap = st->capacity * 2;
-    void **new_data = (void **)realloc(st->data, new_cap * sizeof(void *));
+    void **new_data = (void **)mem_realloc(MEM_TAG_MISC, st->data, new_cap * sizeof(void *));
     if (!new_data) {
         return -1;
     }
@@ -0,0 +1,104 @@
+#include "str_pool.h"
+#include "mem.h"
+#include <string.h>
+
+static uint64_t str_hash64(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static int reserve(str_pool_t *pool, size_t extra) {
+    size_t need = (size_t)pool->size + extra;
+    if (need > UINT32_MAX) return -1;
+    if (need <= pool->capacity) return 0;
+    size_t cap = pool->capacity ? pool->capacity : 256;
+    while (cap < need) {
+        cap <<= 1;
+    }
+    if (cap > UINT32_MAX) cap = UINT32_MAX;
+    char *data = (char *)mem_realloc(MEM_TAG_ELECTIONS, pool->data, cap);
+    if (!data) return -1;
+    pool->data = data;
+    pool->capacity = (uint32_t)cap;
+    return 0;
+}
+
+int str_pool_init(str_pool_t *pool, size_t initial_capacity) {
+    pool->data = NULL;
+    pool->size = 0;
+    pool->capacity = 0;
+    if (hash_table_init(&pool->intern, 64) != 0) return -1;
+    if (reserve(pool, initial_capacity ? initial_capacity : 256) != 0) return -1;
+    pool->data[0] = 0; /* ref 0 is the empty string */
+    pool->size = 1;
+    return 0;
+}
+
+void str_pool_free(str_pool_t *pool) {
+    mem_free(pool->data);
+    hash_table_free(&pool->intern);
+    pool->data = NULL;
+    pool->size = 0;
+    pool->capacity = 0;
+}
+
+int str_pool_intern(str_pool_t *pool, const char *s, str_ref_t *out_ref) {
+    if (!*s) {
+        *out_ref = 0;
+        return 0;
+    }
+    uint64_t h = str_hash64(s);
+    int inserted;
+    uint32_t *slot = hash_table_upsert(&pool->intern, h, &inserted);
+    if (!slot) return -1;
+    if (!inserted && strcmp(pool->data + *slot, s) == 0) {
+        *out_ref = *slot;
+        return 0;
+    }
+    size_t len = strlen(s) + 1;
+    if (reserve(pool, len) != 0) {
+        if (inserted) hash_table_delete(&pool->intern, h);
+        return -1;
+    }
+    str_ref_t ref = pool->size;
+    memcpy(pool->data + ref, s, len);
+    pool->size += (uint32_t)len;
+    /* On a 64-bit hash collision the first string keeps the slot and this one
+     * is simply stored un-interned. */
+    if (inserted) *slot = ref;
+    *out_ref = ref;
+    return 0;
+}
+
+int str_pool_add_refs(str_pool_t *pool, const str_ref_t *refs, uint32_t n, uint32_t *out_off) {
+    uint32_t pad = (uint32_t)((sizeof(str_ref_t) - (pool->size % sizeof(str_ref_t))) % sizeof(str_ref_t));
+    size_t bytes = (size_t)n * sizeof(str_ref_t);
+    if (reserve(pool, pad + bytes) != 0) return -1;
+    memset(pool->data + pool->size, 0, pad);
+    pool->size += pad;
+    if (bytes) memcpy(pool->data + pool->size, refs, bytes);
+    *out_off = pool->size;
+    pool->size += (uint32_t)bytes;
+    return 0;
+}
+
+int str_pool_load(str_pool_t *pool, const char *data, uint32_t size) {
+    if (size == 0 || data[0] != 0) return -1;
+    pool->size = 0;
+    if (reserve(pool, size) != 0) return -1;
+    memcpy(pool->data, data, size);
+    pool->size = size;
+    hash_table_free(&pool->intern);
+    return hash_table_init(&pool->intern, 64);
+}
+
+void str_pool_reindex(str_pool_t *pool, str_ref_t ref) {
+    if (ref == 0 || ref >= pool->size) return;
+    int inserted;
+    uint32_t *slot = hash_table_upsert(&pool->intern, str_hash64(pool->data + ref), &inserted);
+    if (slot && inserted) *slot = ref;
+}
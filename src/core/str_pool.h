@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "hash_table.h"
+
+/* Append-only interned string pool. Strings and ref arrays live in one
+ * contiguous buffer and are addressed by 32-bit byte offsets, so the buffer
+ * can be written to disk or mapped back without fix-ups. Offset 0 is always
+ * the empty string. */
+
+typedef uint32_t str_ref_t;
+
+typedef struct {
+    char *data;
+    uint32_t size;
+    uint32_t capacity;
+    hash_table_t intern; /* string hash -> offset; rebuilt, never persisted */
+} str_pool_t;
+
+int str_pool_init(str_pool_t *pool, size_t initial_capacity);
+void str_pool_free(str_pool_t *pool);
+int str_pool_intern(str_pool_t *pool, const char *s, str_ref_t *out_ref);
+/* Stores n refs as a 4-byte aligned array and returns its offset. */
+int str_pool_add_refs(str_pool_t *pool, const str_ref_t *refs, uint32_t n, uint32_t *out_off);
+/* Replaces the contents with a previously saved buffer. The buffer holds
+ * ref arrays as well as strings, so callers re-register each string they
+ * know about with str_pool_reindex to make it internable again. */
+int str_pool_load(str_pool_t *pool, const char *data, uint32_t size);
+void str_pool_reindex(str_pool_t *pool, str_ref_t ref);
+
+static inline const char *str_pool_get(const str_pool_t *pool, str_ref_t ref) {
+    return pool->data + ref;
+}
+
+static inline const str_ref_t *str_pool_refs(const str_pool_t *pool, uint32_t off) {
+    return (const str_ref_t *)(const void *)(pool->data + off);
+}
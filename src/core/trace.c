@@ -0,0 +1,244 @@
+#include "trace.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define TRACE_CHUNK_EVENTS 4096
+#define TRACE_STR_LEN 64
+
+typedef struct {
+    const char *name;
+    const char *key;
+    uint64_t ts_ns;
+    uint64_t u64;
+    char str[TRACE_STR_LEN];
+    char ph;       /* 'B' or 'E' */
+    char arg_kind; /* 0 none, 'u' integer, 's' string */
+} trace_event_t;
+
+typedef struct trace_chunk {
+    trace_event_t events[TRACE_CHUNK_EVENTS];
+    size_t count;
+    struct trace_chunk *next;
+} trace_chunk_t;
+
+/* A thread's buffer lives for the whole process, so its tl_buf never
+ * dangles; shutdown frees only the chunks. busy is set around each append
+ * so shutdown can wait out a span that saw tracing still on. */
+typedef struct trace_buf {
+    uint64_t tid;
+    trace_chunk_t *head;
+    trace_chunk_t *tail;
+    struct trace_buf *next;
+    volatile uint32_t busy;
+} trace_buf_t;
+
+volatile uint32_t trace_on = 0;
+
+static char trace_path[512];
+static uint64_t trace_epoch_ns;
+static plat_mutex_t trace_lock;
+static int trace_lock_ready;
+static trace_buf_t *trace_bufs;
+static PLAT_THREAD_LOCAL trace_buf_t *tl_buf;
+
+int trace_init_from_env(void) {
+    const char *path = getenv("ONLINEVOTE_TRACE");
+    if (!path || !*path) return 0;
+    return trace_init(path);
+}
+
+/* Held across fork so a snapshot child never inherits it locked by a
+ * thread that does not exist there. */
+static void trace_fork_prepare(void) {
+    plat_mutex_lock(&trace_lock);
+}
+
+static void trace_fork_release(void) {
+    plat_mutex_unlock(&trace_lock);
+}
+
+int trace_init(const char *path) {
+    if (plat_atomic_load_u32(&trace_on)) return 0;
+    if (!trace_lock_ready) {
+        if (plat_mutex_init(&trace_lock) != 0) return -1;
+        if (plat_atfork(trace_fork_prepare, trace_fork_release, trace_fork_release) != 0) return -1;
+        trace_lock_ready = 1;
+    }
+    strncpy(trace_path, path, sizeof(trace_path) - 1);
+    trace_epoch_ns = plat_now_ns();
+    plat_atomic_store_u32(&trace_on, 1);
+    return 0;
+}
+
+static trace_buf_t *thread_buf(void) {
+    if (tl_buf) return tl_buf;
+    trace_buf_t *b = (trace_buf_t *)calloc(1, sizeof(trace_buf_t));
+    if (!b) return NULL;
+    b->tid = plat_thread_id();
+    plat_mutex_lock(&trace_lock);
+    b->next = trace_bufs;
+    trace_bufs = b;
+    plat_mutex_unlock(&trace_lock);
+    tl_buf = b;
+    return b;
+}
+
+/* Claims the thread's buffer for one append; NULL when tracing is off.
+ * busy is set before trace_on is checked again, and shutdown clears
+ * trace_on before it checks busy, so one of the two always sees the other. */
+static trace_buf_t *enter(void) {
+    if (!plat_atomic_load_u32(&trace_on)) return NULL;
+    trace_buf_t *b = thread_buf();
+    if (!b) return NULL;
+    plat_atomic_store_u32(&b->busy, 1);
+    if (!plat_atomic_load_u32(&trace_on)) {
+        plat_atomic_store_u32(&b->busy, 0);
+        return NULL;
+    }
+    return b;
+}
+
+static void leave(trace_buf_t *b) {
+    plat_atomic_store_u32(&b->busy, 0);
+}
+
+static trace_event_t *next_event(trace_buf_t *b) {
+    if (!b->tail || b->tail->count == TRACE_CHUNK_EVENTS) {
+        trace_chunk_t *c = (trace_chunk_t *)malloc(sizeof(trace_chunk_t));
+        if (!c) return NULL;
+        c->count = 0;
+        c->next = NULL;
+        if (b->tail) {
+            b->tail->next = c;
+        } else {
+            b->head = c;
+        }
+        b->tail = c;
+    }
+    trace_event_t *ev = &b->tail->events[b->tail->count++];
+    ev->ts_ns = plat_now_ns();
+    ev->arg_kind = 0;
+    return ev;
+}
+
+void trace_begin(const char *name) {
+    trace_buf_t *b = enter();
+    if (!b) return;
+    trace_event_t *ev = next_event(b);
+    if (ev) {
+        ev->name = name;
+        ev->ph = 'B';
+    }
+    leave(b);
+}
+
+void trace_begin_u64(const char *name, const char *key, uint64_t value) {
+    trace_buf_t *b = enter();
+    if (!b) return;
+    trace_event_t *ev = next_event(b);
+    if (ev) {
+        ev->name = name;
+        ev->ph = 'B';
+        ev->key = key;
+        ev->u64 = value;
+        ev->arg_kind = 'u';
+    }
+    leave(b);
+}
+
+void trace_begin_str(const char *name, const char *key, const char *value) {
+    trace_buf_t *b = enter();
+    if (!b) return;
+    trace_event_t *ev = next_event(b);
+    if (ev) {
+        ev->name = name;
+        ev->ph = 'B';
+        ev->key = key;
+        strncpy(ev->str, value ? value : "", TRACE_STR_LEN - 1);
+        ev->str[TRACE_STR_LEN - 1] = 0;
+        ev->arg_kind = 's';
+    }
+    leave(b);
+}
+
+void trace_end(const char *name) {
+    trace_buf_t *b = enter();
+    if (!b) return;
+    trace_event_t *ev = next_event(b);
+    if (ev) {
+        ev->name = name;
+        ev->ph = 'E';
+    }
+    leave(b);
+}
+
+static void write_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', f);
+            fputc(c, f);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void write_event(FILE *f, const trace_event_t *ev, uint64_t pid, uint64_t tid, int first) {
+    uint64_t rel = ev->ts_ns - trace_epoch_ns;
+    fprintf(f, "%s\n{\"name\":", first ? "" : ",");
+    write_json_string(f, ev->name);
+    fprintf(f, ",\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03u,\"pid\":%" PRIu64 ",\"tid\":%" PRIu64,
+            ev->ph, rel / 1000, (unsigned)(rel % 1000), pid, tid);
+    if (ev->arg_kind) {
+        fputs(",\"args\":{", f);
+        write_json_string(f, ev->key);
+        fputc(':', f);
+        if (ev->arg_kind == 'u') {
+            fprintf(f, "%" PRIu64, ev->u64);
+        } else {
+            write_json_string(f, ev->str);
+        }
+        fputc('}', f);
+    }
+    fputc('}', f);
+}
+
+/* Drains every buffer under the registry lock. A span still being
+ * appended is waited out; spans started later see tracing off. */
+void trace_shutdown(void) {
+    if (!plat_atomic_load_u32(&trace_on)) return;
+    plat_atomic_store_u32(&trace_on, 0);
+    FILE *f = fopen(trace_path, "w");
+    uint64_t pid = plat_process_id();
+    int first = 1;
+    if (f) fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+    plat_mutex_lock(&trace_lock);
+    for (trace_buf_t *b = trace_bufs; b; b = b->next) {
+        while (plat_atomic_load_u32(&b->busy)) plat_yield();
+        trace_chunk_t *c = b->head;
+        while (c) {
+            trace_chunk_t *cnext = c->next;
+            for (size_t i = 0; f && i < c->count; i++) {
+                write_event(f, &c->events[i], pid, b->tid, first);
+                first = 0;
+            }
+            free(c);
+            c = cnext;
+        }
+        b->head = NULL;
+        b->tail = NULL;
+    }
+    plat_mutex_unlock(&trace_lock);
+    if (f) {
+        fputs("\n]}\n", f);
+        fclose(f);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+/* Span tracing in Chrome trace-event format (loadable in chrome://tracing
+ * and Perfetto). Set ONLINEVOTE_TRACE=<path> to enable; every call returns
+ * immediately when tracing is off. Each thread records into its own
+ * buffer, so spans never take a lock after the first event on a thread.
+ * Names and argument keys must be string literals (they are stored by
+ * pointer); string argument values are copied. */
+
+extern volatile uint32_t trace_on; /* read with plat_atomic_load_u32 */
+
+int trace_init_from_env(void);
+int trace_init(const char *path);
+/* Writes the JSON file. Threads may still be running: a span in progress
+ * is waited for, and later ones are dropped until the next trace_init. */
+void trace_shutdown(void);
+
+void trace_begin(const char *name);
+void trace_begin_u64(const char *name, const char *key, uint64_t value);
+void trace_begin_str(const char *name, const char *key, const char *value);
+void trace_end(const char *name);
@@ -3,8 +3,8 @@
 #include <time.h>
 
 #define TITLE_LEN 128
-#define DESC_LEN 512
-#define MAX_CAND 128
+#define DESC_LEN 512 /* longest description accepted on input */
+#define CAND_NAME_LEN 64 /* longest candidate name accepted on input */
 
 typedef enum {
     ELECTION_CREATED,
@@ -14,14 +14,16 @@ typedef enum {
     TALLY_COMPLETE
 } election_phase_t;
 
+/* Description and candidate names live in the app's string pool; the record
+ * keeps only offsets, so it stays small and fixed-size on disk. */
 typedef struct {
     uint64_t id;
     char title[TITLE_LEN];
-    char description[DESC_LEN];
     election_phase_t phase;
     time_t start_time;
     time_t end_time;
+    uint32_t description;     /* str_ref_t into the string pool */
     uint32_t candidate_count;
-    char candidates[MAX_CAND][64];
+    uint32_t candidates;      /* pool offset of candidate_count str_ref_t */
+    uint32_t eligible_groups; /* user group bits allowed to vote; 0 = everyone */
 } election_rec_t;
-
@@ -2,18 +2,27 @@
 #include <stdint.h>
 
 #define MAX_NAME 64
+#define EMAIL_LEN 128
 #define SALT_LEN 16
 #define HASH_LEN 32
 
 typedef enum { ROLE_VOTER, ROLE_ADMIN } role_t;
 
+#define USER_FLAG_ADMIN  0x1u
+#define USER_FLAG_ACTIVE 0x2u
+
+/* Hot half of a user: everything login and eligibility checks touch,
+ * packed into one 64-byte cache line. */
 typedef struct {
     uint64_t id;
-    char name[MAX_NAME];
-    char email[128];
-    role_t role;
+    uint32_t flags;  /* USER_FLAG_* */
+    uint32_t groups; /* eligibility group bits; 0 = no group */
     uint8_t salt[SALT_LEN];
     uint8_t pass_hash[HASH_LEN];
-    uint8_t active;
-} user_rec_t;
+} user_auth_t;
 
+/* Cold half: profile data only needed for display and export. */
+typedef struct {
+    char name[MAX_NAME];
+    char email[EMAIL_LEN];
+} user_profile_t;
@@ -0,0 +1,431 @@
+#define _GNU_SOURCE
+#include "aio.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_RW_CUR_POS /* the header knows IORING_OP_WRITE */
+#define AIO_HAVE_URING 1
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+#endif
+
+#define AIO_POOL_THREADS 2u
+
+/* Runs one chain of linked ops in order; after a failure the rest of the
+ * chain is cancelled, matching io_uring's IOSQE_IO_LINK. */
+static void run_chain(const aio_op_t *ops, uint32_t n, aio_completion_t *out) {
+    int failed = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        out[i].tag = ops[i].tag;
+        if (failed) {
+            out[i].result = -1;
+            continue;
+        }
+        if (ops[i].opcode == AIO_OP_WRITE) {
+            out[i].result = plat_pwrite(ops[i].fd, ops[i].buf, ops[i].len, ops[i].off) == 0 ? (int64_t)ops[i].len : -1;
+        } else {
+            out[i].result = plat_fdatasync(ops[i].fd) == 0 ? 0 : -1;
+        }
+        if (out[i].result < 0) failed = 1;
+    }
+}
+
+/* --- thread pool (and the inline sync engine, which is a pool with no
+ * threads) --- */
+
+typedef struct {
+    plat_mutex_t lock;
+    plat_cond_t work_cv;
+    plat_cond_t done_cv;
+    aio_op_t *ops; /* submitted ops not yet picked up, a ring */
+    uint32_t ops_head, ops_count;
+    aio_completion_t *done; /* finished ops not yet reaped, a ring */
+    uint32_t done_head, done_count;
+    uint32_t cap;
+    unsigned thread_count;
+    plat_thread_t threads[AIO_POOL_THREADS];
+    int stop;
+} pool_t;
+
+static uint32_t pool_take_chain(pool_t *p, aio_op_t *chain) {
+    uint32_t n = 0;
+    while (p->ops_count > 0) {
+        chain[n] = p->ops[p->ops_head];
+        p->ops_head = (p->ops_head + 1) % p->cap;
+        p->ops_count--;
+        if (!chain[n++].link) break;
+    }
+    return n;
+}
+
+static void pool_put_done(pool_t *p, const aio_completion_t *res, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        p->done[(p->done_head + p->done_count) % p->cap] = res[i];
+        p->done_count++;
+    }
+}
+
+static void *pool_worker(void *arg) {
+    pool_t *p = (pool_t *)arg;
+    aio_op_t chain[AIO_MAX_OPS];
+    aio_completion_t res[AIO_MAX_OPS];
+    plat_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->stop && p->ops_count == 0) plat_cond_wait(&p->work_cv, &p->lock);
+        if (p->ops_count == 0) break;
+        uint32_t n = pool_take_chain(p, chain);
+        plat_mutex_unlock(&p->lock);
+        run_chain(chain, n, res);
+        plat_mutex_lock(&p->lock);
+        pool_put_done(p, res, n);
+        plat_cond_broadcast(&p->done_cv);
+    }
+    plat_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void pool_destroy(pool_t *p) {
+    plat_mutex_lock(&p->lock);
+    p->stop = 1;
+    plat_cond_broadcast(&p->work_cv);
+    plat_mutex_unlock(&p->lock);
+    for (unsigned i = 0; i < p->thread_count; i++) plat_thread_join(&p->threads[i]);
+    plat_cond_destroy(&p->done_cv);
+    plat_cond_destroy(&p->work_cv);
+    plat_mutex_destroy(&p->lock);
+    mem_free(p->ops);
+    mem_free(p->done);
+    mem_free(p);
+}
+
+static pool_t *pool_create(unsigned depth, unsigned threads) {
+    pool_t *p = (pool_t *)mem_calloc(MEM_TAG_WAL, 1, sizeof(pool_t));
+    if (!p) return NULL;
+    p->cap = depth;
+    p->ops = (aio_op_t *)mem_alloc(MEM_TAG_WAL, depth * sizeof(aio_op_t));
+    p->done = (aio_completion_t *)mem_alloc(MEM_TAG_WAL, depth * sizeof(aio_completion_t));
+    if (!p->ops || !p->done || plat_mutex_init(&p->lock) != 0) {
+        mem_free(p->ops);
+        mem_free(p->done);
+        mem_free(p);
+        return NULL;
+    }
+    plat_cond_init(&p->work_cv);
+    plat_cond_init(&p->done_cv);
+    for (; p->thread_count < threads; p->thread_count++) {
+        if (plat_thread_create(&p->threads[p->thread_count], pool_worker, p) != 0) {
+            pool_destroy(p);
+            return NULL;
+        }
+    }
+    return p;
+}
+
+static int pool_submit(pool_t *p, const aio_op_t *ops, uint32_t n) {
+    if (p->thread_count == 0) {
+        aio_completion_t res[AIO_MAX_OPS];
+        for (uint32_t i = 0; i < n;) {
+            uint32_t len = 1;
+            while (ops[i + len - 1].link && i + len < n) len++;
+            run_chain(ops + i, len, res);
+            pool_put_done(p, res, len);
+            i += len;
+        }
+        return (int)n;
+    }
+    plat_mutex_lock(&p->lock);
+    for (uint32_t i = 0; i < n; i++) {
+        p->ops[(p->ops_head + p->ops_count) % p->cap] = ops[i];
+        p->ops_count++;
+    }
+    plat_cond_broadcast(&p->work_cv);
+    plat_mutex_unlock(&p->lock);
+    return (int)n;
+}
+
+static int pool_reap(pool_t *p, aio_completion_t *out, unsigned max, unsigned min) {
+    plat_mutex_lock(&p->lock);
+    while (p->done_count < min) plat_cond_wait(&p->done_cv, &p->lock);
+    unsigned n = 0;
+    for (; n < max && p->done_count > 0; n++) {
+        out[n] = p->done[p->done_head];
+        p->done_head = (p->done_head + 1) % p->cap;
+        p->done_count--;
+    }
+    plat_mutex_unlock(&p->lock);
+    return (int)n;
+}
+
+/* --- io_uring --- */
+
+#ifdef AIO_HAVE_URING
+
+typedef struct {
+    int fd;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_len, cq_ring_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Completions taken off the ring while submitting, handed out by the
+     * next reap. */
+    aio_completion_t stash[AIO_MAX_OPS];
+    unsigned stash_count;
+} uring_t;
+
+static void uring_destroy(uring_t *u) {
+    if (u->sqes) munmap(u->sqes, u->sqes_len);
+    if (u->cq_ring && u->cq_ring != u->sq_ring) munmap(u->cq_ring, u->cq_ring_len);
+    if (u->sq_ring) munmap(u->sq_ring, u->sq_ring_len);
+    if (u->fd >= 0) close(u->fd);
+    mem_free(u);
+}
+
+static void *ring_map(int fd, size_t len, off_t off) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, off);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static uring_t *uring_create(unsigned depth) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+    if (fd < 0) return NULL; /* old kernel, or disabled by policy */
+    uring_t *u = (uring_t *)mem_calloc(MEM_TAG_WAL, 1, sizeof(uring_t));
+    if (!u) {
+        close(fd);
+        return NULL;
+    }
+    u->fd = fd;
+    /* IORING_OP_WRITE arrived in the same release as this feature bit. */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        uring_destroy(u);
+        return NULL;
+    }
+    u->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    u->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_len > u->sq_ring_len) u->sq_ring_len = u->cq_ring_len;
+        u->sq_ring = ring_map(fd, u->sq_ring_len, IORING_OFF_SQ_RING);
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->sq_ring = ring_map(fd, u->sq_ring_len, IORING_OFF_SQ_RING);
+        u->cq_ring = ring_map(fd, u->cq_ring_len, IORING_OFF_CQ_RING);
+    }
+    u->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = (struct io_uring_sqe *)ring_map(fd, u->sqes_len, IORING_OFF_SQES);
+    if (!u->sq_ring || !u->cq_ring || !u->sqes) {
+        uring_destroy(u);
+        return NULL;
+    }
+    uint8_t *sq = (uint8_t *)u->sq_ring, *cq = (uint8_t *)u->cq_ring;
+    u->sq_tail = (unsigned *)(void *)(sq + params.sq_off.tail);
+    u->sq_mask = (unsigned *)(void *)(sq + params.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(void *)(sq + params.sq_off.array);
+    u->cq_head = (unsigned *)(void *)(cq + params.cq_off.head);
+    u->cq_tail = (unsigned *)(void *)(cq + params.cq_off.tail);
+    u->cq_mask = (unsigned *)(void *)(cq + params.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(void *)(cq + params.cq_off.cqes);
+    return u;
+}
+
+/* Moves up to max completions off the CQ ring. */
+static unsigned uring_take(uring_t *u, aio_completion_t *out, unsigned max) {
+    unsigned n = 0;
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail && n < max; head++, n++) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        out[n].tag = cqe->user_data;
+        out[n].result = cqe->res;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+/* The kernel refused more SQEs (-EAGAIN) or its completion ring is full
+ * (-EBUSY): stash completions to make room, waiting for one when ops are
+ * outstanding, else just let the kernel catch up. */
+static int uring_make_room(uring_t *u, uint32_t in_flight) {
+    unsigned got = uring_take(u, u->stash + u->stash_count, AIO_MAX_OPS - u->stash_count);
+    u->stash_count += got;
+    if (got) return 0;
+    if (in_flight <= u->stash_count) {
+        plat_yield();
+        return 0;
+    }
+    int rc = (int)syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    return rc < 0 && errno != EINTR ? -1 : 0;
+}
+
+/* Returns n once every op is submitted, the number that were if that
+ * stops short on an error, -1 if none were. */
+static int uring_submit(uring_t *u, const aio_op_t *ops, uint32_t n, uint32_t in_flight) {
+    unsigned tail = *u->sq_tail, mask = *u->sq_mask;
+    for (uint32_t i = 0; i < n; i++) {
+        unsigned idx = tail & mask;
+        struct io_uring_sqe *sqe = &u->sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->fd = ops[i].fd;
+        sqe->user_data = ops[i].tag;
+        if (ops[i].link) sqe->flags = IOSQE_IO_LINK;
+        if (ops[i].opcode == AIO_OP_WRITE) {
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->addr = (uint64_t)(uintptr_t)ops[i].buf;
+            sqe->len = ops[i].len;
+            sqe->off = ops[i].off;
+        } else {
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        }
+        u->sq_array[idx] = idx;
+        tail++;
+    }
+    __atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+    /* One syscall normally hands the whole batch to the kernel; it may
+     * take fewer, so keep going until it has them all. */
+    uint32_t done = 0;
+    while (done < n) {
+        int rc = (int)syscall(__NR_io_uring_enter, u->fd, n - done, 0, 0, NULL, 0);
+        if (rc > 0) {
+            done += (uint32_t)rc;
+        } else if (rc < 0 && errno == EINTR) {
+            continue;
+        } else if (rc < 0 && (errno == EAGAIN || errno == EBUSY)) {
+            if (uring_make_room(u, in_flight + done) != 0) break;
+        } else {
+            break;
+        }
+    }
+    return done ? (int)done : -1;
+}
+
+static int uring_reap(uring_t *u, aio_completion_t *out, unsigned max, unsigned min) {
+    unsigned n = u->stash_count < max ? u->stash_count : max;
+    memcpy(out, u->stash, n * sizeof(*out));
+    memmove(u->stash, u->stash + n, (u->stash_count - n) * sizeof(*out));
+    u->stash_count -= n;
+    for (;;) {
+        n += uring_take(u, out + n, max - n);
+        if (n >= min) return (int)n;
+        int rc = (int)syscall(__NR_io_uring_enter, u->fd, 0, min - n, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0 && errno != EINTR) return n ? (int)n : -1;
+    }
+}
+
+#endif
+
+/* --- dispatch --- */
+
+int aio_init(aio_t *aio, aio_kind_t kind, unsigned depth) {
+    memset(aio, 0, sizeof(*aio));
+    if (depth < 2) depth = 2;
+    if (depth > AIO_MAX_OPS) depth = AIO_MAX_OPS;
+    aio->depth = depth;
+#ifdef AIO_HAVE_URING
+    if (kind == AIO_AUTO || kind == AIO_URING) {
+        aio->impl = uring_create(depth);
+        if (aio->impl) {
+            aio->kind = AIO_URING;
+            return 0;
+        }
+    }
+#endif
+    /* Without io_uring the thread pool stands in for it. */
+    aio->kind = kind == AIO_SYNC ? AIO_SYNC : AIO_THREADS;
+    aio->impl = pool_create(depth, aio->kind == AIO_SYNC ? 0 : AIO_POOL_THREADS);
+    return aio->impl ? 0 : -1;
+}
+
+void aio_free(aio_t *aio) {
+    if (!aio->impl) return;
+    aio_completion_t done[AIO_MAX_OPS];
+    while (aio->in_flight > 0 && aio_reap(aio, done, AIO_MAX_OPS, aio->in_flight) > 0) {
+    }
+#ifdef AIO_HAVE_URING
+    if (aio->kind == AIO_URING) {
+        uring_destroy((uring_t *)aio->impl);
+        aio->impl = NULL;
+        return;
+    }
+#endif
+    pool_destroy((pool_t *)aio->impl);
+    aio->impl = NULL;
+}
+
+aio_kind_t aio_kind_from_name(const char *name) {
+    if (!name) return AIO_AUTO;
+    if (strcmp(name, "uring") == 0) return AIO_URING;
+    if (strcmp(name, "threads") == 0) return AIO_THREADS;
+    if (strcmp(name, "sync") == 0) return AIO_SYNC;
+    return AIO_AUTO;
+}
+
+const char *aio_kind_name(aio_kind_t kind) {
+    switch (kind) {
+    case AIO_URING: return "io_uring";
+    case AIO_THREADS: return "threads";
+    case AIO_SYNC: return "sync";
+    default: return "auto";
+    }
+}
+
+static int aio_queue(aio_t *aio, const aio_op_t *op) {
+    if (aio->queued_count + aio->in_flight >= aio->depth) return -1;
+    aio->queued[aio->queued_count++] = *op;
+    return 0;
+}
+
+int aio_queue_write(aio_t *aio, int fd, const void *buf, uint32_t len, uint64_t off, uint64_t tag, int link) {
+    aio_op_t op = {AIO_OP_WRITE, (uint8_t)(link != 0), fd, buf, len, off, tag};
+    return aio_queue(aio, &op);
+}
+
+int aio_queue_fdatasync(aio_t *aio, int fd, uint64_t tag, int link) {
+    aio_op_t op = {AIO_OP_FDATASYNC, (uint8_t)(link != 0), fd, NULL, 0, 0, tag};
+    return aio_queue(aio, &op);
+}
+
+int aio_submit(aio_t *aio) {
+    uint32_t n = aio->queued_count;
+    if (n == 0) return 0;
+    int rc;
+#ifdef AIO_HAVE_URING
+    if (aio->kind == AIO_URING) rc = uring_submit((uring_t *)aio->impl, aio->queued, n, aio->in_flight);
+    else
+#endif
+        rc = pool_submit((pool_t *)aio->impl, aio->queued, n);
+    aio->queued_count = 0;
+    if (rc <= 0) return -1;
+    /* Ops that did go out are in flight even if the rest did not. */
+    aio->in_flight += (uint32_t)rc;
+    aio->ops_submitted += (uint32_t)rc;
+    aio->submit_calls++;
+    return rc == (int)n ? rc : -1;
+}
+
+int aio_reap(aio_t *aio, aio_completion_t *out, unsigned max, unsigned min) {
+    if (min > aio->in_flight) min = aio->in_flight;
+    int n;
+#ifdef AIO_HAVE_URING
+    if (aio->kind == AIO_URING) n = uring_reap((uring_t *)aio->impl, out, max, min);
+    else
+#endif
+        n = pool_reap((pool_t *)aio->impl, out, max, min);
+    if (n <= 0) return n;
+    aio->in_flight -= (uint32_t)n;
+    for (int i = 0; i < n; i++) {
+        if (out[i].result < 0) aio->ops_failed++;
+    }
+    return n;
+}
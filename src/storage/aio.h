@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+
+/* Asynchronous write engine. Callers queue writes and fdatasyncs, hand the
+ * whole batch over with one aio_submit and reap completions later. An
+ * operation queued with link set lets the next queued one start only after
+ * it succeeds; a failure cancels the rest of the chain, so write+fdatasync
+ * goes out as one unit.
+ *   AIO_URING    io_uring through raw syscalls (Linux 5.6+)
+ *   AIO_THREADS  worker threads issuing pwrite/fdatasync
+ *   AIO_SYNC     each chain runs inside aio_submit
+ * AIO_AUTO picks io_uring when the kernel allows it, else the thread pool. */
+
+typedef enum { AIO_AUTO = 0, AIO_URING, AIO_THREADS, AIO_SYNC } aio_kind_t;
+
+#define AIO_MAX_OPS 64u
+
+enum { AIO_OP_WRITE = 1, AIO_OP_FDATASYNC };
+
+typedef struct {
+    uint8_t opcode;
+    uint8_t link;
+    int fd;
+    const void *buf; /* must stay valid until the op completes */
+    uint32_t len;
+    uint64_t off;
+    uint64_t tag;
+} aio_op_t;
+
+typedef struct {
+    uint64_t tag;
+    int64_t result; /* bytes written, 0 after a sync, negative on error or cancel */
+} aio_completion_t;
+
+typedef struct {
+    aio_kind_t kind; /* engine in use */
+    unsigned depth;  /* queued plus in-flight ops never exceed this */
+    aio_op_t queued[AIO_MAX_OPS];
+    uint32_t queued_count;
+    uint32_t in_flight;
+    void *impl;
+    /* metrics */
+    uint64_t ops_submitted;
+    uint64_t submit_calls;
+    uint64_t ops_failed;
+} aio_t;
+
+int aio_init(aio_t *aio, aio_kind_t kind, unsigned depth);
+void aio_free(aio_t *aio); /* waits for in-flight ops */
+aio_kind_t aio_kind_from_name(const char *name); /* NULL or unknown gives AIO_AUTO */
+const char *aio_kind_name(aio_kind_t kind);
+
+int aio_queue_write(aio_t *aio, int fd, const void *buf, uint32_t len, uint64_t off, uint64_t tag, int link);
+int aio_queue_fdatasync(aio_t *aio, int fd, uint64_t tag, int link);
+/* Returns the number of ops handed to the engine, -1 on error. */
+int aio_submit(aio_t *aio);
+/* Collects up to max completions, blocking until at least min (capped at
+ * the in-flight count) have arrived. Returns the number collected. */
+int aio_reap(aio_t *aio, aio_completion_t *out, unsigned max, unsigned min);
@@ -0,0 +1,98 @@
+#include "atomic_file.h"
+#include "checksum.h"
+#include "../core/crc32c.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include <stdarg.h>
+#include <string.h>
+
+FILE *atomic_file_open(atomic_file_t *af, const char *path) {
+    memset(af, 0, sizeof(*af));
+    if (strlen(path) >= sizeof(af->path)) return NULL;
+    strcpy(af->path, path);
+    snprintf(af->tmp, sizeof(af->tmp), "%s.tmp", path);
+    af->f = fopen(af->tmp, "wb");
+    if (!af->f) return NULL;
+    af->buf = (char *)mem_alloc(MEM_TAG_MISC, ATOMIC_FILE_BUF);
+    if (af->buf) setvbuf(af->f, af->buf, _IOFBF, ATOMIC_FILE_BUF);
+    return af->f;
+}
+
+static int write_check_line(atomic_file_t *af) {
+    char line[64];
+    int n = checksum_text_line(line, sizeof(line), af->crc, af->block_lines);
+    af->crc = 0;
+    af->block_lines = 0;
+    af->block_bytes = 0;
+    return fwrite(line, 1, (size_t)n, af->f) == (size_t)n ? 0 : -1;
+}
+
+/* Check lines only go after a complete line, so callers may build one
+ * line from several writes. */
+static int write_text(atomic_file_t *af, const char *s, size_t len) {
+    if (!af->f) return -1;
+    af->text = 1;
+    if (len == 0) return 0;
+    if (fwrite(s, 1, len, af->f) != len) {
+        af->failed = 1;
+        return -1;
+    }
+    af->crc = crc32c(af->crc, s, len);
+    af->block_bytes += len;
+    for (const char *p = s; (p = (const char *)memchr(p, '\n', (size_t)(s + len - p))) != NULL; p++) af->block_lines++;
+    af->mid_line = s[len - 1] != '\n';
+    if (!af->mid_line && af->block_lines >= CHECKSUM_TEXT_LINES) return write_check_line(af);
+    return 0;
+}
+
+int atomic_file_printf(atomic_file_t *af, const char *fmt, ...) {
+    char line[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        af->failed = 1;
+        return -1;
+    }
+    if ((size_t)n < sizeof(line)) return write_text(af, line, (size_t)n);
+    char *big = (char *)mem_alloc(MEM_TAG_MISC, (size_t)n + 1);
+    if (!big) {
+        af->failed = 1;
+        return -1;
+    }
+    va_start(ap, fmt);
+    vsnprintf(big, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    int rc = write_text(af, big, (size_t)n);
+    mem_free(big);
+    return rc;
+}
+
+int atomic_file_puts(atomic_file_t *af, const char *s) {
+    return write_text(af, s, strlen(s));
+}
+
+static void release(atomic_file_t *af, int *rc) {
+    if (af->f && fclose(af->f) != 0) *rc = -1;
+    af->f = NULL;
+    mem_free(af->buf); /* only after fclose: stdio still owns it until then */
+    af->buf = NULL;
+}
+
+int atomic_file_commit(atomic_file_t *af) {
+    int rc = af->f && !af->failed && !ferror(af->f) ? 0 : -1;
+    if (rc == 0 && af->mid_line && write_text(af, "\n", 1) != 0) rc = -1;
+    if (rc == 0 && af->text && af->block_bytes > 0 && write_check_line(af) != 0) rc = -1;
+    if (rc == 0 && plat_fsync_file(af->f) != 0) rc = -1;
+    release(af, &rc);
+    if (rc == 0 && plat_replace_file(af->tmp, af->path) != 0) rc = -1;
+    if (rc != 0) remove(af->tmp);
+    return rc;
+}
+
+void atomic_file_abort(atomic_file_t *af) {
+    int rc = 0;
+    release(af, &rc);
+    remove(af->tmp);
+}
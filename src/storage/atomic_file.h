@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Replace-on-commit file writer: output goes to <path>.tmp through a large
+ * stdio buffer; commit fsyncs it and renames it over path, so readers see
+ * either the old file or the complete new one. Callers fsync the directory
+ * (plat_fsync_dir) once after committing a batch of files.
+ *
+ * Text written through atomic_file_printf/atomic_file_puts is framed with
+ * CRC32C check lines (see storage/checksum.h); commit seals the last block.
+ * Raw fwrite output to the returned FILE carries no framing. */
+
+#define ATOMIC_FILE_BUF (1u << 20)
+
+typedef struct {
+    FILE *f;
+    char *buf;
+    char path[256];
+    char tmp[264];
+    int text;             /* check lines are due on commit */
+    uint32_t crc;         /* of the text since the last check line */
+    uint32_t block_lines;
+    size_t block_bytes;
+    int mid_line;         /* the last write did not end a line */
+    int failed;           /* a text write failed; commit refuses */
+} atomic_file_t;
+
+FILE *atomic_file_open(atomic_file_t *af, const char *path);
+int atomic_file_printf(atomic_file_t *af, const char *fmt, ...);
+int atomic_file_puts(atomic_file_t *af, const char *s);
+int atomic_file_commit(atomic_file_t *af);
+void atomic_file_abort(atomic_file_t *af);
@@ -0,0 +1,268 @@
+#include "checksum.h"
+#include "../core/crc32c.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKSUM_RANGE_BLOCKS 64u /* blocks per verify work item: 4 MB */
+#define CHECKSUM_MAX_THREADS 8u
+
+static uint32_t trailer_crc(const checksum_trailer_t *t) {
+    checksum_trailer_t copy = *t;
+    copy.crc = 0;
+    return crc32c(0, &copy, sizeof(copy));
+}
+
+int checksum_seal(FILE *f) {
+    if (fflush(f) != 0 || fseek(f, 0, SEEK_END) != 0) return -1;
+    long end = ftell(f);
+    if (end < 0) return -1;
+    checksum_trailer_t t;
+    memset(&t, 0, sizeof(t));
+    memcpy(t.magic, CHECKSUM_MAGIC, sizeof(CHECKSUM_MAGIC));
+    t.data_size = (uint64_t)end;
+    t.block_size = CHECKSUM_BLOCK;
+    uint64_t blocks = (t.data_size + CHECKSUM_BLOCK - 1) / CHECKSUM_BLOCK;
+    if (blocks > UINT32_MAX) return -1;
+    t.block_count = (uint32_t)blocks;
+    uint32_t *table = (uint32_t *)mem_alloc(MEM_TAG_MISC, (blocks ? blocks : 1) * sizeof(uint32_t));
+    uint8_t *buf = (uint8_t *)mem_alloc(MEM_TAG_MISC, CHECKSUM_BLOCK);
+    int rc = table && buf && fseek(f, 0, SEEK_SET) == 0 ? 0 : -1;
+    for (uint64_t b = 0; rc == 0 && b < blocks; b++) {
+        size_t n = b + 1 < blocks ? CHECKSUM_BLOCK : (size_t)(t.data_size - b * CHECKSUM_BLOCK);
+        if (fread(buf, 1, n, f) != n) rc = -1;
+        else table[b] = crc32c(0, buf, n);
+    }
+    if (rc == 0) {
+        t.table_crc = crc32c(0, table, (size_t)blocks * sizeof(uint32_t));
+        t.crc = trailer_crc(&t);
+        /* A read-to-write switch on an update stream needs a seek. */
+        if (fseek(f, 0, SEEK_END) != 0 || (blocks && fwrite(table, sizeof(uint32_t), (size_t)blocks, f) != blocks) ||
+            fwrite(&t, sizeof(t), 1, f) != 1) {
+            rc = -1;
+        }
+    }
+    mem_free(table);
+    mem_free(buf);
+    return rc;
+}
+
+int checksum_text_line(char *out, size_t len, uint32_t crc, uint32_t lines) {
+    return snprintf(out, len, CHECKSUM_TEXT_PREFIX "%08x,%u\n", (unsigned)crc, (unsigned)lines);
+}
+
+/* One unit of verify work: a range of blocks of a binary file, or a whole
+ * text file (its check lines chain, so it is scanned in one go). */
+typedef struct {
+    checksum_job_t *job;
+    const uint8_t *data;
+    size_t size;
+    uint64_t first, end; /* blocks */
+    uint64_t bad;        /* first failing block in the range, or UINT64_MAX */
+    uint32_t stored, computed;
+} verify_item_t;
+
+typedef struct {
+    verify_item_t *items;
+    uint64_t count;
+    volatile uint64_t next;
+} verify_pool_t;
+
+static void verify_text(verify_item_t *it) {
+    checksum_job_t *job = it->job;
+    const uint8_t *p = it->data, *end = it->data + it->size;
+    const size_t prefix = sizeof(CHECKSUM_TEXT_PREFIX) - 1;
+    uint64_t line = 0, block_first = 1, checks = 0;
+    uint32_t crc = 0, lines = 0;
+    while (p < end) {
+        const uint8_t *nl = (const uint8_t *)memchr(p, '\n', (size_t)(end - p));
+        const uint8_t *next = nl ? nl + 1 : end;
+        line++;
+        if ((size_t)(next - p) > prefix && memcmp(p, CHECKSUM_TEXT_PREFIX, prefix) == 0) {
+            char tmp[32];
+            size_t n = (size_t)(next - p - prefix) < sizeof(tmp) - 1 ? (size_t)(next - p - prefix) : sizeof(tmp) - 1;
+            memcpy(tmp, p + prefix, n);
+            tmp[n] = 0;
+            char *rest;
+            uint32_t stored = (uint32_t)strtoul(tmp, &rest, 16);
+            uint32_t count = *rest == ',' ? (uint32_t)strtoul(rest + 1, NULL, 10) : UINT32_MAX;
+            if (stored != crc || count != lines) {
+                job->status = CHECKSUM_MISMATCH;
+                job->bad_line = block_first;
+                job->bad_lines = lines;
+                job->stored = stored;
+                job->computed = crc;
+                return;
+            }
+            checks++;
+            crc = 0;
+            lines = 0;
+            block_first = line + 1;
+        } else {
+            crc = crc32c(crc, p, (size_t)(next - p));
+            lines++;
+        }
+        p = next;
+    }
+    if (lines == 0) {
+        job->status = CHECKSUM_OK;
+    } else if (checks == 0) {
+        job->status = CHECKSUM_UNFRAMED;
+    } else {
+        job->status = CHECKSUM_UNSEALED;
+        job->bad_line = block_first;
+        job->bad_lines = lines;
+    }
+}
+
+static void verify_blocks(verify_item_t *it) {
+    const uint8_t *table = it->data + it->job->data_size;
+    for (uint64_t b = it->first; b < it->end; b++) {
+        uint64_t off = b * CHECKSUM_BLOCK;
+        size_t n = it->job->data_size - off < CHECKSUM_BLOCK ? (size_t)(it->job->data_size - off) : CHECKSUM_BLOCK;
+        uint32_t stored, computed = crc32c(0, it->data + off, n);
+        memcpy(&stored, table + b * sizeof(uint32_t), sizeof(stored));
+        if (stored != computed) {
+            it->bad = b;
+            it->stored = stored;
+            it->computed = computed;
+            return;
+        }
+    }
+}
+
+static void *verify_worker(void *arg) {
+    verify_pool_t *pool = (verify_pool_t *)arg;
+    for (;;) {
+        uint64_t i = plat_atomic_add_u64(&pool->next, 1) - 1;
+        if (i >= pool->count) return NULL;
+        verify_item_t *it = &pool->items[i];
+        if (it->job->kind == CHECKSUM_TEXT) verify_text(it);
+        else verify_blocks(it);
+    }
+}
+
+/* Checks a binary file's trailer and table; returns its block count, or -1
+ * with job->status set. */
+static int64_t open_binary(checksum_job_t *job, const plat_map_t *m) {
+    checksum_trailer_t t;
+    job->status = CHECKSUM_BAD_TRAILER;
+    if (m->size < sizeof(t)) return -1;
+    memcpy(&t, (const uint8_t *)m->data + m->size - sizeof(t), sizeof(t));
+    if (memcmp(t.magic, CHECKSUM_MAGIC, sizeof(CHECKSUM_MAGIC)) != 0 || t.crc != trailer_crc(&t) ||
+        t.block_size != CHECKSUM_BLOCK || t.data_size > m->size ||
+        (t.data_size + CHECKSUM_BLOCK - 1) / CHECKSUM_BLOCK != t.block_count ||
+        t.data_size + (uint64_t)t.block_count * sizeof(uint32_t) + sizeof(t) != m->size ||
+        crc32c(0, (const uint8_t *)m->data + t.data_size, (size_t)t.block_count * sizeof(uint32_t)) != t.table_crc) {
+        return -1;
+    }
+    job->status = CHECKSUM_OK;
+    job->data_size = t.data_size;
+    return t.block_count;
+}
+
+int checksum_verify(checksum_job_t *jobs, unsigned count) {
+    plat_map_t *maps = (plat_map_t *)mem_calloc(MEM_TAG_MISC, count ? count : 1, sizeof(plat_map_t));
+    if (!maps) return -1;
+    uint64_t item_count = 0;
+    for (unsigned j = 0; j < count; j++) {
+        checksum_job_t *job = &jobs[j];
+        job->status = CHECKSUM_OK;
+        job->data_size = 0;
+        if (plat_map_file(&maps[j], job->path) != 0) {
+            job->status = CHECKSUM_MISSING;
+            continue;
+        }
+        if (job->kind == CHECKSUM_TEXT) {
+            item_count++;
+            continue;
+        }
+        int64_t blocks = open_binary(job, &maps[j]);
+        if (blocks > 0) item_count += ((uint64_t)blocks + CHECKSUM_RANGE_BLOCKS - 1) / CHECKSUM_RANGE_BLOCKS;
+    }
+    verify_pool_t pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.items = (verify_item_t *)mem_calloc(MEM_TAG_MISC, item_count ? item_count : 1, sizeof(verify_item_t));
+    int rc = pool.items ? 0 : -1;
+    for (unsigned j = 0; rc == 0 && j < count; j++) {
+        checksum_job_t *job = &jobs[j];
+        if (job->status != CHECKSUM_OK) continue;
+        uint64_t blocks = job->kind == CHECKSUM_TEXT ? 1 : (job->data_size + CHECKSUM_BLOCK - 1) / CHECKSUM_BLOCK;
+        uint64_t step = job->kind == CHECKSUM_TEXT ? 1 : CHECKSUM_RANGE_BLOCKS;
+        for (uint64_t b = 0; b < blocks; b += step) {
+            verify_item_t *it = &pool.items[pool.count++];
+            it->job = job;
+            it->data = (const uint8_t *)maps[j].data;
+            it->size = maps[j].size;
+            it->first = b;
+            it->end = b + step < blocks ? b + step : blocks;
+            it->bad = UINT64_MAX;
+        }
+    }
+    if (rc == 0) {
+        unsigned threads = plat_cpu_count();
+        if (threads > CHECKSUM_MAX_THREADS) threads = CHECKSUM_MAX_THREADS;
+        if (threads > pool.count) threads = (unsigned)pool.count;
+        plat_thread_t workers[CHECKSUM_MAX_THREADS];
+        unsigned started = 0;
+        /* The calling thread is one of the workers. */
+        while (started + 1 < threads && plat_thread_create(&workers[started], verify_worker, &pool) == 0) started++;
+        verify_worker(&pool);
+        for (unsigned t = 0; t < started; t++) plat_thread_join(&workers[t]);
+        /* Items are in file order, so the first bad one per file wins. */
+        for (uint64_t i = 0; i < pool.count; i++) {
+            verify_item_t *it = &pool.items[i];
+            checksum_job_t *job = it->job;
+            if (it->bad == UINT64_MAX || job->status != CHECKSUM_OK) continue;
+            job->status = CHECKSUM_MISMATCH;
+            job->bad_block = it->bad;
+            job->bad_offset = it->bad * CHECKSUM_BLOCK;
+            job->bad_len = job->data_size - job->bad_offset < CHECKSUM_BLOCK ? job->data_size - job->bad_offset
+                                                                               : CHECKSUM_BLOCK;
+            job->stored = it->stored;
+            job->computed = it->computed;
+        }
+        for (unsigned j = 0; j < count; j++) {
+            checksum_status_t s = jobs[j].status;
+            if (s != CHECKSUM_OK && s != CHECKSUM_MISSING && s != CHECKSUM_UNFRAMED) rc = -1;
+        }
+    }
+    for (unsigned j = 0; j < count; j++) plat_unmap_file(&maps[j]);
+    mem_free(pool.items);
+    mem_free(maps);
+    return rc;
+}
+
+void checksum_describe(const checksum_job_t *job, char *out, size_t len) {
+    switch (job->status) {
+    case CHECKSUM_OK:
+        snprintf(out, len, "%s: ok", job->path);
+        break;
+    case CHECKSUM_MISSING:
+        snprintf(out, len, "%s: missing or empty", job->path);
+        break;
+    case CHECKSUM_UNFRAMED:
+        snprintf(out, len, "%s: no checksums (written by an older version)", job->path);
+        break;
+    case CHECKSUM_BAD_TRAILER:
+        snprintf(out, len, "%s: checksum table missing or damaged (truncated file?)", job->path);
+        break;
+    case CHECKSUM_MISMATCH:
+        if (job->kind == CHECKSUM_TEXT) {
+            snprintf(out, len, "%s: lines %llu-%llu fail their checksum (stored %08x, computed %08x)", job->path,
+                     (unsigned long long)job->bad_line, (unsigned long long)(job->bad_line + job->bad_lines - 1),
+                     (unsigned)job->stored, (unsigned)job->computed);
+        } else {
+            snprintf(out, len, "%s: block %llu (bytes %llu-%llu) fails its checksum (stored %08x, computed %08x)",
+                     job->path, (unsigned long long)job->bad_block, (unsigned long long)job->bad_offset,
+                     (unsigned long long)(job->bad_offset + job->bad_len - 1), (unsigned)job->stored,
+                     (unsigned)job->computed);
+        }
+        break;
+    case CHECKSUM_UNSEALED:
+        snprintf(out, len, "%s: lines %llu-%llu follow the last checksum (truncated or appended)", job->path,
+                 (unsigned long long)job->bad_line, (unsigned long long)(job->bad_line + job->bad_lines - 1));
+        break;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Integrity framing for persisted files, all CRC32C (core/crc32c.h).
+ *
+ * Binary files end with a checksum table: one CRC per CHECKSUM_BLOCK bytes
+ * of data, then a checksum_trailer_t. checksum_seal appends both once the
+ * file's data is final (header rewrites included); it reads the data back,
+ * which comes from the page cache right after writing.
+ *
+ * Text files (the CSVs) carry a line "#crc32c,<hex crc>,<lines>" after
+ * every CHECKSUM_TEXT_LINES data lines and at the end, covering the data
+ * lines since the previous check line. Parsers skip lines starting with
+ * '#'. atomic_file_printf writes this framing.
+ *
+ * checksum_verify checks a batch of files on several threads; binary files
+ * are split into ranges of blocks so one large file does not serialize the
+ * load. A failure names the first bad block and its byte range (binary) or
+ * the line range of the first bad block (text). */
+
+#define CHECKSUM_BLOCK (64u << 10)
+#define CHECKSUM_TEXT_LINES 4096u
+#define CHECKSUM_MAGIC "OVCRC1"
+#define CHECKSUM_TEXT_PREFIX "#crc32c,"
+
+typedef struct {
+    char magic[8];
+    uint64_t data_size;   /* bytes covered; the table starts here */
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t table_crc;
+    uint32_t crc;         /* of this trailer with crc = 0 */
+} checksum_trailer_t;
+
+/* Appends the table and trailer for everything in f (opened for update). */
+int checksum_seal(FILE *f);
+/* Formats the check line for crc over lines data lines; returns its length. */
+int checksum_text_line(char *out, size_t len, uint32_t crc, uint32_t lines);
+
+typedef enum { CHECKSUM_BINARY, CHECKSUM_TEXT } checksum_kind_t;
+
+typedef enum {
+    CHECKSUM_OK = 0,
+    CHECKSUM_MISSING,     /* no such file (or an empty one) */
+    CHECKSUM_UNFRAMED,    /* text without any check line: written before checksums */
+    CHECKSUM_BAD_TRAILER, /* binary trailer or table absent or damaged */
+    CHECKSUM_MISMATCH,    /* a block's CRC differs */
+    CHECKSUM_UNSEALED     /* text lines after the last check line */
+} checksum_status_t;
+
+typedef struct {
+    const char *path;
+    checksum_kind_t kind;
+    /* results */
+    checksum_status_t status;
+    uint64_t data_size;  /* binary: bytes before the table */
+    uint64_t bad_block;  /* binary: index of the first failing block */
+    uint64_t bad_offset; /* byte range of the failing block */
+    uint64_t bad_len;
+    uint64_t bad_line;   /* text: first line (1-based) of the failing block */
+    uint64_t bad_lines;
+    uint32_t stored, computed;
+} checksum_job_t;
+
+/* Fills in every job's results. Returns 0 when all are OK, MISSING or
+ * UNFRAMED, -1 otherwise. */
+int checksum_verify(checksum_job_t *jobs, unsigned count);
+/* One-line description of a job's result, e.g. for stderr. */
+void checksum_describe(const checksum_job_t *job, char *out, size_t len);
@@ -0,0 +1,406 @@
+#include "compactor.h"
+#include "atomic_file.h"
+#include "vote_segment.h"
+#include "../core/mem.h"
+#include "../core/trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define COMPACT_NAME_MAX 200
+#define COMPACT_SUFFIX ".seg"
+#define COMPACT_NAP_MS 50u
+#define COMPACT_MARKER "COMPACTING"
+
+typedef struct {
+    char name[COMPACT_NAME_MAX];
+    uint64_t size;
+} seg_file_t;
+
+typedef struct {
+    const char *dir;
+    seg_file_t *files;
+    size_t count;
+    size_t cap;
+    int failed;
+} seg_list_t;
+
+/* Per-merge state behind the keep callback, which sees every vote that is
+ * not an exact copy, newest input first within an id. */
+typedef struct {
+    volatile uint64_t *stop;
+    uint64_t budget;
+    double bytes_per_vote; /* of the inputs, to turn votes into I/O */
+    uint64_t seen;
+    uint64_t kept;
+    uint64_t last_id;
+    int have_last;
+    uint64_t superseded;
+    uint64_t start_ns;
+    uint64_t throttle_ns;
+} compact_ctx_t;
+
+void compact_options_init(compact_options_t *opts) {
+    opts->budget_bytes_per_sec = 0;
+    opts->small_bytes = 0;
+    opts->max_inputs = 0;
+}
+
+static int stopping(volatile uint64_t *stop) {
+    return stop && plat_atomic_load_u64(stop) != 0;
+}
+
+/* Sleeps ms in short naps; 0 if it ran to the end, -1 if stop was set. */
+static int nap(uint64_t ms, volatile uint64_t *stop) {
+    while (ms > 0) {
+        if (stopping(stop)) return -1;
+        unsigned step = ms < COMPACT_NAP_MS ? (unsigned)ms : COMPACT_NAP_MS;
+        plat_sleep_ms(step);
+        ms -= step;
+    }
+    return stopping(stop) ? -1 : 0;
+}
+
+static int file_size(const char *path, uint64_t *out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    int rc = fseek(f, 0, SEEK_END);
+    long end = rc == 0 ? ftell(f) : -1;
+    fclose(f);
+    if (end < 0) return -1;
+    *out = (uint64_t)end;
+    return 0;
+}
+
+static int is_segment_name(const char *name) {
+    size_t len = strlen(name), suffix = sizeof(COMPACT_SUFFIX) - 1;
+    return len > suffix && len < COMPACT_NAME_MAX && strcmp(name + len - suffix, COMPACT_SUFFIX) == 0 &&
+           !strchr(name, '/') && !strchr(name, '\\');
+}
+
+static int collect_segment(const char *name, void *ctx) {
+    seg_list_t *list = (seg_list_t *)ctx;
+    size_t len = strlen(name);
+    if (!is_segment_name(name)) return 0;
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        seg_file_t *files = (seg_file_t *)mem_realloc(MEM_TAG_MISC, list->files, cap * sizeof(seg_file_t));
+        if (!files) {
+            list->failed = 1;
+            return 1;
+        }
+        list->files = files;
+        list->cap = cap;
+    }
+    seg_file_t *s = &list->files[list->count];
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", list->dir, name);
+    if (file_size(path, &s->size) != 0) return 0; /* removed meanwhile */
+    memcpy(s->name, name, len + 1);
+    list->count++;
+    return 0;
+}
+
+/* Records a merge about to be renamed into place: the merged vote count,
+ * then the input names oldest first, the last being the output's. */
+static int write_marker(const char *dir, const seg_file_t *files, size_t n, uint64_t votes_out) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/" COMPACT_MARKER, dir);
+    atomic_file_t af;
+    FILE *f = atomic_file_open(&af, path);
+    if (!f) return -1;
+    int rc = fprintf(f, "%llu\n", (unsigned long long)votes_out) < 0 ? -1 : 0;
+    for (size_t i = 0; i < n && rc == 0; i++) {
+        if (fprintf(f, "%s\n", files[i].name) < 0) rc = -1;
+    }
+    if (rc != 0) {
+        atomic_file_abort(&af);
+        return -1;
+    }
+    if (atomic_file_commit(&af) != 0) return -1;
+    return plat_fsync_dir(dir);
+}
+
+/* Next name in a marker: 1, 0 at the end, -1 when malformed. */
+static int read_name(FILE *f, char *name) {
+    char line[COMPACT_NAME_MAX + 2];
+    if (!fgets(line, sizeof(line), f)) return 0;
+    line[strcspn(line, "\r\n")] = '\0';
+    if (!is_segment_name(line)) return -1;
+    strcpy(name, line);
+    return 1;
+}
+
+/* Vote count in the segment at path, or -1 when it is not one. */
+static int segment_votes(const char *path, uint64_t *out) {
+    plat_map_t map;
+    vote_seg_view_t view;
+    if (plat_map_file(&map, path) != 0) return -1;
+    int rc = vote_seg_view_open(&view, (const uint8_t *)map.data, map.size);
+    if (rc == 0) *out = view.hdr->vote_count;
+    plat_unmap_file(&map);
+    return rc;
+}
+
+/* Completes the merge a marker records. The output holding the merged vote
+ * count means it was renamed into place (or the newest input already held
+ * every id), so the older inputs are superseded and go; otherwise the
+ * inputs are intact and the merge is dropped. The marker goes last, so a
+ * crash in here just repeats this on the next pass. */
+static int finish_pending(const char *dir) {
+    char marker[256];
+    snprintf(marker, sizeof(marker), "%s/" COMPACT_MARKER, dir);
+    FILE *f = fopen(marker, "r");
+    if (!f) return 0;
+    char head[32], name[COMPACT_NAME_MAX], out[COMPACT_NAME_MAX], path[512];
+    unsigned long long votes_out;
+    size_t inputs = 0;
+    int rc = fgets(head, sizeof(head), f) && sscanf(head, "%llu", &votes_out) == 1 ? 1 : -1;
+    while (rc == 1 && (rc = read_name(f, name)) == 1) {
+        memcpy(out, name, sizeof(out));
+        inputs++;
+    }
+    uint64_t votes = 0;
+    if (rc == 0 && inputs > 0) {
+        snprintf(path, sizeof(path), "%s/%s", dir, out);
+        rc = segment_votes(path, &votes);
+    } else {
+        rc = -1;
+    }
+    if (rc == 0 && votes == votes_out) {
+        rewind(f);
+        rc = fgets(head, sizeof(head), f) ? 0 : -1;
+        for (size_t i = 0; rc == 0 && i + 1 < inputs; i++) {
+            if (read_name(f, name) != 1) rc = -1;
+            snprintf(path, sizeof(path), "%s/%s", dir, name);
+            if (rc == 0) remove(path);
+        }
+    }
+    fclose(f);
+    if (rc == 0) {
+        snprintf(path, sizeof(path), "%s/%s.tmp", dir, out);
+        remove(path);
+        rc = plat_fsync_dir(dir);
+    }
+    if (rc == 0) {
+        remove(marker);
+        rc = plat_fsync_dir(dir);
+    }
+    if (rc != 0) fprintf(stderr, "%s: cannot finish the merge it records\n", marker);
+    return rc;
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(((const seg_file_t *)a)->name, ((const seg_file_t *)b)->name);
+}
+
+/* Oldest run of at least two adjacent small segments, cut to max_inputs. */
+static int pick_run(const seg_list_t *list, const compact_options_t *opts, size_t *first, size_t *count) {
+    size_t i = 0;
+    while (i < list->count) {
+        size_t j = i;
+        while (j < list->count && (opts->small_bytes == 0 || list->files[j].size < opts->small_bytes)) j++;
+        if (j - i >= 2) {
+            *first = i;
+            *count = opts->max_inputs && j - i > opts->max_inputs ? opts->max_inputs : j - i;
+            return 1;
+        }
+        i = j + 1;
+    }
+    return 0;
+}
+
+/* Charges the votes seen and kept so far against the budget and sleeps off
+ * any lead; the estimate assumes output as dense as the inputs. */
+static int pace(compact_ctx_t *c) {
+    if (c->budget == 0) return stopping(c->stop) ? -1 : 0;
+    double io = (double)(c->seen + c->kept) * c->bytes_per_vote;
+    uint64_t due_ns = (uint64_t)(io / (double)c->budget * 1e9);
+    uint64_t elapsed = plat_now_ns() - c->start_ns;
+    if (due_ns <= elapsed + 1000000) return stopping(c->stop) ? -1 : 0;
+    uint64_t t0 = plat_now_ns();
+    int rc = nap((due_ns - elapsed) / 1000000, c->stop);
+    c->throttle_ns += plat_now_ns() - t0;
+    return rc;
+}
+
+static int compact_keep(void *ctx, const vote_rec_t *v) {
+    compact_ctx_t *c = (compact_ctx_t *)ctx;
+    if (++c->seen % VOTE_BLOCK_SIZE == 0 && pace(c) != 0) return -1;
+    if (c->have_last && v->id == c->last_id) {
+        c->superseded++;
+        return 0;
+    }
+    c->last_id = v->id;
+    c->have_last = 1;
+    c->kept++;
+    return 1;
+}
+
+/* Merges files[0..n) (oldest first) into the newest one's name. */
+static int merge_run(const char *dir, const seg_file_t *files, size_t n, const compact_options_t *opts,
+                     volatile uint64_t *stop, compact_stats_t *stats) {
+    plat_map_t *maps = (plat_map_t *)mem_calloc(MEM_TAG_MISC, n, sizeof(plat_map_t));
+    vote_seg_view_t *views = (vote_seg_view_t *)mem_calloc(MEM_TAG_MISC, n, sizeof(vote_seg_view_t));
+    int rc = maps && views ? 0 : -1;
+    char path[256];
+    uint64_t bytes_in = 0, votes_in = 0;
+    /* Newest first, so the merge hands the newest version of an id to keep first. */
+    for (size_t i = 0; i < n && rc == 0; i++) {
+        const seg_file_t *s = &files[n - 1 - i];
+        snprintf(path, sizeof(path), "%s/%s", dir, s->name);
+        if (plat_map_file(&maps[i], path) != 0 ||
+            vote_seg_view_open(&views[i], (const uint8_t *)maps[i].data, maps[i].size) != 0) {
+            fprintf(stderr, "%s: not a vote segment stream\n", path);
+            rc = -1;
+            break;
+        }
+        bytes_in += maps[i].size;
+        votes_in += views[i].hdr->vote_count;
+    }
+    compact_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.stop = stop;
+    ctx.budget = opts->budget_bytes_per_sec;
+    ctx.bytes_per_vote = votes_in ? (double)bytes_in / (double)votes_in : 0;
+    ctx.start_ns = plat_now_ns();
+    vote_seg_merge_stats_t ms;
+    memset(&ms, 0, sizeof(ms));
+    atomic_file_t af;
+    snprintf(path, sizeof(path), "%s/%s", dir, files[n - 1].name);
+    trace_begin_u64("compact.merge", "inputs", n);
+    FILE *f = rc == 0 ? atomic_file_open(&af, path) : NULL;
+    if (rc == 0 && !f) rc = -1;
+    if (rc == 0 && vote_seg_merge(f, views, n, compact_keep, &ctx, &ms) != 0) {
+        atomic_file_abort(&af);
+        if (!stopping(stop)) fprintf(stderr, "%s: compaction failed\n", path);
+        rc = -1;
+    } else if (rc == 0) {
+        /* The marker goes down before the rename, so a crash between the
+         * rename and deleting the older inputs is finished on the next
+         * pass, at startup if need be. */
+        rc = write_marker(dir, files, n, ms.votes_out);
+        if (rc == 0) rc = atomic_file_commit(&af);
+        else atomic_file_abort(&af);
+    }
+    trace_end("compact.merge");
+    for (size_t i = 0; i < n; i++) {
+        if (maps && maps[i].data) plat_unmap_file(&maps[i]);
+    }
+    mem_free(maps);
+    mem_free(views);
+    /* The merged file replaced the newest input; the older ones are now
+     * wholly superseded. A failed commit or marker is resolved the same
+     * way, from what reached the disk. */
+    if (finish_pending(dir) != 0 || rc != 0) return -1;
+    stats->passes++;
+    stats->segments_in += n;
+    stats->segments_out++;
+    stats->votes_in += ms.votes_in;
+    stats->votes_out += ms.votes_out;
+    stats->superseded += ctx.superseded;
+    stats->duplicates += ms.duplicates;
+    stats->bytes_read += bytes_in;
+    stats->bytes_written += ms.bytes;
+    stats->throttle_ns += ctx.throttle_ns;
+    return 0;
+}
+
+int compact_pass(const char *dir, const compact_options_t *opts, volatile uint64_t *stop, compact_stats_t *stats) {
+    seg_list_t list;
+    memset(&list, 0, sizeof(list));
+    list.dir = dir;
+    if (finish_pending(dir) != 0 || plat_list_dir(dir, collect_segment, &list) < 0 || list.failed) {
+        mem_free(list.files);
+        stats->failed++;
+        return -1;
+    }
+    qsort(list.files, list.count, sizeof(seg_file_t), by_name);
+    size_t first = 0, count = 0;
+    int rc = 0;
+    if (pick_run(&list, opts, &first, &count)) {
+        rc = merge_run(dir, list.files + first, count, opts, stop, stats) == 0 ? 1 : -1;
+        if (rc < 0 && !stopping(stop)) stats->failed++;
+    }
+    mem_free(list.files);
+    return rc;
+}
+
+int compact_dir(const char *dir, const compact_options_t *opts, volatile uint64_t *stop, compact_stats_t *stats) {
+    int rc;
+    while ((rc = compact_pass(dir, opts, stop, stats)) == 1 && !stopping(stop)) {
+    }
+    return rc < 0 ? -1 : 0;
+}
+
+static void add_stats(compact_stats_t *dst, const compact_stats_t *src) {
+    dst->passes += src->passes;
+    dst->segments_in += src->segments_in;
+    dst->segments_out += src->segments_out;
+    dst->votes_in += src->votes_in;
+    dst->votes_out += src->votes_out;
+    dst->superseded += src->superseded;
+    dst->duplicates += src->duplicates;
+    dst->bytes_read += src->bytes_read;
+    dst->bytes_written += src->bytes_written;
+    dst->throttle_ns += src->throttle_ns;
+    dst->failed += src->failed;
+}
+
+/* After a failed pass the wait doubles, up to 64 intervals, so a damaged
+ * file is not re-read every few seconds. */
+static void *compactor_main(void *arg) {
+    compactor_t *c = (compactor_t *)arg;
+    uint64_t wait_ms = c->interval_ms;
+    while (!stopping(&c->stop)) {
+        int rc;
+        do {
+            compact_stats_t st;
+            memset(&st, 0, sizeof(st));
+            rc = compact_pass(c->dir, &c->opts, &c->stop, &st);
+            plat_mutex_lock(&c->lock);
+            add_stats(&c->stats, &st);
+            plat_mutex_unlock(&c->lock);
+        } while (rc == 1 && !stopping(&c->stop));
+        if (rc < 0 && wait_ms < (uint64_t)c->interval_ms * 64) wait_ms *= 2;
+        else if (rc >= 0) wait_ms = c->interval_ms;
+        nap(wait_ms, &c->stop);
+    }
+    return NULL;
+}
+
+int compactor_start(compactor_t *c, const char *dir, const compact_options_t *opts, unsigned interval_ms) {
+    memset(c, 0, sizeof(*c));
+    if (strlen(dir) >= sizeof(c->dir) || plat_make_dir(dir) != 0) return -1;
+    strcpy(c->dir, dir);
+    c->opts = *opts;
+    c->interval_ms = interval_ms ? interval_ms : 1000;
+    if (plat_mutex_init(&c->lock) != 0) return -1;
+    if (plat_thread_create(&c->thread, compactor_main, c) != 0) {
+        plat_mutex_destroy(&c->lock);
+        return -1;
+    }
+    return 0;
+}
+
+void compactor_stop(compactor_t *c) {
+    plat_atomic_add_u64(&c->stop, 1);
+    plat_thread_join(&c->thread);
+    plat_mutex_destroy(&c->lock);
+}
+
+void compactor_get_stats(compactor_t *c, compact_stats_t *out) {
+    plat_mutex_lock(&c->lock);
+    *out = c->stats;
+    plat_mutex_unlock(&c->lock);
+}
+
+void compact_print_stats(const compact_stats_t *st, FILE *out) {
+    fprintf(out, "Compaction: %llu merges, %llu segments into %llu, %llu failed\n", (unsigned long long)st->passes,
+            (unsigned long long)st->segments_in, (unsigned long long)st->segments_out,
+            (unsigned long long)st->failed);
+    fprintf(out, "  votes %llu in, %llu kept, %llu superseded, %llu duplicates\n", (unsigned long long)st->votes_in,
+            (unsigned long long)st->votes_out, (unsigned long long)st->superseded,
+            (unsigned long long)st->duplicates);
+    fprintf(out, "  %.1f MB read, %.1f MB written, %.1f ms throttled\n", st->bytes_read / 1e6,
+            st->bytes_written / 1e6, st->throttle_ns / 1e6);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "../core/platform.h"
+
+/* Compaction of a segment directory: a directory of vote segment streams
+ * (columnar exports, say one per machine per round) named *.seg, where a
+ * name that sorts later is newer. A pass picks the oldest run of adjacent
+ * segments below small_bytes, merges up to max_inputs of them with
+ * vote_seg_merge into one stream that takes the newest input's name, and
+ * deletes the rest. When a vote id occurs in several inputs the newest
+ * input's vote is kept and the others are dropped as superseded, so a
+ * re-exported range replaces the old one. The output is written through
+ * atomic_file and renamed over the newest input before the older ones are
+ * removed. Just before the rename a COMPACTING marker naming the inputs
+ * and the merged vote count is made durable, and it is removed once the
+ * older inputs are gone; every pass, so also the first after a restart,
+ * starts by finishing a merge a marker records (deleting the older inputs
+ * when the output holds the merged count, else dropping the merge).
+ *
+ * Only adjacent segments are merged, so the name order of the votes that
+ * survive never changes. I/O (input streams read plus output written) is
+ * paced to budget_bytes_per_sec by sleeping between blocks. */
+
+/* Background defaults: what counts as small, and inputs per merge. */
+#define COMPACT_SMALL_BYTES (64ull << 20)
+#define COMPACT_MAX_INPUTS 64u
+
+typedef struct {
+    uint64_t budget_bytes_per_sec; /* 0 = unthrottled */
+    uint64_t small_bytes;          /* 0 = any size, merging the whole directory */
+    unsigned max_inputs;           /* 0 = no limit */
+} compact_options_t;
+
+typedef struct {
+    uint64_t passes;      /* merges done */
+    uint64_t segments_in;
+    uint64_t segments_out;
+    uint64_t votes_in;
+    uint64_t votes_out;
+    uint64_t superseded;  /* older versions of a vote id dropped */
+    uint64_t duplicates;  /* exact copies dropped */
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t throttle_ns; /* time slept to honour the budget */
+    uint64_t failed;
+} compact_stats_t;
+
+void compact_options_init(compact_options_t *opts);
+/* One merge in dir, added to stats. Returns 1 if segments were merged, 0 if
+ * nothing qualified, -1 on error (the inputs are left as they were). stop,
+ * when not NULL, is polled while merging and abandons the merge once
+ * non-zero. */
+int compact_pass(const char *dir, const compact_options_t *opts, volatile uint64_t *stop, compact_stats_t *stats);
+/* Passes until nothing qualifies; -1 if one fails. */
+int compact_dir(const char *dir, const compact_options_t *opts, volatile uint64_t *stop, compact_stats_t *stats);
+
+/* Background compactor: a thread that checks dir (created if missing)
+ * every interval_ms and runs passes until nothing qualifies. */
+typedef struct {
+    char dir[256];
+    compact_options_t opts;
+    unsigned interval_ms;
+    plat_thread_t thread;
+    plat_mutex_t lock; /* guards stats */
+    volatile uint64_t stop;
+    compact_stats_t stats;
+} compactor_t;
+
+int compactor_start(compactor_t *c, const char *dir, const compact_options_t *opts, unsigned interval_ms);
+/* Abandons a merge in progress (its inputs stay) and joins the thread. */
+void compactor_stop(compactor_t *c);
+void compactor_get_stats(compactor_t *c, compact_stats_t *out);
+void compact_print_stats(const compact_stats_t *st, FILE *out);
@@ -3,7 +3,7 @@
 #include "../core/hash_table.h"
 
 typedef struct {
-    hash_table_t id_to_offset;
+    hash_table_t id_to_offset; /* id -> record index; offset = index * record size */
 } storage_index_t;
 
 typedef struct {
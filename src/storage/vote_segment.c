@@ -0,0 +1,519 @@
+#include "vote_segment.h"
+#include "../core/crc32c.h"
+#include "../core/mem.h"
+#include "../core/selection_tree.h"
+#include <string.h>
+
+enum { COL_FOR = 0, COL_DELTA = 1 };
+enum { BLOCK_HAS_SIGNATURES = 1 };
+#define VOTE_COLUMNS 5
+
+static unsigned bit_width(uint64_t x) {
+    unsigned w = 0;
+    while (x) {
+        w++;
+        x >>= 1;
+    }
+    return w;
+}
+
+static uint64_t zigzag(int64_t d) {
+    return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+}
+
+static int64_t unzigzag(uint64_t z) {
+    return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *out) {
+    uint64_t v = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Byte-wise little-endian load; compilers turn it into one load on
+ * little-endian targets, and it keeps the format the same everywhere. */
+static uint64_t load_le64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static size_t packed_bytes(uint32_t n, unsigned w) {
+    return ((size_t)n * w + 7) / 8;
+}
+
+/* LSB-first bit packing at a fixed width. */
+static size_t pack(const uint64_t *x, uint32_t n, unsigned w, uint8_t *out) {
+    size_t bytes = packed_bytes(n, w);
+    memset(out, 0, bytes);
+    for (uint32_t i = 0; i < n && w; i++) {
+        uint64_t v = x[i];
+        size_t pos = (size_t)i * w;
+        for (unsigned left = w; left;) {
+            unsigned off = (unsigned)(pos & 7), take = 8 - off < left ? 8 - off : left;
+            out[pos >> 3] |= (uint8_t)((v & ((1u << take) - 1)) << off);
+            v >>= take;
+            pos += take;
+            left -= take;
+        }
+    }
+    return bytes;
+}
+
+/* Branch-free per value: one word load, shift and mask, so the loop
+ * vectorizes. Widths above 56 may straddle nine bytes and take the slower
+ * path. */
+static void unpack(const uint8_t *in, uint32_t n, unsigned w, uint64_t base, uint64_t *out) {
+    if (w == 0) {
+        for (uint32_t i = 0; i < n; i++) out[i] = base;
+        return;
+    }
+    uint64_t mask = w == 64 ? ~(uint64_t)0 : ((uint64_t)1 << w) - 1;
+    if (w <= 56) {
+        for (uint32_t i = 0; i < n; i++) {
+            size_t bit = (size_t)i * w;
+            out[i] = base + ((load_le64(in + (bit >> 3)) >> (bit & 7)) & mask);
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        size_t bit = (size_t)i * w;
+        unsigned sh = (unsigned)(bit & 7);
+        uint64_t v = load_le64(in + (bit >> 3)) >> sh;
+        if (sh) v |= (uint64_t)in[(bit >> 3) + 8] << (64 - sh);
+        out[i] = base + (v & mask);
+    }
+}
+
+/* Column header: mode, width, start (first value, delta mode only), base. */
+static uint8_t *encode_column(const uint64_t *v, uint32_t n, uint8_t *p) {
+    uint64_t lo = v[0], hi = v[0];
+    for (uint32_t i = 1; i < n; i++) {
+        if (v[i] < lo) lo = v[i];
+        if (v[i] > hi) hi = v[i];
+    }
+    unsigned for_width = bit_width(hi - lo);
+    uint64_t d[VOTE_BLOCK_SIZE];
+    uint64_t dlo = UINT64_MAX, dhi = 0;
+    for (uint32_t i = 1; i < n; i++) {
+        d[i - 1] = zigzag((int64_t)(v[i] - v[i - 1]));
+        if (d[i - 1] < dlo) dlo = d[i - 1];
+        if (d[i - 1] > dhi) dhi = d[i - 1];
+    }
+    if (n > 1 && bit_width(dhi - dlo) < for_width) {
+        unsigned w = bit_width(dhi - dlo);
+        for (uint32_t i = 0; i + 1 < n; i++) d[i] -= dlo;
+        *p++ = COL_DELTA;
+        *p++ = (uint8_t)w;
+        p = put_varint(p, v[0]);
+        p = put_varint(p, dlo);
+        return p + pack(d, n - 1, w, p);
+    }
+    for (uint32_t i = 0; i < n; i++) d[i] = v[i] - lo;
+    *p++ = COL_FOR;
+    *p++ = (uint8_t)for_width;
+    p = put_varint(p, 0);
+    p = put_varint(p, lo);
+    return p + pack(d, n, for_width, p);
+}
+
+static const uint8_t *decode_column(const uint8_t *p, const uint8_t *end, uint32_t n, uint64_t *out) {
+    if (end - p < 2) return NULL;
+    unsigned mode = p[0], w = p[1];
+    p += 2;
+    uint64_t start, base;
+    if (mode > COL_DELTA || w > 64 || !(p = get_varint(p, end, &start)) || !(p = get_varint(p, end, &base))) {
+        return NULL;
+    }
+    uint32_t count = mode == COL_DELTA ? n - 1 : n;
+    size_t bytes = packed_bytes(count, w);
+    if ((size_t)(end - p) < bytes) return NULL;
+    if (mode == COL_FOR) {
+        unpack(p, count, w, base, out);
+    } else {
+        unpack(p, count, w, base, out + 1);
+        out[0] = start;
+        for (uint32_t i = 1; i < n; i++) out[i] = out[i - 1] + (uint64_t)unzigzag(out[i]);
+    }
+    return p + bytes;
+}
+
+static int has_signature(const vote_rec_t *v) {
+    for (size_t i = 0; i < sizeof(v->signature); i++) {
+        if (v->signature[i]) return 1;
+    }
+    return 0;
+}
+
+static uint64_t vote_field(const vote_rec_t *v, int column) {
+    switch (column) {
+    case 0: return v->id;
+    case 1: return v->election_id;
+    case 2: return v->voter_id;
+    case 3: return v->choice;
+    default: return (uint64_t)(int64_t)v->timestamp;
+    }
+}
+
+size_t vote_block_encode(const vote_rec_t *votes, uint32_t n, uint8_t *out) {
+    if (n == 0 || n > VOTE_BLOCK_SIZE) return 0;
+    uint64_t col[VOTE_BLOCK_SIZE] = {0};
+    int sigs = 0;
+    for (uint32_t i = 0; i < n && !sigs; i++) sigs = has_signature(&votes[i]);
+    uint8_t *p = out;
+    *p++ = sigs ? BLOCK_HAS_SIGNATURES : 0;
+    for (int c = 0; c < VOTE_COLUMNS; c++) {
+        for (uint32_t i = 0; i < n; i++) col[i] = vote_field(&votes[i], c);
+        p = encode_column(col, n, p);
+    }
+    for (uint32_t i = 0; i < n && sigs; i++) {
+        memcpy(p, votes[i].signature, sizeof(votes[i].signature));
+        p += sizeof(votes[i].signature);
+    }
+    return (size_t)(p - out);
+}
+
+size_t vote_block_decode(const uint8_t *in, size_t avail, uint32_t n, vote_rec_t *out) {
+    if (n == 0 || n > VOTE_BLOCK_SIZE || avail < 1 || (in[0] & ~BLOCK_HAS_SIGNATURES)) return 0;
+    uint64_t cols[VOTE_COLUMNS][VOTE_BLOCK_SIZE];
+    const uint8_t *p = in + 1, *end = in + avail;
+    for (int c = 0; c < VOTE_COLUMNS; c++) {
+        if (!(p = decode_column(p, end, n, cols[c]))) return 0;
+    }
+    size_t sig_bytes = (in[0] & BLOCK_HAS_SIGNATURES) ? (size_t)n * sizeof(out->signature) : 0;
+    if ((size_t)(end - p) < sig_bytes) return 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (cols[3][i] > UINT32_MAX) return 0;
+        vote_rec_t *v = &out[i];
+        v->id = cols[0][i];
+        v->election_id = cols[1][i];
+        v->voter_id = cols[2][i];
+        v->choice = (uint32_t)cols[3][i];
+        v->timestamp = (time_t)(int64_t)cols[4][i];
+        if (sig_bytes) {
+            memcpy(v->signature, p, sizeof(v->signature));
+            p += sizeof(v->signature);
+        } else {
+            memset(v->signature, 0, sizeof(v->signature));
+        }
+    }
+    return (size_t)(p - in);
+}
+
+/* Bytes after index_offset: the block index, then the search tree over
+ * its first ids (keys, then ranks). */
+static uint64_t tail_bytes(uint64_t blocks) {
+    return blocks * sizeof(vote_seg_index_t) + (blocks + 1) * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+static uint32_t header_crc(const vote_seg_header_t *h) {
+    vote_seg_header_t copy = *h;
+    copy.crc = 0;
+    return crc32c(0, &copy, sizeof(copy));
+}
+
+/* Encodes n votes as the next block. */
+static void write_block(vote_seg_writer_t *w, const vote_rec_t *votes, uint32_t n) {
+    if (w->failed) return;
+    if (w->blocks == w->index_cap) {
+        uint64_t cap = w->index_cap ? w->index_cap * 2 : 64;
+        vote_seg_index_t *index =
+            cap <= UINT32_MAX ? (vote_seg_index_t *)mem_realloc(MEM_TAG_VOTES, w->index, (size_t)cap * sizeof(*index)) : NULL;
+        if (!index) {
+            w->failed = 1;
+            return;
+        }
+        w->index = index;
+        w->index_cap = cap;
+    }
+    size_t size = vote_block_encode(votes, n, w->buf);
+    vote_seg_index_t *e = &w->index[w->blocks++];
+    e->offset = w->off;
+    e->first_id = votes[0].id;
+    e->crc = crc32c(0, w->buf, size);
+    e->reserved = 0;
+    if (fwrite(w->buf, 1, size, w->f) != size) w->failed = 1;
+    w->off += size;
+    w->count += n;
+}
+
+int vote_seg_writer_init(vote_seg_writer_t *w, FILE *f) {
+    memset(w, 0, sizeof(*w));
+    w->f = f;
+    w->start = ftell(f);
+    w->off = sizeof(vote_seg_header_t);
+    w->block = (vote_rec_t *)mem_alloc(MEM_TAG_VOTES, VOTE_BLOCK_SIZE * sizeof(vote_rec_t));
+    w->buf = (uint8_t *)mem_alloc(MEM_TAG_VOTES, VOTE_BLOCK_MAX_BYTES);
+    vote_seg_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr)); /* placeholder until finish */
+    if (!w->block || !w->buf || w->start < 0 || fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        mem_free(w->block);
+        mem_free(w->buf);
+        return -1;
+    }
+    return 0;
+}
+
+void vote_seg_writer_add(vote_seg_writer_t *w, const vote_rec_t *votes, uint64_t n) {
+    while (n > 0) {
+        if (w->pending == 0 && n >= VOTE_BLOCK_SIZE) {
+            write_block(w, votes, VOTE_BLOCK_SIZE); /* straight from the caller's array */
+            votes += VOTE_BLOCK_SIZE;
+            n -= VOTE_BLOCK_SIZE;
+            continue;
+        }
+        uint32_t take = VOTE_BLOCK_SIZE - w->pending;
+        if (take > n) take = (uint32_t)n;
+        memcpy(w->block + w->pending, votes, take * sizeof(vote_rec_t));
+        w->pending += take;
+        votes += take;
+        n -= take;
+        if (w->pending == VOTE_BLOCK_SIZE) {
+            write_block(w, w->block, VOTE_BLOCK_SIZE);
+            w->pending = 0;
+        }
+    }
+}
+
+int vote_seg_writer_finish(vote_seg_writer_t *w, uint64_t *out_bytes) {
+    if (w->pending) write_block(w, w->block, w->pending);
+    w->pending = 0;
+    uint64_t blocks = w->blocks;
+    uint64_t *first_ids = (uint64_t *)mem_alloc(MEM_TAG_VOTES, (blocks + 1) * sizeof(uint64_t));
+    uint64_t *keys = (uint64_t *)mem_alloc(MEM_TAG_VOTES, (blocks + 1) * sizeof(uint64_t));
+    uint32_t *ranks = (uint32_t *)mem_alloc(MEM_TAG_VOTES, (blocks + 1) * sizeof(uint32_t));
+    int rc = !w->failed && first_ids && keys && ranks ? 0 : -1;
+    vote_seg_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, VOTE_SEG_MAGIC, sizeof(VOTE_SEG_MAGIC));
+    hdr.block_size = VOTE_BLOCK_SIZE;
+    hdr.block_count = w->blocks;
+    hdr.vote_count = w->count;
+    /* The index is read in place, so it starts 8-byte aligned. */
+    static const uint8_t zeros[8];
+    size_t pad = (size_t)((8 - w->off % 8) % 8);
+    if (rc == 0 && pad && fwrite(zeros, 1, pad, w->f) != pad) rc = -1;
+    hdr.index_offset = w->off + pad;
+    hdr.total_size = hdr.index_offset + tail_bytes(blocks);
+    if (rc == 0) {
+        for (uint32_t b = 0; b < w->blocks; b++) first_ids[b] = w->index[b].first_id;
+        eytzinger_layout(first_ids, w->blocks, keys, ranks);
+        uint32_t crc = crc32c(0, w->index, (size_t)blocks * sizeof(vote_seg_index_t));
+        crc = crc32c(crc, keys, (size_t)(blocks + 1) * sizeof(uint64_t));
+        hdr.index_crc = crc32c(crc, ranks, (size_t)(blocks + 1) * sizeof(uint32_t));
+    }
+    hdr.crc = header_crc(&hdr);
+    if (rc == 0 && (fwrite(w->index, sizeof(vote_seg_index_t), (size_t)blocks, w->f) != blocks ||
+                    fwrite(keys, sizeof(uint64_t), (size_t)blocks + 1, w->f) != blocks + 1 ||
+                    fwrite(ranks, sizeof(uint32_t), (size_t)blocks + 1, w->f) != blocks + 1)) {
+        rc = -1;
+    }
+    if (rc == 0 && (fseek(w->f, w->start, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, w->f) != 1 ||
+                    fseek(w->f, w->start + (long)hdr.total_size, SEEK_SET) != 0)) {
+        rc = -1;
+    }
+    mem_free(first_ids);
+    mem_free(keys);
+    mem_free(ranks);
+    mem_free(w->index);
+    mem_free(w->block);
+    mem_free(w->buf);
+    memset(w, 0, sizeof(*w));
+    if (rc == 0 && out_bytes) *out_bytes = hdr.total_size;
+    return rc;
+}
+
+int vote_seg_write(FILE *f, const vote_rec_t *votes, const uint32_t *sel, uint64_t count, uint64_t *out_bytes) {
+    vote_seg_writer_t w;
+    if (vote_seg_writer_init(&w, f) != 0) return -1;
+    if (!sel) vote_seg_writer_add(&w, votes, count);
+    for (uint64_t i = 0; sel && i < count; i++) vote_seg_writer_add(&w, &votes[sel[i]], 1);
+    return vote_seg_writer_finish(&w, out_bytes);
+}
+
+int vote_seg_view_open(vote_seg_view_t *v, const uint8_t *data, size_t size) {
+    memset(v, 0, sizeof(*v));
+    if (size < sizeof(vote_seg_header_t) || ((uintptr_t)data & 7)) return -1;
+    const vote_seg_header_t *h = (const vote_seg_header_t *)(const void *)data;
+    if (memcmp(h->magic, VOTE_SEG_MAGIC, sizeof(VOTE_SEG_MAGIC)) != 0 || h->crc != header_crc(h) ||
+        h->block_size != VOTE_BLOCK_SIZE ||
+        h->total_size != size || h->index_offset % 8 != 0 || h->index_offset < sizeof(*h) ||
+        h->index_offset > size || size - h->index_offset != tail_bytes(h->block_count) ||
+        (h->vote_count + VOTE_BLOCK_SIZE - 1) / VOTE_BLOCK_SIZE != h->block_count) {
+        return -1;
+    }
+    const vote_seg_index_t *index = (const vote_seg_index_t *)(const void *)(data + h->index_offset);
+    if (crc32c(0, index, (size_t)(size - h->index_offset)) != h->index_crc) return -1;
+    const uint64_t *keys = (const uint64_t *)(const void *)(index + h->block_count);
+    const uint32_t *ranks = (const uint32_t *)(const void *)(keys + h->block_count + 1);
+    for (uint32_t k = 1; k <= h->block_count; k++) {
+        if (ranks[k] >= h->block_count || keys[k] != index[ranks[k]].first_id) return -1;
+    }
+    v->ids_sorted = 1;
+    for (uint32_t b = 0; b < h->block_count; b++) {
+        uint64_t next = b + 1 < h->block_count ? index[b + 1].offset : h->index_offset;
+        if (index[b].offset < sizeof(*h) || index[b].offset >= next) return -1;
+        if (b > 0 && index[b].first_id < index[b - 1].first_id) v->ids_sorted = 0;
+    }
+    if (h->block_count && index[0].offset != sizeof(*h)) return -1;
+    v->data = data;
+    v->hdr = h;
+    v->index = index;
+    v->search.keys = keys;
+    v->search.ranks = ranks;
+    v->search.count = h->block_count;
+    return 0;
+}
+
+int vote_seg_view_block(const vote_seg_view_t *v, uint32_t b, vote_rec_t *out) {
+    if (b >= v->hdr->block_count) return -1;
+    uint64_t first = (uint64_t)b * VOTE_BLOCK_SIZE;
+    uint32_t n = v->hdr->vote_count - first < VOTE_BLOCK_SIZE ? (uint32_t)(v->hdr->vote_count - first) : VOTE_BLOCK_SIZE;
+    uint64_t off = v->index[b].offset;
+    uint64_t end = b + 1 < v->hdr->block_count ? v->index[b + 1].offset : v->hdr->index_offset;
+    /* The block may be followed by alignment padding before the index. The
+     * CRC covers only the encoded bytes, whose length decoding tells us;
+     * the decoder is bounds-checked, so damaged input cannot overrun. */
+    size_t used = vote_block_decode(v->data + off, (size_t)(end - off), n, out);
+    if (used == 0 || (b + 1 < v->hdr->block_count && used != end - off) || end - off - used >= 8) return -1;
+    if (crc32c(0, v->data + off, used) != v->index[b].crc) return -1;
+    return (int)n;
+}
+
+int64_t vote_seg_view_find_block(const vote_seg_view_t *v, uint64_t id) {
+    if (!v->ids_sorted) return -1;
+    uint32_t b = eytzinger_upper_bound(&v->search, id);
+    return b ? (int64_t)b - 1 : -1;
+}
+
+int64_t vote_seg_view_block_at(const vote_seg_view_t *v, uint64_t off) {
+    uint32_t count = v->hdr->block_count;
+    if (count == 0 || off < v->index[0].offset || off >= v->hdr->index_offset) return -1;
+    uint32_t lo = 0, hi = count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (v->index[mid].offset <= off) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+int vote_seg_view_decode_all(const vote_seg_view_t *v, vote_rec_t *out, uint32_t *bad_block) {
+    for (uint32_t b = 0; b < v->hdr->block_count; b++) {
+        if (vote_seg_view_block(v, b, out + (size_t)b * VOTE_BLOCK_SIZE) < 0) {
+            if (bad_block) *bad_block = b;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* One merge input and its decoded current block. */
+typedef struct {
+    const vote_seg_view_t *view;
+    vote_rec_t *block;
+    uint32_t next_block;
+    uint32_t n, pos;
+} merge_input_t;
+
+/* 0 with the next block decoded, 1 once the input is done, -1 if damaged. */
+static int merge_fill(merge_input_t *in) {
+    while (in->next_block < in->view->hdr->block_count) {
+        int n = vote_seg_view_block(in->view, in->next_block++, in->block);
+        if (n < 0) return -1;
+        in->n = (uint32_t)n;
+        in->pos = 0;
+        if (n > 0) return 0;
+    }
+    return 1;
+}
+
+static int same_vote(const vote_rec_t *a, const vote_rec_t *b) {
+    return a->id == b->id && a->election_id == b->election_id && a->voter_id == b->voter_id && a->choice == b->choice &&
+           a->timestamp == b->timestamp && memcmp(a->signature, b->signature, sizeof(a->signature)) == 0;
+}
+
+int vote_seg_merge(FILE *f, const vote_seg_view_t *inputs, size_t k, vote_seg_keep_fn keep, void *ctx,
+                   vote_seg_merge_stats_t *stats) {
+    vote_seg_merge_stats_t local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    size_t slots = k ? k : 1;
+    merge_input_t *in = (merge_input_t *)mem_calloc(MEM_TAG_VOTES, slots, sizeof(merge_input_t));
+    vote_rec_t *blocks = (vote_rec_t *)mem_alloc(MEM_TAG_VOTES, slots * VOTE_BLOCK_SIZE * sizeof(vote_rec_t));
+    vote_rec_t *run = (vote_rec_t *)mem_alloc(MEM_TAG_VOTES, slots * sizeof(vote_rec_t)); /* written with this id */
+    uint64_t *keys = (uint64_t *)mem_calloc(MEM_TAG_VOTES, slots, sizeof(uint64_t));
+    uint8_t *done = (uint8_t *)mem_calloc(MEM_TAG_VOTES, slots, 1);
+    int rc = in && blocks && run && keys && done ? 0 : -1;
+    for (size_t i = 0; i < k && rc == 0; i++) {
+        in[i].view = &inputs[i];
+        in[i].block = blocks + i * VOTE_BLOCK_SIZE;
+        int r = merge_fill(&in[i]);
+        if (r < 0) rc = -1;
+        done[i] = r == 1;
+        keys[i] = r == 0 ? in[i].block[0].id : 0;
+    }
+    loser_tree_t tree;
+    memset(&tree, 0, sizeof(tree));
+    if (rc == 0) rc = loser_tree_init(&tree, keys, done, k);
+    vote_seg_writer_t w;
+    int writing = rc == 0 && vote_seg_writer_init(&w, f) == 0;
+    if (!writing) rc = -1;
+    size_t run_len = 0;
+    while (rc == 0 && !loser_tree_empty(&tree)) {
+        merge_input_t *s = &in[loser_tree_winner(&tree)];
+        const vote_rec_t *v = &s->block[s->pos];
+        uint64_t id = v->id;
+        int dup = 0, verdict = 1;
+        if (run_len && run[0].id != id) run_len = 0;
+        for (size_t j = 0; j < run_len && !dup; j++) dup = same_vote(&run[j], v);
+        stats->votes_in++;
+        if (dup) {
+            stats->duplicates++;
+        } else if (keep && (verdict = keep(ctx, v)) < 0) {
+            rc = -1;
+        } else if (verdict == 0) {
+            stats->dropped++;
+        } else {
+            vote_seg_writer_add(&w, v, 1);
+            stats->votes_out++;
+            run[run_len++] = *v; /* at most one per input, since ids ascend strictly within one */
+        }
+        if (rc != 0) break;
+        if (++s->pos == s->n) {
+            int r = merge_fill(s);
+            if (r != 0) {
+                if (r < 0) rc = -1;
+                loser_tree_finish(&tree);
+                continue;
+            }
+        }
+        if (s->block[s->pos].id <= id) rc = -1; /* not in id order */
+        else loser_tree_replace(&tree, s->block[s->pos].id);
+    }
+    if (writing && vote_seg_writer_finish(&w, &stats->bytes) != 0) rc = -1;
+    loser_tree_free(&tree);
+    mem_free(in);
+    mem_free(blocks);
+    mem_free(run);
+    mem_free(keys);
+    mem_free(done);
+    return rc;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../core/eytzinger.h"
+#include "../models/vote.h"
+
+/* Compressed, column-wise encoding of vote records. Votes are cut into
+ * blocks of VOTE_BLOCK_SIZE; inside a block each field is a column that is
+ * either frame-of-reference coded (value - block minimum) or delta coded
+ * (zigzag difference from the previous value, minus the smallest one),
+ * whichever needs fewer bits, then bit-packed at that fixed width.
+ * Sequential ids and a block from one election pack to 0 bits per value;
+ * choices take just the bits their largest value needs. Signatures are
+ * stored raw, and only for blocks that have a non-zero one.
+ *
+ * Stream layout (host-endian, offsets relative to the stream start):
+ *   vote_seg_header_t
+ *   block[block_count]          varint column headers + packed columns
+ *   vote_seg_index_t[block_count]  offset, first id and CRC32C of each block
+ *   u64[block_count + 1], u32[block_count + 1]  the block first ids as an
+ *                               Eytzinger search tree (keys, then ranks)
+ * The index gives random access to any block without decoding the rest,
+ * and the tree finds the block holding a vote id in a few cache lines;
+ * the header carries CRCs of itself and of everything after the blocks,
+ * so a block read on its own is still verified end to end. */
+
+#define VOTE_SEG_MAGIC "OVVSEG3"
+#define VOTE_BLOCK_SIZE 128u
+/* Upper bound for one encoded block: flags, five column headers, five
+ * columns of 64-bit values and the signatures. */
+#define VOTE_BLOCK_MAX_BYTES (1u + 5u * (2u + 20u + VOTE_BLOCK_SIZE * 8u) + VOTE_BLOCK_SIZE * 256u)
+/* Decoders read whole 64-bit words, so in-memory streams need this much
+ * readable slack past their end. */
+#define VOTE_SEG_SLACK 8u
+
+typedef struct {
+    char magic[8];
+    uint32_t block_size;
+    uint32_t block_count;
+    uint64_t vote_count;
+    uint64_t index_offset;
+    uint64_t total_size;
+    uint32_t index_crc;
+    uint32_t crc; /* of this header with crc = 0 */
+} vote_seg_header_t;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t first_id;
+    uint32_t crc; /* of the encoded block */
+    uint32_t reserved;
+} vote_seg_index_t;
+
+/* Encodes n (<= VOTE_BLOCK_SIZE) votes into out (VOTE_BLOCK_MAX_BYTES);
+ * returns the encoded size. */
+size_t vote_block_encode(const vote_rec_t *votes, uint32_t n, uint8_t *out);
+/* Decodes n votes from in[0..avail); returns bytes consumed, 0 if the
+ * block is malformed. in must have VOTE_SEG_SLACK readable bytes past avail. */
+size_t vote_block_decode(const uint8_t *in, size_t avail, uint32_t n, vote_rec_t *out);
+
+/* Writes count votes as one stream at the file's current position: votes[0..
+ * count), or votes[sel[0..count)] when sel is not NULL. */
+int vote_seg_write(FILE *f, const vote_rec_t *votes, const uint32_t *sel, uint64_t count, uint64_t *out_bytes);
+
+/* Stream written incrementally: each block is encoded and written as it
+ * fills, so only the block index stays in memory. */
+typedef struct {
+    FILE *f;
+    long start;             /* file position of the header */
+    uint64_t off;           /* stream bytes so far */
+    uint64_t count;         /* votes in written blocks */
+    vote_seg_index_t *index;
+    uint64_t index_cap;
+    uint32_t blocks;
+    uint32_t pending;       /* votes in block waiting to be encoded */
+    vote_rec_t *block;
+    uint8_t *buf;
+    int failed;
+} vote_seg_writer_t;
+
+int vote_seg_writer_init(vote_seg_writer_t *w, FILE *f);
+void vote_seg_writer_add(vote_seg_writer_t *w, const vote_rec_t *votes, uint64_t n);
+/* Writes the last block, index and header, and releases w either way. */
+int vote_seg_writer_finish(vote_seg_writer_t *w, uint64_t *out_bytes);
+
+/* Read-only view over a stream in memory, validated once at open. */
+typedef struct {
+    const uint8_t *data;
+    const vote_seg_header_t *hdr;
+    const vote_seg_index_t *index;
+    eytzinger_t search; /* borrowed from the stream */
+    int ids_sorted;     /* block first ids ascend, so find_block can search */
+} vote_seg_view_t;
+
+int vote_seg_view_open(vote_seg_view_t *v, const uint8_t *data, size_t size);
+/* Decodes block b into out (VOTE_BLOCK_SIZE records); returns its vote count,
+ * or -1 if the block fails its CRC or is malformed. */
+int vote_seg_view_block(const vote_seg_view_t *v, uint32_t b, vote_rec_t *out);
+/* Block that would hold vote id, or -1 when ids are not ascending. */
+int64_t vote_seg_view_find_block(const vote_seg_view_t *v, uint64_t id);
+/* Block whose encoded bytes contain stream offset off, or -1. */
+int64_t vote_seg_view_block_at(const vote_seg_view_t *v, uint64_t off);
+/* Decodes the whole stream into out (hdr->vote_count records); on failure
+ * *bad_block (if not NULL) is the block that failed. */
+int vote_seg_view_decode_all(const vote_seg_view_t *v, vote_rec_t *out, uint32_t *bad_block);
+
+typedef struct {
+    uint64_t votes_in;
+    uint64_t votes_out;
+    uint64_t duplicates; /* exact copies of a vote already written */
+    uint64_t dropped;    /* refused by keep */
+    uint64_t bytes;
+} vote_seg_merge_stats_t;
+
+/* 1 to write v, 0 to drop it, -1 to abandon the merge. */
+typedef int (*vote_seg_keep_fn)(void *ctx, const vote_rec_t *v);
+
+/* Merges k streams, each in ascending vote id order, into one stream at f's
+ * position, in one pass: a loser tree picks the next vote in log2(k)
+ * comparisons, and each input is decoded one block at a time. Votes with
+ * equal ids come out in input order; exact copies are written once. keep
+ * (may be NULL) filters votes. -1 on a write error, a damaged block, an
+ * input out of id order or when keep abandons the merge. */
+int vote_seg_merge(FILE *f, const vote_seg_view_t *inputs, size_t k, vote_seg_keep_fn keep, void *ctx,
+                   vote_seg_merge_stats_t *stats);
@@ -1,24 +1,529 @@
 #include "wal.h"
+#include "../core/crc32c.h"
+#include "../core/mem.h"
+#include "../core/platform.h"
+#include <stdlib.h>
 #include <string.h>
 
-int wal_open(wal_t *wal, const char *path) {
-    wal->file = fopen(path, "ab");
-    return wal->file ? 0 : -1;
+static void segment_path(const char *dir, uint64_t start, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s/%020llu.wal", dir, (unsigned long long)start);
 }
 
-int wal_append(wal_t *wal, const void *data, uint32_t len) {
-    if (!wal->file) {
+static int parse_segment_name(const char *name, uint64_t *out_start) {
+    char *end;
+    unsigned long long v = strtoull(name, &end, 10);
+    if (end == name || strcmp(end, ".wal") != 0) return -1;
+    *out_start = (uint64_t)v;
+    return 0;
+}
+
+enum { WAL_TAG_WRITE = 1, WAL_TAG_SYNC };
+
+#define WAL_AIO_DEPTH 8u
+#define WAL_BATCH_MIN (64u << 10)
+
+static uint32_t record_crc(const wal_record_hdr_t *h, const void *payload) {
+    wal_record_hdr_t copy = *h;
+    copy.crc = 0;
+    return crc32c(crc32c(0, &copy, sizeof(copy)), payload, h->len);
+}
+
+static int is_spare_name(const char *name) {
+    return strncmp(name, "spare-", 6) == 0;
+}
+
+typedef struct {
+    char name[64];
+    unsigned count;
+} spare_scan_t;
+
+static int scan_spares(const char *name, void *ctx) {
+    spare_scan_t *scan = (spare_scan_t *)ctx;
+    if (!is_spare_name(name)) return 0;
+    if (scan->count++ == 0) snprintf(scan->name, sizeof(scan->name), "%s", name);
+    return 0;
+}
+
+/* Keeps a covered segment as a spare while there is room, else deletes it. */
+static int retire_segment(const char *dir, uint64_t start, unsigned *spares) {
+    char path[300], spare[300];
+    segment_path(dir, start, path, sizeof(path));
+    if (*spares < WAL_SPARE_SEGMENTS) {
+        snprintf(spare, sizeof(spare), "%s/spare-%020llu.seg", dir, (unsigned long long)start);
+        if (plat_replace_file(path, spare) == 0) {
+            (*spares)++;
+            return 0;
+        }
+    }
+    return remove(path) == 0 ? 0 : -1;
+}
+
+static int open_segment(wal_t *wal) {
+    char path[300];
+    segment_path(wal->dir, wal->next_lsn, path, sizeof(path));
+    wal->segment_bytes = 0;
+    spare_scan_t scan;
+    char from[sizeof(wal->dir) + sizeof(scan.name)];
+    memset(&scan, 0, sizeof(scan));
+    plat_list_dir(wal->dir, scan_spares, &scan);
+    snprintf(from, sizeof(from), "%s/%s", wal->dir, scan.name);
+    /* A reused file keeps its old records past our tail; they read as the
+     * end of the log. Otherwise any same-named file can only hold a torn
+     * first record, so truncate it. */
+    int reused = scan.count > 0 && plat_replace_file(from, path) == 0;
+    int flags = reused ? 0 : PLAT_OPEN_TRUNC;
+    wal->fd = plat_open_write(path, flags | (wal->direct ? PLAT_OPEN_DIRECT : 0));
+    if (wal->fd < 0 && wal->direct) {
+        /* The filesystem refused O_DIRECT (tmpfs, for one): stay buffered. */
+        wal->direct = 0;
+        wal->align = 1;
+        wal->fd = plat_open_write(path, flags);
+    }
+    if (wal->fd < 0) return -1;
+    if (reused) wal->segments_reused++;
+    else wal->segments_created++;
+    if (plat_preallocate(wal->fd, WAL_SEGMENT_BYTES) != 0) {
+        plat_close_fd(wal->fd);
+        wal->fd = -1;
+        return -1;
+    }
+    /* The new name must survive a crash before records in it count. */
+    return plat_fsync_dir(wal->dir);
+}
+
+int wal_open(wal_t *wal, const char *dir, uint64_t next_lsn, const wal_options_t *opts) {
+    memset(wal, 0, sizeof(*wal));
+    wal->fd = -1;
+    if (strlen(dir) >= sizeof(wal->dir) || plat_make_dir(dir) != 0) return -1;
+    strcpy(wal->dir, dir);
+    wal->next_lsn = next_lsn ? next_lsn : 1;
+    wal->durable_lsn = wal->next_lsn - 1;
+    wal->direct = opts && opts->direct;
+    wal->align = wal->direct ? PLAT_DIRECT_ALIGN : 1;
+    if (aio_init(&wal->aio, opts ? opts->engine : AIO_AUTO, WAL_AIO_DEPTH) != 0) return -1;
+    if (open_segment(wal) != 0) {
+        aio_free(&wal->aio);
         return -1;
     }
-    size_t w = fwrite(data, 1, len, wal->file);
-    fflush(wal->file);
-    return w == len ? 0 : -1;
+    return 0;
+}
+
+/* Bytes actually written for a batch: padded to the block size with zeros
+ * under O_DIRECT. */
+static uint32_t batch_write_len(const wal_t *wal, const wal_batch_t *b) {
+    return (b->len + wal->align - 1) & ~(wal->align - 1);
+}
+
+static int batch_reserve(wal_batch_t *b, uint32_t need) {
+    if (need <= b->cap) return 0;
+    uint32_t cap = b->cap ? b->cap : WAL_BATCH_MIN;
+    while (cap < need) cap *= 2;
+    /* Aligned for O_DIRECT; cheap enough to do always. */
+    void *raw = mem_alloc(MEM_TAG_WAL, (size_t)cap + PLAT_DIRECT_ALIGN);
+    if (!raw) return -1;
+    uint8_t *data = (uint8_t *)(((uintptr_t)raw + PLAT_DIRECT_ALIGN - 1) & ~(uintptr_t)(PLAT_DIRECT_ALIGN - 1));
+    if (b->len) memcpy(data, b->data, b->len);
+    mem_free(b->raw);
+    b->raw = raw;
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+/* Hands the filling batch to the engine as a linked write+fdatasync, unless
+ * a commit is already in flight. */
+static void wal_kick(wal_t *wal) {
+    wal_batch_t *b = &wal->batch[wal->open_batch];
+    if (wal->ops_pending || wal->failed || b->records == 0) return;
+    uint32_t wlen = batch_write_len(wal, b);
+    if (wlen > b->len) memset(b->data + b->len, 0, wlen - b->len);
+    if (aio_queue_write(&wal->aio, wal->fd, b->data, wlen, b->base_off, WAL_TAG_WRITE, 1) != 0 ||
+        aio_queue_fdatasync(&wal->aio, wal->fd, WAL_TAG_SYNC, 0) != 0 || aio_submit(&wal->aio) != 2) {
+        wal->failed = 1;
+        return;
+    }
+    wal->ops_pending = 2;
+    wal->open_batch ^= 1;
+    wal->batch[wal->open_batch].len = 0;
+    wal->batch[wal->open_batch].records = 0;
+}
+
+static void wal_reap(wal_t *wal, int wait) {
+    if (!wal->ops_pending) return;
+    wal_batch_t *b = &wal->batch[wal->open_batch ^ 1];
+    aio_completion_t done[2];
+    int n = aio_reap(&wal->aio, done, 2, wait ? wal->ops_pending : 0);
+    if (n < 0) {
+        wal->failed = 1;
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        if (done[i].result < 0 || (done[i].tag == WAL_TAG_WRITE && done[i].result != (int64_t)batch_write_len(wal, b))) {
+            wal->failed = 1;
+        }
+    }
+    wal->ops_pending -= (uint32_t)n;
+    if (wal->ops_pending == 0 && !wal->failed) {
+        wal->durable_lsn = b->last_lsn;
+        wal->commits++;
+        if (b->records > wal->max_batch) wal->max_batch = b->records;
+    }
+}
+
+/* An empty batch starts at the block holding the segment's tail; under
+ * O_DIRECT the already-written part of that block is carried over from the
+ * previous batch so the rewrite keeps it. */
+static int batch_begin(wal_t *wal, wal_batch_t *b) {
+    b->base_off = wal->segment_bytes & ~(uint64_t)(wal->align - 1);
+    uint32_t prefix = (uint32_t)(wal->segment_bytes - b->base_off);
+    if (batch_reserve(b, WAL_BATCH_MIN) != 0) return -1;
+    if (prefix) {
+        const wal_batch_t *prev = &wal->batch[wal->open_batch ^ 1];
+        memcpy(b->data, prev->data + (b->base_off - prev->base_off), prefix);
+    }
+    b->len = prefix;
+    return 0;
+}
+
+int wal_append(wal_t *wal, uint16_t type, const void *data, uint32_t len, uint64_t *out_lsn) {
+    if (wal->failed || len > WAL_MAX_RECORD) return -1;
+    uint32_t rec = (uint32_t)sizeof(wal_record_hdr_t) + len;
+    if (wal->segment_bytes > 0 && wal->segment_bytes + rec > WAL_SEGMENT_BYTES && wal_rotate(wal) != 0) return -1;
+    if (wal->fd < 0 && open_segment(wal) != 0) return -1;
+    wal_batch_t *b = &wal->batch[wal->open_batch];
+    if (b->records == 0 && batch_begin(wal, b) != 0) return -1;
+    if (batch_reserve(b, batch_write_len(wal, b) + rec + wal->align) != 0) return -1;
+    wal_record_hdr_t h;
+    memset(&h, 0, sizeof(h));
+    h.len = len;
+    h.type = type;
+    h.lsn = wal->next_lsn;
+    h.time_us = plat_wall_us();
+    h.crc = record_crc(&h, data);
+    memcpy(b->data + b->len, &h, sizeof(h));
+    if (len) memcpy(b->data + b->len + sizeof(h), data, len);
+    b->len += rec;
+    b->records++;
+    b->last_lsn = h.lsn;
+    wal->segment_bytes += rec;
+    wal->next_lsn++;
+    wal->records++;
+    wal->bytes += rec;
+    if (out_lsn) *out_lsn = h.lsn;
+    wal_poll(wal);
+    return wal->failed ? -1 : 0;
+}
+
+void wal_poll(wal_t *wal) {
+    wal_reap(wal, 0);
+    wal_kick(wal);
+}
+
+int wal_sync(wal_t *wal, uint64_t lsn) {
+    if (lsn >= wal->next_lsn) lsn = wal->next_lsn - 1;
+    while (wal->durable_lsn < lsn && !wal->failed) {
+        wal_kick(wal);
+        wal_reap(wal, 1);
+    }
+    return wal->durable_lsn >= lsn ? 0 : -1;
+}
+
+int wal_rotate(wal_t *wal) {
+    if (wal->fd >= 0 && wal->segment_bytes == 0) return 0;
+    if (wal_sync(wal, wal->next_lsn - 1) != 0) return -1;
+    if (wal->fd >= 0) {
+        plat_close_fd(wal->fd);
+        wal->fd = -1;
+    }
+    return open_segment(wal);
 }
 
 void wal_close(wal_t *wal) {
-    if (wal->file) {
-        fclose(wal->file);
-        wal->file = NULL;
+    wal_sync(wal, wal->next_lsn - 1);
+    aio_free(&wal->aio);
+    if (wal->fd >= 0) {
+        plat_close_fd(wal->fd);
+        wal->fd = -1;
+        if (wal->segment_bytes == 0) {
+            /* Nothing was logged; hand the file back to the spare pool. */
+            spare_scan_t scan;
+            memset(&scan, 0, sizeof(scan));
+            plat_list_dir(wal->dir, scan_spares, &scan);
+            retire_segment(wal->dir, wal->next_lsn, &scan.count);
+        }
+    }
+    mem_free(wal->batch[0].raw);
+    mem_free(wal->batch[1].raw);
+    memset(wal->batch, 0, sizeof(wal->batch));
+}
+
+void wal_print_stats(const wal_t *wal, FILE *out) {
+    fprintf(out, "WAL (%s engine): %llu records, %llu bytes in %llu commits (max %u per commit), durable LSN %llu%s\n",
+            aio_kind_name(wal->aio.kind), (unsigned long long)wal->records, (unsigned long long)wal->bytes,
+            (unsigned long long)wal->commits, wal->max_batch, (unsigned long long)wal->durable_lsn,
+            wal->failed ? ", FAILED" : "");
+    fprintf(out, "  %llu ops in %llu submissions, %llu failed\n", (unsigned long long)wal->aio.ops_submitted,
+            (unsigned long long)wal->aio.submit_calls, (unsigned long long)wal->aio.ops_failed);
+    fprintf(out, "  segments: %llu reused, %llu created, %s writes\n", (unsigned long long)wal->segments_reused,
+            (unsigned long long)wal->segments_created, wal->direct ? "O_DIRECT" : "buffered");
+}
+
+typedef struct {
+    uint64_t *starts;
+    size_t count, cap;
+    unsigned spares;
+} segment_list_t;
+
+static int collect_segment(const char *name, void *ctx) {
+    segment_list_t *list = (segment_list_t *)ctx;
+    uint64_t start;
+    if (is_spare_name(name)) list->spares++;
+    if (parse_segment_name(name, &start) != 0) return 0;
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 16;
+        uint64_t *ns = (uint64_t *)mem_realloc(MEM_TAG_WAL, list->starts, cap * sizeof(uint64_t));
+        if (!ns) return -1;
+        list->starts = ns;
+        list->cap = cap;
+    }
+    list->starts[list->count++] = start;
+    return 0;
+}
+
+static int u64_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int wal_truncate(const char *dir, uint64_t upto_lsn) {
+    segment_list_t list;
+    memset(&list, 0, sizeof(list));
+    if (plat_list_dir(dir, collect_segment, &list) != 0) {
+        mem_free(list.starts);
+        return -1;
+    }
+    qsort(list.starts, list.count, sizeof(uint64_t), u64_cmp);
+    int retired = 0;
+    /* A segment ends where the next one starts; the newest is never retired. */
+    for (size_t i = 0; i + 1 < list.count && list.starts[i + 1] <= upto_lsn + 1; i++) {
+        if (retire_segment(dir, list.starts[i], &list.spares) == 0) retired++;
+    }
+    mem_free(list.starts);
+    return retired;
+}
+
+/* --- reader --- */
+
+typedef struct {
+    uint64_t target;
+    uint64_t best;     /* largest start <= target */
+    uint64_t smallest; /* smallest start overall */
+    int have_best;
+    int have_any;
+} segment_scan_t;
+
+static int scan_segment(const char *name, void *ctx) {
+    segment_scan_t *scan = (segment_scan_t *)ctx;
+    uint64_t start;
+    if (parse_segment_name(name, &start) != 0) return 0;
+    if (!scan->have_any || start < scan->smallest) scan->smallest = start;
+    scan->have_any = 1;
+    if (start <= scan->target && (!scan->have_best || start > scan->best)) {
+        scan->best = start;
+        scan->have_best = 1;
+    }
+    return 0;
+}
+
+static int reader_open_segment(wal_reader_t *r, uint64_t start) {
+    char path[300];
+    segment_path(r->dir, start, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    if (r->file) fclose(r->file);
+    r->file = f;
+    r->segment_start = start;
+    return 0;
+}
+
+static int segment_exists(const wal_reader_t *r, uint64_t start) {
+    char path[300];
+    segment_path(r->dir, start, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fclose(f);
+    return 1;
+}
+
+typedef struct {
+    uint64_t after;
+    int found;
+} newer_scan_t;
+
+static int scan_newer(const char *name, void *ctx) {
+    newer_scan_t *scan = (newer_scan_t *)ctx;
+    uint64_t start;
+    if (parse_segment_name(name, &start) == 0 && start > scan->after) scan->found = 1;
+    return scan->found;
+}
+
+/* 1 if the writer has started a segment after next_lsn without one named
+ * for it, i.e. the records from next_lsn were retired; -1 on error. */
+static int segment_retired(const wal_reader_t *r) {
+    newer_scan_t scan = {r->next_lsn, 0};
+    if (plat_list_dir(r->dir, scan_newer, &scan) < 0) return -1;
+    return scan.found && !segment_exists(r, r->next_lsn);
+}
+
+int wal_reader_open(wal_reader_t *r, const char *dir, uint64_t from_lsn) {
+    memset(r, 0, sizeof(*r));
+    if (strlen(dir) >= sizeof(r->dir)) return -1;
+    strcpy(r->dir, dir);
+    if (from_lsn == 0) from_lsn = 1;
+    r->next_lsn = from_lsn;
+    segment_scan_t scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.target = from_lsn;
+    plat_list_dir(dir, scan_segment, &scan);
+    if (!scan.have_best) {
+        /* Records before the oldest segment must already be covered. */
+        return scan.have_any && scan.smallest > from_lsn ? -1 : 0;
     }
+    if (reader_open_segment(r, scan.best) != 0) return -1;
+    r->next_lsn = scan.best;
+    wal_record_hdr_t h;
+    const void *payload;
+    while (r->next_lsn < from_lsn) {
+        int rc = wal_reader_next(r, &h, &payload);
+        if (rc < 0) return -1;
+        if (rc == 0) {
+            /* The log ends before from_lsn: everything up to it is in the
+             * caller's snapshot, so wait for the segment that follows. */
+            fclose(r->file);
+            r->file = NULL;
+            r->next_lsn = from_lsn;
+            break;
+        }
+    }
+    return 0;
+}
+
+int wal_reader_next(wal_reader_t *r, wal_record_hdr_t *hdr, const void **payload) {
+    int reopened = 0, reread = 0;
+    for (;;) {
+        if (!r->file && reader_open_segment(r, r->next_lsn) != 0) {
+            if (segment_retired(r) != 1) return 0;
+            r->truncated = 1;
+            return -1;
+        }
+        long pos = ftell(r->file);
+        wal_record_hdr_t h;
+        int corrupt = 0;
+        /* Zeros and records older than the segment are preallocated or
+         * recycled space past the tail. */
+        if (fread(&h, sizeof(h), 1, r->file) == 1 && h.lsn != 0 && h.lsn >= r->segment_start) {
+            if (h.len > WAL_MAX_RECORD || h.lsn != r->next_lsn) {
+                /* The open file may have been recycled as a newer segment
+                 * under us: reopen it by name and read the same offset. */
+                if (!reopened) {
+                    reopened = 1;
+                    uint64_t start = r->segment_start;
+                    if (!segment_exists(r, start)) {
+                        r->truncated = 1;
+                        return -1;
+                    }
+                    if (reader_open_segment(r, start) == 0 && fseek(r->file, pos, SEEK_SET) == 0) continue;
+                }
+                corrupt = 1;
+            } else {
+                if (h.len > r->buf_cap) {
+                    uint8_t *nb = (uint8_t *)mem_realloc(MEM_TAG_WAL, r->buf, h.len);
+                    if (!nb) return -1;
+                    r->buf = nb;
+                    r->buf_cap = h.len;
+                }
+                /* A CRC mismatch is a record still being written. */
+                if ((h.len == 0 || fread(r->buf, 1, h.len, r->file) == h.len) && record_crc(&h, r->buf) == h.crc) {
+                    r->next_lsn++;
+                    r->bad_lsn = 0;
+                    *hdr = h;
+                    *payload = r->buf;
+                    return 1;
+                }
+                r->bad_lsn = h.lsn;
+                r->bad_segment = r->segment_start;
+                r->bad_offset = (uint64_t)pos;
+            }
+        }
+        /* End of the written data, a torn tail or garbage. If the writer
+         * has since started a segment at next_lsn, continue there. A
+         * segment nothing was read from yet is reopened by name on the next
+         * call, since the writer may have replaced or removed it. */
+        clearerr(r->file);
+        fseek(r->file, pos, SEEK_SET);
+        if (r->segment_start == r->next_lsn) {
+            fclose(r->file);
+            r->file = NULL;
+        } else if (segment_exists(r, r->next_lsn)) {
+            /* A recovery restarted the log at next_lsn, past a torn tail. */
+            fclose(r->file);
+            r->file = NULL;
+            r->bad_lsn = 0;
+            continue;
+        } else if (!corrupt) {
+            /* stdio keeps the preallocated zeros or torn bytes it buffered
+             * past the tail; a fresh handle sees what the writer appended
+             * since. */
+            if (reader_open_segment(r, r->segment_start) == 0) fseek(r->file, pos, SEEK_SET);
+            if (segment_retired(r) == 1) {
+                /* A newer segment but none at next_lsn: either the writer
+                 * finished this one after we read its end, or the segment
+                 * holding next_lsn was retired. The listing came first, so
+                 * reading once more tells them apart. */
+                if (!reread) {
+                    reread = 1;
+                    continue;
+                }
+                r->truncated = 1;
+                return -1;
+            }
+        }
+        return corrupt ? -1 : 0;
+    }
+}
+
+/* Walks the records after the bad one by their lengths; 1 if one of them
+ * is intact. */
+static int intact_record_after(const wal_reader_t *r) {
+    char path[300];
+    segment_path(r->dir, r->bad_segment, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    uint8_t *buf = (uint8_t *)mem_alloc(MEM_TAG_WAL, WAL_MAX_RECORD);
+    wal_record_hdr_t h;
+    int found = 0;
+    int ok = buf && fseek(f, (long)r->bad_offset, SEEK_SET) == 0 && fread(&h, sizeof(h), 1, f) == 1 &&
+             h.len <= WAL_MAX_RECORD && fseek(f, (long)h.len, SEEK_CUR) == 0;
+    while (ok && !found && fread(&h, sizeof(h), 1, f) == 1 && h.lsn > r->bad_lsn && h.len <= WAL_MAX_RECORD) {
+        if (h.len && fread(buf, 1, h.len, f) != h.len) break;
+        found = record_crc(&h, buf) == h.crc;
+    }
+    mem_free(buf);
+    fclose(f);
+    return buf ? found : -1;
 }
 
+int wal_reader_stopped_at_tail(const wal_reader_t *r) {
+    newer_scan_t scan = {r->bad_lsn ? r->bad_segment : r->segment_start, 0};
+    if (plat_list_dir(r->dir, scan_newer, &scan) < 0) return -1;
+    if (scan.found) return 0;
+    if (!r->bad_lsn) return 1; /* a torn header: nothing after it can be parsed */
+    int after = intact_record_after(r);
+    return after < 0 ? -1 : !after;
+}
+
+void wal_reader_close(wal_reader_t *r) {
+    if (r->file) fclose(r->file);
+    mem_free(r->buf);
+    memset(r, 0, sizeof(*r));
+}
@@ -1,12 +1,127 @@
 #pragma once
 #include <stdint.h>
 #include <stdio.h>
+#include "aio.h"
+
+/* Write-ahead log split into segment files <dir>/<first lsn>.wal. Every
+ * record carries a dense, increasing LSN; a segment is named after the LSN
+ * of its first record, so a reader that finishes one segment knows the
+ * name of the next. Records are host-endian:
+ *   wal_record_hdr_t, then len payload bytes.
+ *
+ * Appends go into an in-memory batch. While one batch is being written and
+ * fdatasynced (a linked pair on the async engine) the next one fills up, and
+ * it goes out as soon as the previous commit completes: group commit, with
+ * the caller free to apply its change while the I/O runs. Records share a
+ * sync only when several are appended before the caller waits on one (a
+ * bulk path); a caller that syncs after every append gets one record per
+ * commit.
+ *
+ * Segments are preallocated to WAL_SEGMENT_BYTES, so commits never grow the
+ * file and fdatasync has no size metadata to write. Segments a snapshot
+ * covers are renamed to spare-<n>.seg and reused for the next segment
+ * instead of being deleted (up to WAL_SPARE_SEGMENTS of them), which keeps
+ * disk usage bounded and skips block allocation in steady state. A reused
+ * or preallocated file holds zeros or older records past the tail; both
+ * read as the end of the log, since their LSN is 0 or below the segment's
+ * first. */
+
+#define WAL_SEGMENT_BYTES (4u << 20)
+#define WAL_MAX_RECORD (1u << 20)
+#define WAL_SPARE_SEGMENTS 4u
 
 typedef struct {
-    FILE *file;
+    uint32_t len;     /* payload bytes */
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t crc;     /* CRC32C of this header (crc = 0) and the payload */
+    uint32_t pad;
+    uint64_t lsn;
+    uint64_t time_us; /* wall clock at append */
+} wal_record_hdr_t;
+
+typedef struct {
+    aio_kind_t engine;
+    int direct; /* O_DIRECT with block-aligned writes; falls back if refused */
+} wal_options_t;
+
+typedef struct {
+    uint8_t *data;     /* aligned start inside raw */
+    void *raw;
+    uint32_t len;      /* bytes from base_off, including any carried block prefix */
+    uint32_t cap;
+    uint32_t records;
+    uint64_t base_off; /* segment offset of data[0] */
+    uint64_t last_lsn;
+} wal_batch_t;
+
+typedef struct {
+    char dir[256];
+    int fd;                 /* current segment */
+    uint64_t next_lsn;
+    uint64_t segment_bytes; /* appended to the current segment, written or not */
+    uint32_t align;         /* write granularity: 1, or PLAT_DIRECT_ALIGN with O_DIRECT */
+    int direct;
+    uint64_t durable_lsn;   /* every record up to here is on stable storage */
+    aio_t aio;
+    wal_batch_t batch[2];   /* the one filling up and the one in flight */
+    uint32_t open_batch;
+    uint32_t ops_pending;   /* of the in-flight write+fdatasync pair */
+    int failed;             /* a commit failed; the log refuses further appends */
+    /* metrics */
+    uint64_t commits;
+    uint64_t records;
+    uint64_t bytes;
+    uint32_t max_batch;
+    uint64_t segments_reused;
+    uint64_t segments_created;
 } wal_t;
 
-int wal_open(wal_t *wal, const char *path);
-int wal_append(wal_t *wal, const void *data, uint32_t len);
+/* Starts a fresh segment at next_lsn; earlier segments are left alone.
+ * opts may be NULL for the defaults. */
+int wal_open(wal_t *wal, const char *dir, uint64_t next_lsn, const wal_options_t *opts);
+/* Queues a record; it is durable once wal_sync for its LSN returns 0. */
+int wal_append(wal_t *wal, uint16_t type, const void *data, uint32_t len, uint64_t *out_lsn);
+/* Reaps finished commits and starts the next batch without blocking. */
+void wal_poll(wal_t *wal);
+/* Blocks until every record up to lsn is durable. */
+int wal_sync(wal_t *wal, uint64_t lsn);
+/* Makes everything durable and closes the current segment (if it holds
+ * anything) so the next record starts a new one. */
+int wal_rotate(wal_t *wal);
 void wal_close(wal_t *wal);
+void wal_print_stats(const wal_t *wal, FILE *out);
+/* Retires segments whose records all have LSN <= upto_lsn, i.e. are covered
+ * by a snapshot: kept as spares up to WAL_SPARE_SEGMENTS, deleted beyond.
+ * Returns the number of segments retired. */
+int wal_truncate(const char *dir, uint64_t upto_lsn);
+
+/* Tails the segments of a live log. */
+typedef struct {
+    char dir[256];
+    FILE *file;
+    uint64_t segment_start; /* first LSN of the open segment */
+    uint64_t next_lsn;      /* LSN of the next record to return */
+    uint8_t *buf;
+    uint32_t buf_cap;
+    /* The last record that failed its CRC (0 if none): a torn tail while
+     * the writer is live, damage when replaying after a crash. */
+    uint64_t bad_lsn;
+    uint64_t bad_segment;
+    uint64_t bad_offset;
+    /* Set with a -1 from wal_reader_next when the segment holding next_lsn
+     * was retired (removed or recycled) before it was read. */
+    int truncated;
+} wal_reader_t;
 
+int wal_reader_open(wal_reader_t *r, const char *dir, uint64_t from_lsn);
+/* Returns 1 with the next record (payload valid until the next call), 0
+ * when no complete record is available yet, -1 on a gap or corruption
+ * (with truncated set if wal_truncate removed records not yet read). */
+int wal_reader_next(wal_reader_t *r, wal_record_hdr_t *hdr, const void **payload);
+void wal_reader_close(wal_reader_t *r);
+/* After wal_reader_next stopped on a bad record: 1 when it is the torn
+ * tail of the last write, i.e. it is in the newest segment and no intact
+ * record follows it there; 0 when the log is damaged (committed records
+ * lie beyond it), -1 on error. */
+int wal_reader_stopped_at_tail(const wal_reader_t *r);